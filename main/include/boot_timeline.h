@@ -0,0 +1,39 @@
+#ifndef _BOOT_TIMELINE_H_
+#define _BOOT_TIMELINE_H_
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * boot phases in the order they are expected, networking phases run in parallel tasks
+ * so netif ~ http_response may complete in any order
+ */
+typedef enum
+{
+    BOOT_PHASE_APP_MAIN = 0,        // app_main entered
+    BOOT_PHASE_NVS,                 // nvs flash initialized, persisted state readable
+    BOOT_PHASE_LEDS,                // led driver initialized, persisted light state about to be posted
+    BOOT_PHASE_FIRST_LIGHT,         // first frame transmitted after BOOT_PHASE_LEDS
+    BOOT_PHASE_NETIF,               // tcp/ip stack and event loop
+    BOOT_PHASE_WIFI,                // soft-ap started
+    BOOT_PHASE_HTTP,                // http server listening
+    BOOT_PHASE_HTTP_RESPONSE,       // first page, state or boot timeline request answered
+    BOOT_PHASE_COUNT
+} eBootPhase;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief record esp_timer_get_time() for the phase, only the first call counts (any task)
+ */
+void boot_timeline_mark(eBootPhase phase);
+bool boot_timeline_reached(eBootPhase phase);
+int64_t boot_timeline_get(eBootPhase phase);    // us since boot, -1: not reached yet
+const char* boot_phase_name(uint8_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,39 @@
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * fixed size blocks allocated once, shared between tasks (free list is a queue of pointers)
+ */
+class CBufferPool
+{
+public:
+    CBufferPool(size_t block_size, size_t block_cnt);
+    virtual ~CBufferPool();
+
+public:
+    char* acquire(TickType_t wait_ticks = portMAX_DELAY);
+    void release(char *block);
+    size_t get_block_size() const { return m_block_size; }
+    size_t get_available();
+
+private:
+    char *m_memory;
+    size_t m_block_size;
+    size_t m_block_cnt;
+    QueueHandle_t m_queue_free;
+};
+
+#ifdef __cplusplus
+};
+#endif
+#endif
@@ -17,9 +17,65 @@
 #define PIN_WS2812_DATA         18
 
 #define WS2812_PIXEL_COUNT      16
+// default strips driven in parallel: {data pin, pixel count, color order}
+// (runtime geometry is stored in nvs, see /api/v1/ws2812/geometry)
+#define WS2812_STRIP_CONFIG     { {PIN_WS2812_DATA, WS2812_PIXEL_COUNT, WS2812_ORDER_GRB} }
 #define TASK_PRIORITY_WS2812    10
+#define WS2812_QUEUE_LENGTH     10
 #define LED_SET_ALL             -1
-#define WS2812_REFRESH_TIME_MS  100
+#define WS2812_KEEPALIVE_MS     10000   // resend static frame periodically (0: never)
+#define WS2812_FRAME_TIME_MS    20      // timeline tick while a transition is running
+#define WS2812_DITHER_FRAME_TIME_MS 8   // refresh rate while temporal dithering is active (flicker free),
+                                        // longer if one frame of the longest strip takes more
+#define WS2812_DITHER_SETTLE_FRAMES 64  // static frame: dither this many frames, then send it rounded and idle
+#define WS2812_FADE_TIME_MS     300     // default crossfade for brightness/color changes
+#define WS2812_DEMO_PULSE_MS    1000
+#define WS2812_OUTPUT_RMT       0       // rmt items for whole frame (short strips)
+#define WS2812_OUTPUT_SPI       1       // spi dma streaming (long strips, constant memory)
+#define WS2812_OUTPUT_MODE      WS2812_OUTPUT_RMT
+#define WS2812_RMT_CHANNEL      0       // first strip, strip n uses channel + n
+#define WS2812_MAX_STRIPS       8       // one rmt channel per strip, all strips are sent in parallel
+#define WS2812_STRIP_ALL        0xFF
+#define WS2812_MAX_RMT_PIXEL_COUNT 1024  // rmt strips together, rmt items take 96 bytes/pixel
+#define WS2812_MAX_SPI_PIXEL_COUNT 4096  // spi strip, streamed (frame copy 4 bytes/pixel + two chunk buffers)
+#define WS2812_STREAM_LOCK_MS   100     // raw frame writer waits this long for the buffers
+#define WS2812_UPDATE_MAX_RANGES 8      // pixel ranges per batch update
+#define WS2812_RMT_CLK_DIV      2       // 80MHz APB / 2 = 40MHz (25ns resolution)
+#define WS2812_TX_TIMEOUT_MS    100
+#define WS2812_SPI_HOST         VSPI_HOST   // HSPI_HOST is used by DPOT
+#define WS2812_SPI_CHUNK_PIXELS 64          // pixels per dma ping-pong buffer
+#define WS2812_GAMMA_X100_MIN   100         // linear
+#define WS2812_GAMMA_X100_MAX   300
+
+// Logger (asynchronous, per core ring buffers)
+#define TASK_PRIORITY_LOGGER    1       // formatting and uart output in the idle time
+#define LOGGER_MIN_LEVEL        eLogType::Info  // lower levels are compiled out (Debug < Info < Warning < Error)
+#ifndef LOGGER_RING_SIZE
+#define LOGGER_RING_SIZE        16384   // bytes per core, power of two (build flag -DLOGGER_RING_SIZE=... to override)
+#endif
+#define LOGGER_MAX_ARGS         8
+#define LOGGER_MAX_STRING       48      // %s arguments are copied (truncated) into the record
+#define LOGGER_DRAIN_MS         20      // drain task poll interval while the rings are empty (woken earlier when a ring is half full)
+#define LOGGER_FUNCNAME_CACHE   64      // functions whose names are extracted by the drain task (gcc 8)
+
+// Persistence (NVS, write-behind)
+#define TASK_PRIORITY_MEMORY    2       // background, flash writes stall the cache
+#define MEMORY_DEBOUNCE_MS      2000    // commit once no change came in for this long
+#define MEMORY_MAX_DELAY_MS     30000   // commit at the latest this long after the first change
+#define MEMORY_FLUSH_WAIT_MS    1000
+#define MEMORY_STATS_MINUTES    60      // commits per hour window
+#define SCENE_MAX_COUNT         32      // named scenes (own nvs namespace)
+#define SCENE_RESTORE_ON_BOOT   1       // recall the last recalled scene at boot
+
+// Pixel Streaming (UDP)
+#define TASK_PRIORITY_STREAM        9       // below the led task
+#define STREAM_DDP_PORT             4048
+#define STREAM_E131_PORT            5568    // sACN, unicast or multicast 239.255.{universe}
+#define STREAM_ARTNET_PORT          6454
+#define STREAM_E131_FIRST_UNIVERSE  1       // mapped to pixel 0, next universe starts at pixel 170
+#define STREAM_ARTNET_FIRST_UNIVERSE 0
+#define STREAM_MAX_PACKET           1472    // ethernet mtu - ip/udp headers
+#define STREAM_TIMEOUT_MS           2500    // e1.31 data loss timeout, sequence numbers are forgotten
 
 // PWM Parameters
 #define LED_PWM_FREQUENCY       50000
@@ -27,6 +83,19 @@
 
 // Web Server & Network
 #define WEB_SERVER_PORT         80
+#define WEB_SERVER_MAX_URI      24
+#define WEB_SERVER_MAX_SOCKETS  7       // connections (lwip allows 10, httpd keeps 3 for itself)
+#define WEB_SERVER_FILE_SOCKETS 3       // of these: file responses handed over to the workers (not httpd sessions)
+#define WEB_SOCKET_MAX_MSG      32      // control messages are a few bytes
+#define WEB_SERVER_MAX_BODY     1024    // json request body, larger ones are rejected (413)
+#define WEB_SERVER_FILE_WORKERS 2       // tasks sending static files (0: sent in the httpd task)
+#define WEB_SERVER_FILE_QUEUE   4       // file responses waiting for a worker
+#define WEB_SERVER_BUFFER_SIZE  4096    // file buffer per response in flight (pool)
+#define WEB_SERVER_BUFFER_COUNT (WEB_SERVER_FILE_WORKERS + 1)   // workers + httpd task
+#define WEB_SERVER_BUFFER_WAIT_MS 1000
+#define WEB_SERVER_STATE_BUFFER 1024    // serialized state response (GET .../state)
+#define TASK_PRIORITY_BOOT      5       // one-shot tasks bringing up wifi and http in parallel
+#define TASK_PRIORITY_WEB_WORKER 4      // below httpd (5), api calls are answered first
 #define WIFI_SSID               "YOGYUI-ESP32-TEST"
 
 #define PIN_DEFAULT_BTN        0
@@ -20,10 +20,12 @@ public:
     bool set_raw_value(uint8_t value);
     uint8_t get_raw_value() { return m_value; }
     bool set_resistance_wb(float res);
+    uint32_t get_state_version() { return m_state_version; }
 
 private:
     static CDpotCtrl* _instance;
     uint8_t m_value;
+    volatile uint32_t m_state_version;  // increased on every value change
     spi_device_handle_t m_handle;
     spi_transaction_t m_spi_transaction;
 };
@@ -0,0 +1,72 @@
+#ifndef _JSON_READER_H_
+#define _JSON_READER_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * schema driven json reader (hardware independent)
+ * a single pass over the request body writes the known fields straight into a typed struct,
+ * no tree and no heap allocation, unknown keys are skipped
+ */
+#define JSON_READER_MAX_FIELDS  32      // presence mask width
+#define JSON_READER_MAX_DEPTH   8       // nesting of skipped values
+
+typedef enum
+{
+    JSON_UINT8 = 0,
+    JSON_UINT16,
+    JSON_UINT32,
+    JSON_BOOL,          // true / false or number (non zero)
+    JSON_FIXED100,      // uint16_t, decimal value x 100 (rounded)
+    JSON_UINT8_ARRAY,   // up to capacity elements, missing ones are left untouched
+    JSON_ENUM,          // uint8_t, number or name (from_name lookup)
+    JSON_OBJECT_ARRAY,  // array of objects described by a nested schema
+    JSON_STRING,        // char array of capacity bytes (nul terminated), longer strings are rejected
+} eJsonFieldType;
+
+struct st_json_schema;
+
+typedef struct st_json_field
+{
+    const char *name;
+    uint8_t type;                           // eJsonFieldType
+    uint16_t offset;                        // member offset in the target struct
+    uint16_t capacity;                      // array elements
+    uint16_t stride;                        // object array element size
+    uint16_t count_offset;                  // object array, uint8_t element count member
+    const struct st_json_schema *schema;    // object array element schema
+    int (*from_name)(const char *name);     // enum name lookup (-1: unknown)
+} JsonField;
+
+typedef struct st_json_schema
+{
+    const JsonField *fields;
+    uint8_t field_cnt;
+    uint32_t required;      // bit n: fields[n] must be present
+} JsonSchema;
+
+#define JSON_FIELD(key, type, s, m)                     { key, type, (uint16_t)offsetof(s, m), 1, 0, 0, nullptr, nullptr }
+#define JSON_FIELD_ARRAY(key, s, m, n)                  { key, JSON_UINT8_ARRAY, (uint16_t)offsetof(s, m), n, 0, 0, nullptr, nullptr }
+#define JSON_FIELD_ENUM(key, s, m, lookup)              { key, JSON_ENUM, (uint16_t)offsetof(s, m), 1, 0, 0, nullptr, lookup }
+#define JSON_FIELD_STRING(key, s, m)                    { key, JSON_STRING, (uint16_t)offsetof(s, m), (uint16_t)sizeof(((s *)0)->m), 0, 0, nullptr, nullptr }
+#define JSON_FIELD_OBJECTS(key, s, m, n, cnt, schema)   { key, JSON_OBJECT_ARRAY, (uint16_t)offsetof(s, m), n, (uint16_t)sizeof(((s *)0)->m[0]), (uint16_t)offsetof(s, cnt), &(schema), nullptr }
+#define JSON_SCHEMA(fields, required)                   { fields, (uint8_t)(sizeof(fields) / sizeof(fields[0])), required }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief parse a json object into target
+ * @param present bit n is set if schema->fields[n] was found (optional)
+ * @return false on syntax error, type/range mismatch, missing required field or trailing garbage
+ *         (target may be partially written)
+ */
+bool json_read_object(const char *json, size_t len, const JsonSchema *schema, void *target, uint32_t *present);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -2,16 +2,16 @@
 #ifndef _LOGGER_H_
 #define _LOGGER_H_
 
-#include <stdio.h>
-#include <stdarg.h>
-#include <string>
-#include <cstring>
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include "definition.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define MAXLEN_LOG_MSG  1024
+#define MAXLEN_LOG_MSG  256
 
 typedef enum
 {
@@ -22,40 +22,195 @@ typedef enum
 	Exception
 } eLogType;
 
-class CLogger
+typedef enum
 {
-public:
-    CLogger();
-    virtual ~CLogger();
+    LOG_ARG_INT = 0,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,         // copied into the record (LOGGER_MAX_STRING)
+    LOG_ARG_POINTER,
+} eLogArgType;
+
+typedef struct st_log_arg
+{
+    uint8_t type;           // eLogArgType
+    uint8_t size;           // integer width (bytes), string length in the record
+    uint16_t offset;        // string offset in the record
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+    } value;
+} LogArg;
+
+#ifdef __cplusplus
+};
+#endif
+
+// templates below can not have c linkage
 
+/**
+ * asynchronous logger
+ * a log call only stores a binary record (timestamp, level, format/function/file pointers and
+ * the typed arguments) into the ring buffer of the calling core, reserved with a compare-and-swap
+ * (lock-free, tasks and isrs of the same core may log concurrently). the drain task formats the
+ * records in timestamp order and writes them with esp_log_write.
+ * when the ring is full, Info/Debug records are dropped (GetDropped) and Warning/Error records are
+ * formatted and written by the caller instead (not from isrs, these are dropped as well).
+ * formats must be string literals, only the pointer is kept.
+ */
+class CLogger
+{
 public:
-    static CLogger* Instance(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline);
-    static void Release();
-    void Log(const char* msg, ...);
+    static bool Start();
+    static void Write(eLogType logtype, const char* funcname, uint8_t funcname_len, const char* filename, 
+                      unsigned long fileline, const char* format, const LogArg* args, uint8_t arg_cnt);
+    static uint32_t GetDropped();
 
 private:
-    static CLogger* _instance;
-    eLogType        m_eLogType;
-    std::string     m_funcname;
-    std::string     m_filename;
-    unsigned long   m_fileline;
-
-    void Process(std::string msg);
+    static void func_drain(void *param);
 };
 
-inline CLogger* _GetLogger(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline) {
-    return CLogger::Instance(logtype, funcname, filename, fileline);
+template<typename T>
+inline LogArg make_log_arg(T value)
+{
+    LogArg arg{};
+    if constexpr (std::is_enum_v<T>) {
+        return make_log_arg(static_cast<std::underlying_type_t<T>>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        arg.type = std::is_signed_v<T> ? LOG_ARG_INT : LOG_ARG_UINT;
+        arg.size = sizeof(T);
+        if constexpr (std::is_signed_v<T>) {
+            arg.value.i = value;
+        } else {
+            arg.value.u = value;
+        }
+    } else if constexpr (std::is_floating_point_v<T>) {
+        arg.type = LOG_ARG_DOUBLE;
+        arg.value.d = value;
+    } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+        arg.type = LOG_ARG_STRING;
+        arg.value.p = value;
+    } else {
+        static_assert(std::is_pointer_v<T>, "unsupported log argument type");
+        arg.type = LOG_ARG_POINTER;
+        arg.value.p = value;
+    }
+    return arg;
 }
 
-inline void ReleaseLogger() {
-    CLogger::Release();
+/**
+ * compile-time level filter (LOGGER_MIN_LEVEL), disabled log sites produce no code (optimized builds)
+ * and their arguments are not evaluated
+ */
+constexpr int log_severity(eLogType logtype)
+{
+    return logtype == eLogType::Debug ? 0 : logtype == eLogType::Info ? 1 : logtype == eLogType::Warning ? 2 : 3;
 }
 
-#define GetLoggerBase() _GetLogger(eLogType::Info, __PRETTY_FUNCTION__, __FILE__, __LINE__)
-#define GetLogger(n)    _GetLogger(n, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+constexpr bool log_level_enabled(eLogType logtype)
+{
+    return log_severity(logtype) >= log_severity(LOGGER_MIN_LEVEL);
+}
 
-#ifdef __cplusplus
+/**
+ * source location parts, evaluated at compile time (LOG_CONSTANT)
+ * "/path/main/src/ws2812.cpp" -> "ws2812.cpp"
+ * "bool CWS2812Ctrl::set_pwm_duty(uint32_t, bool)" -> "CWS2812Ctrl::set_pwm_duty"
+ */
+constexpr size_t log_basename_offset(const char* path)
+{
+    size_t offset = 0;
+    for (size_t i = 0; path[i]; i++) {
+        if (path[i] == '/' || path[i] == '\\') {
+            offset = i + 1;
+        }
+    }
+    return offset;
+}
+
+constexpr size_t log_funcname_end(const char* pretty)
+{
+    size_t i = 0;
+    while (pretty[i] && pretty[i] != '(') {
+        i++;
+    }
+    return i;
+}
+
+constexpr size_t log_funcname_begin(const char* pretty)
+{
+    // last space before the first scope (class) or the parameter list
+    size_t end = log_funcname_end(pretty);
+    size_t limit = end;
+    for (size_t i = 0; i + 1 < end; i++) {
+        if (pretty[i] == ':' && pretty[i + 1] == ':') {
+            limit = i;
+            break;
+        }
+    }
+    size_t begin = 0;
+    for (size_t i = 0; i < limit; i++) {
+        if (pretty[i] == ' ') {
+            begin = i + 1;
+        }
+    }
+    return begin;
+}
+
+/**
+ * call site, GetLogger(type)->Log(format, ...) builds it on the stack (no shared state)
+ */
+template<eLogType L>
+class CLogSite
+{
+public:
+    constexpr CLogSite(const char* funcname, size_t funcname_len, const char* filename, unsigned long fileline)
+        : m_funcname(funcname), m_funcname_len(funcname_len <= UINT8_MAX ? (uint8_t)funcname_len : 0), 
+          m_filename(filename), m_fileline(fileline) {}
+
+    const CLogSite* operator->() const { return this; }
+
+    template<typename... Args>
+    void Log(const char* format, Args... args) const {
+        static_assert(sizeof...(Args) <= LOGGER_MAX_ARGS, "too many log arguments (LOGGER_MAX_ARGS)");
+        if constexpr (sizeof...(Args) == 0) {
+            CLogger::Write(L, m_funcname, m_funcname_len, m_filename, m_fileline, format, nullptr, 0);
+        } else {
+            const LogArg argv[] = { make_log_arg(args)... };
+            CLogger::Write(L, m_funcname, m_funcname_len, m_filename, m_fileline, format, argv, sizeof...(Args));
+        }
+    }
+
+private:
+    const char*     m_funcname;
+    uint8_t         m_funcname_len;     // 0: not resolved, extracted from __PRETTY_FUNCTION__ by the drain task
+    const char*     m_filename;
+    unsigned long   m_fileline;
 };
+
+inline bool StartLogger() {
+    return CLogger::Start();
+}
+
+#define LOG_CONSTANT(x)     std::integral_constant<size_t, (x)>::value
+#define LOG_FILENAME()      (__FILE__ + LOG_CONSTANT(log_basename_offset(__FILE__)))
+#if defined(__clang__) || __GNUC__ >= 9
+#define LOG_FUNCNAME()      (__PRETTY_FUNCTION__ + LOG_CONSTANT(log_funcname_begin(__PRETTY_FUNCTION__)))
+#define LOG_FUNCNAME_LEN()  LOG_CONSTANT(log_funcname_end(__PRETTY_FUNCTION__) - log_funcname_begin(__PRETTY_FUNCTION__))
+#else
+// gcc 8 (esp-idf v4.4) can not use __PRETTY_FUNCTION__ or __func__ in constant expressions (fixed in gcc 9),
+// the drain task extracts the name once per function with the same helpers (LOGGER_FUNCNAME_CACHE)
+#define LOG_FUNCNAME()      __PRETTY_FUNCTION__
+#define LOG_FUNCNAME_LEN()  0
 #endif
 
-#endif
\ No newline at end of file
+// a for statement leaves no open if behind (an outer if/else keeps its else, no dangling else warning),
+// disabled levels loop zero times: the constant condition drops the site when optimizing (-Og and up)
+// and the arguments are never evaluated
+#define GetLogger(n)    for (bool log_site_once = log_level_enabled(n); log_site_once; log_site_once = false) \
+                            CLogSite<n>(LOG_FUNCNAME(), LOG_FUNCNAME_LEN(), LOG_FILENAME(), __LINE__)
+#define GetLoggerBase() GetLogger(eLogType::Info)
+
+#endif
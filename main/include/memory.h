@@ -3,12 +3,48 @@
 #pragma once
 #include <stdint.h>
 #include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
 #include "definition.h"
+#include "ws2812.h"
+
+typedef struct st_memory_stats
+{
+    uint32_t writes_requested;      // save_* calls that changed a value
+    uint32_t writes_coalesced;      // saves replaced by a newer one before they reached flash
+    uint32_t writes_skipped;        // saves of the value already stored
+    uint32_t commits;               // nvs commits since boot
+    uint32_t commits_last_hour;
+    uint32_t pending;               // dirty items waiting for the debounce window
+} MemoryStats;
+
+/**
+ * persisted settings, stored as one versioned blob (memory_blob.h)
+ * append only: new fields go to the end and MEMORY_STATE_VERSION is incremented
+ */
+typedef struct st_memory_state
+{
+    uint8_t valid;                  // bit n: item n was saved, otherwise load_* fails (caller default)
+    uint8_t brightness;
+    RGB rgb;
+    WS2812Calibration calibration;
+    WS2812Geometry geometry;
+} MemoryState;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * nvs memory manager, write-behind
+ * save_* only update a cached copy and mark it dirty, a background task commits all dirty
+ * items together once no change came in for MEMORY_DEBOUNCE_MS (at the latest MEMORY_MAX_DELAY_MS
+ * after the first one) and before restart. the nvs handle stays open.
+ * all items live in a single crc protected blob that is read once (start), settings stored
+ * under the legacy per item keys are migrated into it and erased on the first flush.
+ */
 class CMemory
 {
 public:
@@ -18,16 +54,64 @@ public:
 public:
     static CMemory* Instance();
     static void Release();
+    bool start();   // initializes nvs flash, starts the persist task
+    bool flush();
+    void get_stats(MemoryStats *stats);
+
     bool load_ws2812_brightness(uint8_t *brightness);
     bool save_ws2812_brightness(const uint8_t brightness);
     bool load_ws2812_color(uint8_t *red, uint8_t *green, uint8_t *blue);
     bool save_ws2812_color(const uint8_t red, uint8_t green, uint8_t blue);
+    bool save_ws2812_light(const uint8_t *brightness, const RGB *rgb);    // nullptr: not changed
+    bool load_ws2812_calibration(WS2812Calibration *cal);
+    bool save_ws2812_calibration(const WS2812Calibration *cal);
+    bool load_ws2812_geometry(WS2812Geometry *geometry);
+    bool save_ws2812_geometry(const WS2812Geometry *geometry);
 
 private:
+    enum ITEM {
+        BRIGHTNESS = 0,
+        COLOR = 1,
+        CALIBRATION = 2,
+        GEOMETRY = 3,
+        ITEM_COUNT
+    };
+
     static CMemory* _instance;
 
-    bool read_nvs(const char *key, void *out, size_t data_size);
-    bool write_nvs(const char *key, const void *data, const size_t data_size);
+    nvs_handle m_handle;
+    bool m_handle_opened;
+    portMUX_TYPE m_lock;                // cache, dirty mask
+    SemaphoreHandle_t m_flush_mutex;    // nvs handle, one flush at a time
+    TaskHandle_t m_task_handle;
+
+    // cached item values (latest requested or loaded)
+    MemoryState m_state;
+    bool m_loaded;
+    uint8_t m_dirty;                    // bit n: item n differs from flash
+    uint8_t m_stored;                   // bit n: cached item n equals flash (loaded or flushed)
+    uint8_t m_legacy;                   // bit n: legacy key of item n still to be erased
+    TickType_t m_first_dirty_tick;
+    TickType_t m_last_dirty_tick;
+
+    volatile uint32_t m_writes_requested;
+    volatile uint32_t m_writes_coalesced;
+    volatile uint32_t m_writes_skipped;
+    volatile uint32_t m_commits;
+    uint16_t m_commit_minutes[MEMORY_STATS_MINUTES];    // commits per minute (ring)
+    uint32_t m_commit_minute_stamp[MEMORY_STATS_MINUTES];
+
+    bool open_handle();
+    void load_state();
+    void load_legacy_items();
+    void *item_cache(ITEM item, size_t *data_size);
+    static const char *item_key(ITEM item);
+    bool load_item(ITEM item, void *out);
+    void save_items(const ITEM *items, const void * const *data, uint8_t count);
+    void count_commit();
+
+    static void func_persist(void *param);
+    static void on_shutdown();
 };
 
 inline CMemory* GetMemory() {
@@ -0,0 +1,64 @@
+#ifndef _MEMORY_BLOB_H_
+#define _MEMORY_BLOB_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * versioned, crc protected settings blob (hardware independent), little endian
+ *   MemoryBlobHeader
+ *   payload            state struct of the given version
+ * crc32 (ieee) covers the header (crc field zero) and the payload.
+ * state structs are append only: a payload of an older version is the prefix of the current
+ * struct, the fields it does not have keep their defaults and the migration hook fixes up
+ * anything that changed meaning between two versions.
+ */
+#define MEMORY_BLOB_MAGIC       0x4D454D59  // "YMEM"
+
+typedef struct st_memory_blob_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;            // payload bytes
+    uint32_t crc;
+} MemoryBlobHeader;
+
+static_assert(sizeof(MemoryBlobHeader) == 12, "blob header layout");
+
+typedef enum
+{
+    MEMORY_BLOB_OK = 0,
+    MEMORY_BLOB_MIGRATED,       // older version, state was migrated (should be written back)
+    MEMORY_BLOB_CORRUPT,        // bad magic, length or crc
+    MEMORY_BLOB_TOO_NEW,        // written by a newer firmware
+} eMemoryBlobResult;
+
+/**
+ * @brief migrate state from version (from) to (from + 1), called once per step
+ */
+typedef void (*MemoryBlobMigration)(uint16_t from, void *state);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t memory_blob_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @return blob bytes (header + payload), 0 if out_size is too small
+ */
+size_t memory_blob_encode(uint16_t version, const void *state, size_t state_size, uint8_t *out, size_t out_size);
+
+/**
+ * @brief validate and decode a blob into state, which holds the defaults on entry
+ *        state is only written on MEMORY_BLOB_OK / MEMORY_BLOB_MIGRATED
+ */
+eMemoryBlobResult memory_blob_decode(const uint8_t *data, size_t len, uint16_t version, void *state, size_t state_size, 
+                                     MemoryBlobMigration migrate);
+const char* memory_blob_result_name(eMemoryBlobResult result);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
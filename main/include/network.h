@@ -6,7 +6,7 @@
 extern "C" {
 #endif
 
-bool activate_wifi_softap();
+bool activate_wifi_softap();   // nvs flash must be initialized (CMemory::start)
 
 #ifdef __cplusplus
 }
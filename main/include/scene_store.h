@@ -0,0 +1,77 @@
+#ifndef _SCENE_STORE_H_
+#define _SCENE_STORE_H_
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "ws2812_scene.h"
+#include "definition.h"
+#include <stdint.h>
+#include <vector>
+
+typedef struct st_scene_info
+{
+    uint8_t id;
+    uint8_t flags;              // WS2812_SCENE_FLAG_*
+    uint8_t effect_id;
+    uint8_t reserved;
+    uint16_t pixel_cnt;
+    uint16_t size;              // encoded bytes in nvs
+    char name[WS2812_SCENE_NAME_LEN];
+    uint32_t load_us;           // last recall (nvs read + decode + apply), not persisted
+} SceneInfo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * named scenes (brightness, color, effect or full frame) in their own nvs namespace
+ * one blob per scene (ws2812_scene.h encoding) + an index blob kept in ram,
+ * so listing never touches flash and recall is a single blob read
+ */
+class CSceneStore
+{
+public:
+    CSceneStore();
+    virtual ~CSceneStore();
+    static CSceneStore* Instance();
+
+public:
+    bool initialize();
+    bool save(uint8_t id, const char *name);    // current state
+    bool recall(uint8_t id, uint32_t fade_ms = 0);
+    bool remove(uint8_t id);
+    bool restore_last();
+
+    uint8_t get_scene_count();
+    bool get_info(uint8_t index, SceneInfo *info);
+    int get_last_scene() { return m_last; }
+
+private:
+    static CSceneStore* _instance;
+
+    nvs_handle m_handle;
+    bool m_initialized;
+    SemaphoreHandle_t m_mutex;          // index, buffers, nvs handle
+    SceneInfo m_index[SCENE_MAX_COUNT];
+    uint8_t m_count;
+    int m_last;                         // last recalled scene id (-1: none)
+    std::vector<uint8_t> m_blob;        // encoded scene, WS2812_SCENE_MAX_SIZE(frame pixels)
+    std::vector<RGB> m_frame;           // decoded frame, pixels of the longest geometry so far
+
+    int find(uint8_t id);
+    void reserve(size_t pixel_cnt);
+    bool write_index();
+    static void make_key(uint8_t id, char *key, size_t key_size);
+};
+
+inline CSceneStore* GetSceneStore() {
+    return CSceneStore::Instance();
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,59 @@
+#ifndef _STREAM_RECEIVER_H_
+#define _STREAM_RECEIVER_H_
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ws2812_stream.h"
+#include "definition.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * UDP pixel stream receiver (DDP, E1.31, Art-Net)
+ * completed frames are pushed to the led controller with begin/end_frame_write
+ */
+class CStreamReceiver
+{
+public:
+    CStreamReceiver();
+    virtual ~CStreamReceiver();
+    static CStreamReceiver* Instance();
+
+public:
+    bool start();
+    void get_stats(WS2812StreamStats *stats);
+    bool is_streaming();
+
+private:
+    static CStreamReceiver* _instance;
+    CWS2812StreamDecoder m_decoder;     // receiver task only
+    int m_sockets[WS2812_STREAM_PROTOCOL_COUNT];
+    uint8_t m_joined_universes;         // e1.31 multicast groups joined
+    uint8_t m_packet[STREAM_MAX_PACKET];
+    uint32_t m_last_packet_ms;
+    volatile bool m_streaming;
+    volatile uint32_t m_frames_rejected;
+    TaskHandle_t m_task_handle;
+    bool m_task_keepalive;
+
+    int open_socket(uint16_t port);
+    void close_sockets();
+    bool sync_geometry();
+    void join_universes(uint8_t universe_cnt);
+    void present_frame();
+
+    static void func_receive(void *param);
+};
+
+inline CStreamReceiver* GetStreamReceiver() {
+    return CStreamReceiver::Instance();
+}
+
+#ifdef __cplusplus
+};
+#endif
+#endif
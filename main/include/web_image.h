@@ -0,0 +1,84 @@
+#ifndef _WEB_IMAGE_H_
+#define _WEB_IMAGE_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * packed read-only web asset image (script/build_web_image.py), little endian
+ *   WebImageHeader
+ *   WebImageEntry[entry_cnt]   sorted by path (strcmp order)
+ *   string table               nul terminated paths and mime types
+ *   file blobs                 4 byte aligned, identity and gzip variants
+ * all offsets are relative to the start of the image
+ */
+#define WEB_IMAGE_MAGIC         0x49424557  // "WEBI"
+#define WEB_IMAGE_VERSION       1
+#define WEB_IMAGE_ETAG_LEN      8           // first 8 bytes of the sha256 of the identity content
+#define WEB_IMAGE_FLAG_IMMUTABLE 0x01       // content hash in file name, cached forever
+
+typedef struct st_web_image_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_cnt;
+    uint32_t image_size;
+    uint32_t reserved;
+} WebImageHeader;
+
+typedef struct st_web_image_entry
+{
+    uint32_t path_offset;
+    uint32_t mime_offset;
+    uint32_t data_offset;
+    uint32_t data_length;
+    uint32_t gzip_offset;
+    uint32_t gzip_length;       // 0: no gzip variant
+    uint8_t etag[WEB_IMAGE_ETAG_LEN];
+    uint8_t flags;
+    uint8_t reserved[3];
+} WebImageEntry;
+
+static_assert(sizeof(WebImageHeader) == 16, "image layout");
+static_assert(sizeof(WebImageEntry) == 36, "image layout");
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * read-only view of an image in memory (mapped flash), no copy is made
+ */
+class CWebImage
+{
+public:
+    CWebImage();
+
+public:
+    bool attach(const void *base, size_t size);
+    bool is_attached() const { return m_base != nullptr; }
+    uint16_t get_entry_count() const { return m_entry_cnt; }
+
+    const WebImageEntry* find(const char *path, size_t path_len) const;
+    const char* get_string(uint32_t offset) const { return reinterpret_cast<const char *>(m_base + offset); }
+    const uint8_t* get_data(uint32_t offset) const { return m_base + offset; }
+
+private:
+    const uint8_t *m_base;
+    size_t m_size;
+    const WebImageEntry *m_entries;
+    uint16_t m_entry_cnt;
+
+    bool validate_entry(const WebImageEntry *entry) const;
+};
+
+/**
+ * format quoted etag ("<16 hex digits>" or "<16 hex digits>-gz"), buffer needs 22 bytes
+ */
+void web_image_format_etag(const WebImageEntry *entry, bool gzip, char *buffer, size_t buffer_len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -3,6 +3,100 @@
 #pragma once
 
 #include "esp_http_server.h"
+#include "esp_partition.h"
+#include "esp_vfs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "web_image.h"
+#include "buffer_pool.h"
+#include "json_reader.h"
+#include "definition.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * websocket messages (binary, little endian)
+ * client -> server
+ *   STATE      [op]                                    request state push
+ *   BRIGHTNESS [op, value, fade_ms(2), flags]
+ *   COLOR      [op, strip, r, g, b, fade_ms(2), flags] strip 0xFF: all
+ *              flags bit 0: save to memory (default 1 if omitted, 0 for previews while dragging)
+ *   EFFECT     [op, strip, effect, speed, size, r, g, b]
+ *   BLINK      [op, count, duration_ms(2)]
+ * server -> client
+ *   STATE      [op | 0x80, brightness, r, g, b, effect, strip_cnt]   (strip 0)
+ */
+typedef enum {
+    WS_OP_STATE = 0x00,
+    WS_OP_BRIGHTNESS = 0x01,
+    WS_OP_COLOR = 0x02,
+    WS_OP_EFFECT = 0x03,
+    WS_OP_BLINK = 0x04,
+    WS_OP_REPLY = 0x80
+} eWebSocketOp;
+
+#define WS_FLAG_SAVE    0x01
+
+typedef struct st_websocket_stats
+{
+    uint32_t messages;          // control messages handled
+    uint32_t rejected;          // malformed or unknown messages
+    uint32_t latency_avg_us;    // per message handling time (receive ~ command posted), moving average
+    uint32_t latency_max_us;
+    uint32_t pushes;            // state frames sent to clients
+} WebSocketStats;
+
+/**
+ * static asset entry from asset-manifest.txt (script/build_web_resource.sh)
+ */
+typedef struct st_web_asset
+{
+    std::string path;       // uri path, sorted
+    std::string etag;       // quoted content hash (identity)
+    std::string etag_gzip;  // quoted content hash (gzip variant)
+    bool gzip;              // <path>.gz exists
+    bool immutable;         // content hash in file name, cached forever
+} WebAsset;
+
+#define FILE_PATH_MAX   ESP_VFS_PATH_MAX + 128
+
+/**
+ * static file response, written to the socket by a worker task (or inline if all are busy)
+ * a worker owns the socket: httpd has dropped the session, the worker closes it after the body
+ */
+typedef struct st_web_file_job
+{
+    int sockfd;
+    const char *content_type;
+    const char *cache_control;
+    char etag[24];              // empty: no caching headers (file not in manifest)
+    bool gzip;                  // Content-Encoding: gzip
+    bool vary;                  // Vary: Accept-Encoding
+    const uint8_t *data;        // mapped web image, nullptr: read file_path
+    size_t length;
+    bool close;                 // Connection: close (handed over to a worker)
+    char file_path[FILE_PATH_MAX];
+} WebFileJob;
+
+typedef struct st_web_file_socket
+{
+    int sockfd;                 // -1: free
+    bool close_pending;         // httpd has dropped the session, closed when the response is done
+} WebFileSocket;
+
+/**
+ * serialized state response, regenerated only when the source state version changes
+ */
+typedef struct st_web_state_cache
+{
+    uint32_t version;           // source state version of body (0: empty)
+    size_t length;
+    char etag[24];              // quoted "<boot id>-<version>"
+    char body[WEB_SERVER_STATE_BUFFER];
+} WebStateCache;
+
+typedef size_t (*WebStateFormatter)(char *buffer, size_t buffer_size);
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,12 +112,29 @@ public:
 public:
     bool start();
     bool stop();
+    void get_ws_stats(WebSocketStats *stats);
 
 private:
     static CWebServer* _instance;
     httpd_handle_t m_handle;
+    volatile bool m_ws_push_queued;
+    WebSocketStats m_ws_stats;
+    std::vector<WebAsset> m_assets;
+    CWebImage m_image;                          // packed asset image (mapped flash), spiffs if not present
+    spi_flash_mmap_handle_t m_image_handle;
+    CBufferPool *m_buffer_pool;                 // per response file buffers
+    QueueHandle_t m_queue_file_jobs;
+    portMUX_TYPE m_file_lock;
+    WebFileSocket m_file_sockets[WEB_SERVER_FILE_SOCKETS];
+    char m_request_body[WEB_SERVER_MAX_BODY];   // json request body (httpd task)
+    uint32_t m_boot_id;                         // etag prefix, versions restart on reboot
+    WebStateCache m_dpot_state;                 // GET state responses (httpd task)
+    WebStateCache m_ws2812_state;
 
+    bool map_web_image();
     void init_spiffs();
+    void load_asset_manifest();
+    const WebAsset* find_asset(const std::string &path);
 
     bool register_uri_handler_get_common();
     static esp_err_t uri_handler_get_common(httpd_req_t *req);
@@ -33,10 +144,54 @@ private:
     static esp_err_t uri_handler_post_dpot_config(httpd_req_t *req);
     bool register_uri_handler_get_ws2812_state();
     static esp_err_t uri_handler_get_ws2812_state(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_stats();
+    static esp_err_t uri_handler_get_ws2812_stats(httpd_req_t *req);
     bool register_uri_handler_post_ws2812_config();
     static esp_err_t uri_handler_post_ws2812_config(httpd_req_t *req);
     bool register_uri_handler_post_ws2812_blink();
     static esp_err_t uri_handler_post_ws2812_blink(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_effect();
+    static esp_err_t uri_handler_get_ws2812_effect(httpd_req_t *req);
+    bool register_uri_handler_post_ws2812_effect();
+    static esp_err_t uri_handler_post_ws2812_effect(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_calibration();
+    static esp_err_t uri_handler_get_ws2812_calibration(httpd_req_t *req);
+    bool register_uri_handler_post_ws2812_calibration();
+    static esp_err_t uri_handler_post_ws2812_calibration(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_geometry();
+    static esp_err_t uri_handler_get_ws2812_geometry(httpd_req_t *req);
+    bool register_uri_handler_post_ws2812_geometry();
+    static esp_err_t uri_handler_post_ws2812_geometry(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_frame();
+    static esp_err_t uri_handler_get_ws2812_frame(httpd_req_t *req);
+    bool register_uri_handler_post_ws2812_frame();
+    static esp_err_t uri_handler_post_ws2812_frame(httpd_req_t *req);
+    bool register_uri_handler_get_ws2812_scenes();
+    static esp_err_t uri_handler_get_ws2812_scenes(httpd_req_t *req);
+    bool register_uri_handler_post_ws2812_scene();
+    static esp_err_t uri_handler_post_ws2812_scene(httpd_req_t *req);
+    bool register_uri_handler_get_system_boot();
+    static esp_err_t uri_handler_get_system_boot(httpd_req_t *req);
+    bool register_uri_handler_ws2812_ws();
+    static esp_err_t uri_handler_ws2812_ws(httpd_req_t *req);
+
+    esp_err_t send_state(httpd_req_t *req, WebStateCache *cache, uint32_t version, WebStateFormatter formatter);
+    static size_t format_dpot_state(char *buffer, size_t buffer_size);
+    static size_t format_ws2812_state(char *buffer, size_t buffer_size);
+    bool recv_json_body(httpd_req_t *req, const JsonSchema *schema, void *target, uint32_t *present, esp_err_t *result);
+    void start_file_workers();
+    static void prepare_image_job(const CWebImage *image, const WebImageEntry *entry, bool accept_gzip, WebFileJob *job);
+    static bool prepare_spiffs_job(const WebAsset *asset, bool accept_gzip, WebFileJob *job);
+    static bool send_file_job(const WebFileJob &job, char *buffer, size_t buffer_size);
+    bool post_file_job(const WebFileJob &job);
+    void release_file_socket(int sockfd);
+    static void on_session_close(httpd_handle_t hd, int sockfd);
+    static void func_file_worker(void *param);
+
+    bool handle_ws_message(const uint8_t *msg, size_t len);
+    void request_ws_push();
+    static void on_ws2812_state_changed(void *ctx);
+    static void work_ws_push_state(void *arg);
 };
 
 inline CWebServer* GetWebServer() {
@@ -5,18 +5,116 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "ws2812_color.h"
+#include "ws2812_effect.h"
+#include "ws2812_geometry.h"
+#include "ws2812_output.h"
+#include "ws2812_timeline.h"
+#include "definition.h"
 #include <stdint.h>
 #include <vector>
 
-typedef struct st_rgb
+typedef struct st_ws2812_stats
 {
-    uint8_t r, g, b;
-    st_rgb(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0) {
-        r = red;
-        g = green;
-        b = blue;
-    }
-} RGB;
+    uint32_t frames_sent;       // frames clocked out to the strip
+    uint32_t frames_skipped;    // task wake-ups without frame change (no transmit)
+    uint32_t frames_dithered;   // frames resent only to spread fractional output bits
+    uint32_t frames_streamed;   // raw frames pushed through begin/end_frame_write
+    uint32_t frame_generation;
+    uint32_t queue_depth;         // commands waiting in the queue
+    uint32_t commands_posted;
+    uint32_t commands_coalesced;  // idempotent commands replaced by a newer one before execution
+    uint32_t commands_dropped;    // commands rejected because the queue was full
+} WS2812Stats;
+
+/**
+ * one physical strip, pixels are a [offset, offset + pixel_cnt) slice of the controller frame
+ */
+typedef struct st_ws2812_strip
+{
+    WS2812StripConfig config;
+    uint16_t offset;
+    CWS2812Output *output;
+    RGB common_color;                   // last requested color
+    uint8_t effect_id;                  // last requested effect
+    WS2812EffectParam effect_param;
+    CWS2812Track track_color;           // task side
+    CWS2812Effect *effect;              // task side, allocated on first use (kept while stopped)
+    uint8_t effect_type;                // type of the allocated effect instance
+    bool effect_running;                // task side, effect is rendered every frame
+} WS2812Strip;
+
+#define WS2812_UPDATE_BRIGHTNESS    0x01
+#define WS2812_UPDATE_COLOR         0x02
+#define WS2812_UPDATE_EFFECT        0x04
+#define WS2812_UPDATE_PIXELS        0x08
+
+typedef struct st_ws2812_pixel_range
+{
+    uint16_t offset;        // first pixel (all strips back to back)
+    uint16_t length;
+    uint8_t rgb[3];
+} WS2812PixelRange;
+
+/**
+ * batch update, applied as one transaction: one task wake-up, one rendered frame, one nvs commit
+ * pixel ranges are painted on top of the color (without fade) and stop running effects,
+ * so they cannot be combined with an effect or with enqueue
+ */
+typedef struct st_ws2812_update
+{
+    uint8_t fields;                 // WS2812_UPDATE_*
+    uint8_t strip;                  // color / effect target, WS2812_STRIP_ALL: all strips
+    uint8_t brightness;
+    RGB color;
+    uint8_t effect;
+    WS2812EffectParam effect_param;
+    uint8_t range_cnt;
+    WS2812PixelRange ranges[WS2812_UPDATE_MAX_RANGES];
+    const RGB *frame;               // WS2812_UPDATE_PIXELS base frame (scene), nullptr: current frame
+    uint16_t frame_pixel_cnt;
+    uint32_t fade_ms;
+    bool enqueue;                   // brightness / color transitions play after the running ones
+    bool save_memory;
+} WS2812Update;
+
+// called in the context of the caller that changed the state (keep it short, no blocking)
+typedef void (*WS2812StateListener)(void *ctx);
+
+typedef struct st_ws2812_command
+{
+    uint8_t type;
+    bool enqueue;   // true: play after running transition, false: preempt it
+    uint8_t strip;  // strip index or WS2812_STRIP_ALL (color, effect)
+    union {
+        struct {
+            uint8_t value;
+            bool verbose;
+            uint32_t fade_ms;
+        } brightness;
+        struct {
+            uint8_t r, g, b;
+            uint32_t fade_ms;
+        } color;
+        struct {
+            uint32_t duration_ms;
+            uint32_t count;
+        } blink;
+        struct {
+            uint8_t id;
+            uint8_t speed, size;
+            uint8_t r, g, b;
+        } effect;
+        WS2812Calibration calibration;
+        struct {
+            uint8_t fields;     // WS2812_UPDATE_BRIGHTNESS, WS2812_UPDATE_COLOR
+            uint8_t brightness;
+            uint8_t r, g, b;
+            uint32_t fade_ms;
+        } update;
+    };
+} WS2812Command;
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,44 +122,134 @@ extern "C" {
 
 class CWS2812Ctrl
 {
+public:
+    // coalesced commands are drained from the mailbox in this order
+    enum CMD_TYPE {
+        RECONFIGURE = 0,
+        BLINK = 2,
+        BLINK_DEMO = 3,
+        BRIGHTNESS = 4,
+        COLOR = 5,
+        EFFECT = 6,
+        CALIBRATION = 7,
+        FRAME = 8,
+        UPDATE = 9,         // enqueued batch update (never coalesced)
+        CMD_TYPE_COUNT
+    };
+
 public:
     CWS2812Ctrl();
     virtual ~CWS2812Ctrl();
     static CWS2812Ctrl* Instance();
 
 public:
-    bool initialize(uint8_t gpio_pin_no, uint16_t pixel_cnt);
-    bool set_pixel_rgb_value(int index, uint8_t red, uint8_t green, uint8_t blue, bool update = true);
-    bool update_color();
-    bool clear_color();
+    bool initialize(const WS2812Geometry &geometry);
+    bool set_geometry(const WS2812Geometry &geometry, bool save_memory = true);
+    WS2812Geometry get_geometry();
+    uint8_t get_strip_count();
+    bool get_strip_config(uint8_t strip, WS2812StripConfig *config);
 
-    bool set_brightness(uint8_t value, bool save_memory = true, bool verbose = true);
+    bool set_brightness(uint8_t value, bool save_memory = true, bool verbose = true, uint32_t fade_ms = WS2812_FADE_TIME_MS, bool enqueue = false);
     uint8_t get_brightness();
     
-    RGB get_common_color();
-    bool set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory = true);
+    RGB get_common_color(uint8_t strip = 0);
+    bool set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory = true, uint32_t fade_ms = WS2812_FADE_TIME_MS, bool enqueue = false, uint8_t strip = WS2812_STRIP_ALL);
+
+    bool blink(uint32_t duration_ms = 1000, uint32_t count = 1, bool enqueue = false);
+    bool blink_demo(bool enqueue = false);
+
+    bool set_effect(uint8_t effect, const WS2812EffectParam &param, uint8_t strip = WS2812_STRIP_ALL);
+    uint8_t get_effect(WS2812EffectParam *param = nullptr, uint8_t strip = 0);
+
+    bool set_calibration(const WS2812Calibration &cal, bool save_memory = true);
+    WS2812Calibration get_calibration();
+
+    bool apply_update(const WS2812Update &update);
 
-    bool blink(uint32_t duration_ms = 1000, uint32_t count = 1);
-    bool blink_demo();
+    /**
+     * raw frame streaming (packed rgb, all strips back to back)
+     * the caller writes into the back buffer, end_frame_write(true) swaps it to the front
+     * and the task shows it (latest wins), no copy is made on the caller side
+     * the stream mutex is held in between: fill from memory only, never from a socket
+     * (write_frame/read_frame copy a caller buffer under the mutex)
+     */
+    size_t get_pixel_count();
+    RGB* begin_frame_write(uint16_t offset, uint16_t pixel_cnt);
+    bool end_frame_write(bool commit);
+    bool write_frame(uint16_t offset, const RGB *pixels, uint16_t pixel_cnt);
+    size_t read_frame(RGB *pixels, size_t max_cnt, size_t offset = 0);     // 0: busy or offset past the frame
+
+    void set_state_listener(WS2812StateListener listener, void *ctx);
+    uint32_t get_state_version();
+
+    void get_stats(WS2812Stats *stats);
 
 private:
     static CWS2812Ctrl *_instance;
 
-    uint8_t m_gpio_pin_no;
     uint8_t m_brightness;
     
-    RGB m_common_color;
-    std::vector<RGB> m_pixel_values;
+    WS2812Geometry m_geometry;                  // last requested geometry (guarded by m_mailbox_lock)
+    uint8_t m_pwm_pin_no;                       // applied by the task
+    WS2812Strip m_strips[WS2812_MAX_STRIPS];
+    uint8_t m_strip_cnt;
+    std::vector<RGB> m_pixel_values;            // all strips back to back
+    std::vector<uint16_t> m_pixel_linear;       // corrected 8.8 fixed point values (r,g,b per pixel)
+    std::vector<uint8_t> m_dither_error;        // temporal dithering accumulators (r,g,b per pixel)
     std::vector<uint32_t> m_pixel_conv_values;
+    std::vector<RGB> m_stream_buffer[2];        // raw frame double buffer (front / back)
+    uint8_t m_stream_front;
+    portMUX_TYPE m_stream_lock;                 // front index, front buffer read by the task
+    SemaphoreHandle_t m_stream_mutex;           // single writer, buffers are not reallocated while held
+    WS2812Calibration m_calibration;    // last requested calibration
+    WS2812Correction m_correction;      // gamma + white balance table used by the task
+    bool m_dither;                      // dithering enabled (task side)
+    bool m_dither_residual;             // last frame had fractional bits, keep refreshing
+    uint16_t m_dither_static;           // dithered frames sent since the frame last changed
+    uint32_t m_dither_frame_ms;         // dither refresh interval, at least one frame of the longest strip
     
-    uint32_t m_blink_duration_ms;
-    uint32_t m_blink_count;
+    CWS2812Track m_track_brightness;
     
     QueueHandle_t m_queue_command;
+    portMUX_TYPE m_mailbox_lock;
+    uint16_t m_mailbox_pending[CMD_TYPE_COUNT];                 // bit 0: all strips, bit n: strip n - 1
+    WS2812Command m_mailbox[CMD_TYPE_COUNT][WS2812_MAX_STRIPS + 1];
+    volatile uint32_t m_commands_posted;
+    volatile uint32_t m_commands_coalesced;
+    volatile uint32_t m_commands_dropped;
     TaskHandle_t m_task_handle;
     bool m_task_keepalive;
+
+    volatile uint32_t m_frame_generation;   // increased whenever m_pixel_conv_values changes
+    uint32_t m_sent_generation;
+    volatile uint32_t m_frames_sent;
+    volatile uint32_t m_frames_skipped;
+    volatile uint32_t m_frames_dithered;
+    volatile uint32_t m_frames_streamed;
+
+    volatile uint32_t m_state_version;          // increased on every brightness/color/effect/config change
+    WS2812StateListener m_state_listener;
+    void *m_state_listener_ctx;
     
     bool set_pwm_duty(uint32_t duty, bool verbose = true);
+    bool apply_brightness(uint8_t value, bool verbose = true);
+    bool refresh_frame();
+    void fill_strip(WS2812Strip *strip, RGB rgb);
+    void set_strip_effect(WS2812Strip *strip, uint8_t effect_id, const WS2812EffectParam &param);
+    void release_strips();
+    bool apply_geometry(const WS2812Geometry &geometry);
+    bool configure_pwm(uint8_t pwm_pin_no);
+    void notify_state_changed();
+    void convert_frame();
+    bool advance_timeline(uint32_t now_ms);
+
+    bool post_command(const WS2812Command &cmd);
+    bool post_coalesced(const WS2812Command &cmd);
+    bool post_batch(const WS2812Command *cmds, uint8_t cmd_cnt);
+    bool validate_update(const WS2812Update &update);
+    bool write_update_frame(const WS2812Update &update);
+    void drain_mailbox();
+    void handle_command(const WS2812Command &cmd);
 
     static void func_command(void *param);
 };
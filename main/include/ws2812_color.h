@@ -0,0 +1,110 @@
+#ifndef _WS2812_COLOR_H_
+#define _WS2812_COLOR_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct st_rgb
+{
+    uint8_t r, g, b;
+    st_rgb(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0) {
+        r = red;
+        g = green;
+        b = blue;
+    }
+} RGB;
+
+#define WS2812_DEFAULT_GAMMA_X100   220     // gamma 2.2
+
+/**
+ * channel order on the wire (first byte sent is the upper byte of the output word)
+ */
+typedef enum {
+    WS2812_ORDER_GRB = 0,   // WS2812(B), SK6812
+    WS2812_ORDER_RGB,       // WS2811 variants
+    WS2812_ORDER_BRG,
+    WS2812_ORDER_RBG,
+    WS2812_ORDER_GBR,
+    WS2812_ORDER_BGR,
+    WS2812_ORDER_COUNT
+} eColorOrder;
+
+typedef struct st_ws2812_calibration
+{
+    uint16_t gamma_x100;        // 100 = linear
+    uint8_t white_balance[3];   // per channel full scale (r, g, b)
+    bool dither;                // temporal dithering of the fractional output bits
+} WS2812Calibration;
+
+/**
+ * combined gamma + white balance table, indexed by [channel(r,g,b)][raw value]
+ * output is 8.8 fixed point (0 ~ 255 * 256), fraction is kept for temporal dithering
+ */
+typedef struct st_ws2812_correction
+{
+    uint16_t lut[3][256];
+} WS2812Correction;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief sine lookup, full period over 0~255, output 1~255 (128 = zero)
+ */
+uint8_t ws2812_sin8(uint8_t theta);
+
+/**
+ * @brief v * scale / 256 (fixed point multiply)
+ */
+inline uint8_t ws2812_scale8(uint8_t v, uint8_t scale) {
+    return (uint8_t)(((uint16_t)v * (uint16_t)(scale + 1)) >> 8);
+}
+
+/**
+ * @brief integer hsv to rgb conversion (hue 0~255 = full circle)
+ */
+RGB ws2812_hsv_to_rgb(uint8_t hue, uint8_t sat, uint8_t val);
+
+/**
+ * @brief calibration/correction table for default gamma and no white balance trim
+ * the table is generated at compile time
+ */
+WS2812Calibration ws2812_default_calibration();
+const WS2812Correction* ws2812_default_correction();
+
+/**
+ * @brief regenerate correction table from calibration (runtime, not for per-pixel path)
+ */
+void ws2812_build_correction(WS2812Correction *corr, const WS2812Calibration *cal);
+
+/**
+ * @brief apply correction table, linear output is 8.8 fixed point (3 values per pixel, r/g/b order)
+ */
+void ws2812_correct_pixels(const RGB *pixels, size_t pixel_cnt, const WS2812Correction *corr, uint16_t *linear);
+
+/**
+ * @brief round 8.8 linear values into output words in wire order (GRB: 0x00GGRRBB)
+ */
+void ws2812_quantize_pixels(const uint16_t *linear, size_t pixel_cnt, uint8_t order, uint32_t *grb);
+
+/**
+ * @brief temporal dithering of 8.8 linear values into output words in wire order (GRB: 0x00GGRRBB)
+ * fractional part is carried to the next frame in per channel error accumulators (3 per pixel)
+ * @return true if any channel has a fractional part (output alternates between frames)
+ */
+bool ws2812_dither_pixels(const uint16_t *linear, size_t pixel_cnt, uint8_t order, uint8_t *error, uint32_t *grb);
+
+/**
+ * @brief initial error accumulators, spread over pixels so that neighbours do not toggle in phase
+ */
+void ws2812_dither_seed(uint8_t *error, size_t pixel_cnt);
+
+const char* ws2812_color_order_name(uint8_t order);
+int ws2812_color_order_from_name(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,92 @@
+#ifndef _WS2812_EFFECT_H_
+#define _WS2812_EFFECT_H_
+#pragma once
+
+#include "ws2812_color.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+typedef enum
+{
+    WS2812_EFFECT_NONE = 0,
+    WS2812_EFFECT_RAINBOW,
+    WS2812_EFFECT_CHASE,
+    WS2812_EFFECT_TWINKLE,
+    WS2812_EFFECT_FIRE,
+    WS2812_EFFECT_COUNT
+} eEffectType;
+
+typedef struct st_ws2812_effect_param
+{
+    uint8_t speed;      // 1(slow) ~ 255(fast)
+    uint8_t size;       // rainbow: hue spread, chase: tail length, twinkle: density, fire: cooling
+    RGB color;          // base color (chase, twinkle)
+} WS2812EffectParam;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Generative effect interface
+ * render() is called by the LED task once per frame tick and must not allocate
+ */
+class CWS2812Effect
+{
+public:
+    CWS2812Effect();
+    virtual ~CWS2812Effect() {}
+
+public:
+    virtual bool resize(size_t pixel_cnt) { return true; }
+    virtual void render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms) = 0;
+    void set_param(const WS2812EffectParam &param) { m_param = param; }
+
+protected:
+    WS2812EffectParam m_param;
+};
+
+class CRainbowEffect : public CWS2812Effect
+{
+public:
+    void render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms) override;
+};
+
+class CChaseEffect : public CWS2812Effect
+{
+public:
+    void render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms) override;
+};
+
+class CTwinkleEffect : public CWS2812Effect
+{
+public:
+    void render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms) override;
+};
+
+class CFireEffect : public CWS2812Effect
+{
+public:
+    CFireEffect();
+
+public:
+    bool resize(size_t pixel_cnt) override;
+    void render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms) override;
+
+private:
+    std::vector<uint8_t> m_heat;
+    uint32_t m_random;
+
+    uint8_t random8();
+};
+
+CWS2812Effect* ws2812_create_effect(uint8_t type);
+const char* ws2812_effect_name(uint8_t type);
+int ws2812_effect_from_name(const char *name);
+WS2812EffectParam ws2812_effect_default_param();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
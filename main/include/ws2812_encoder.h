@@ -0,0 +1,62 @@
+#ifndef _WS2812_ENCODER_H_
+#define _WS2812_ENCODER_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * WS2812 bit timing (datasheet typical values, nanoseconds)
+ */
+#define WS2812_T0H_NS   350
+#define WS2812_T0L_NS   800
+#define WS2812_T1H_NS   700
+#define WS2812_T1L_NS   600
+#define WS2812_BITS_PER_PIXEL   24
+#define WS2812_RESET_US         80      // low time latching the frame (datasheet: above 50us)
+
+/**
+ * SPI streaming: each WS2812 bit is expanded into 3 SPI bits ('0' -> 100, '1' -> 110)
+ * at 2.5MHz, a SPI bit is 400ns (T0H=400ns, T1H=800ns, bit period=1.2us)
+ */
+#define WS2812_SPI_CLOCK_HZ         2500000
+#define WS2812_SPI_BYTES_PER_PIXEL  9
+#define WS2812_SPI_RESET_BYTES      32      // 32 * 8 * 400ns = 102us low (latch)
+
+typedef struct st_ws2812_rmt_timing
+{
+    uint32_t bit0;  // encoded rmt item for '0' bit
+    uint32_t bit1;  // encoded rmt item for '1' bit
+} WS2812RmtTiming;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief build rmt items for '0'/'1' bits from rmt counter clock
+ * item layout is same as rmt_item32_t (duration0:15, level0:1, duration1:15, level1:1)
+ */
+WS2812RmtTiming ws2812_rmt_timing(uint32_t counter_clk_hz);
+
+/**
+ * @brief encode GRB pixel values (0x00GGRRBB, MSB first) into rmt items
+ * @return number of items written (pixel_cnt * 24)
+ */
+size_t ws2812_encode_rmt_items(const uint32_t *grb, size_t pixel_cnt, uint32_t *items, WS2812RmtTiming timing);
+
+/**
+ * @brief encode GRB pixel values into SPI MOSI bitstream via byte lookup table (iram, called from the spi interrupt)
+ * @return number of bytes written (pixel_cnt * WS2812_SPI_BYTES_PER_PIXEL)
+ */
+size_t ws2812_encode_spi(const uint32_t *grb, size_t pixel_cnt, uint8_t *out);
+
+/**
+ * @brief time on the wire for one frame, including the latch (microseconds)
+ */
+uint32_t ws2812_frame_time_us(size_t pixel_cnt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
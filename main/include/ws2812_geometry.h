@@ -0,0 +1,47 @@
+#ifndef _WS2812_GEOMETRY_H_
+#define _WS2812_GEOMETRY_H_
+#pragma once
+
+#include "ws2812_color.h"
+#include "definition.h"
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct st_ws2812_strip_config
+{
+    uint8_t gpio_pin_no;
+    uint16_t pixel_cnt;
+    uint8_t color_order;    // eColorOrder
+} WS2812StripConfig;
+
+typedef struct st_ws2812_geometry
+{
+    uint8_t pwm_pin_no;     // brightness pwm (ledc)
+    uint8_t strip_cnt;
+    WS2812StripConfig strips[WS2812_MAX_STRIPS];
+} WS2812Geometry;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+WS2812Geometry ws2812_default_geometry();
+
+/**
+ * @brief backend of a strip (WS2812_OUTPUT_RMT / WS2812_OUTPUT_SPI)
+ * a single spi host is available: in spi mode it drives the first strip, further strips use rmt
+ */
+uint8_t ws2812_strip_output(uint8_t strip, uint8_t output_mode = WS2812_OUTPUT_MODE);
+
+size_t ws2812_geometry_pixel_count(const WS2812Geometry *geometry);
+
+/**
+ * @brief pins, color orders and pixel limits of the backends
+ * rmt strips together up to WS2812_MAX_RMT_PIXEL_COUNT, the spi strip up to WS2812_MAX_SPI_PIXEL_COUNT
+ */
+bool ws2812_validate_geometry(const WS2812Geometry *geometry, uint8_t output_mode = WS2812_OUTPUT_MODE);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,90 @@
+#ifndef _WS2812_OUTPUT_H_
+#define _WS2812_OUTPUT_H_
+#pragma once
+
+#include "driver/rmt.h"
+#include "driver/spi_master.h"
+#include "ws2812_encoder.h"
+#include <stdint.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class CWS2812Output
+{
+public:
+    CWS2812Output() {}
+    virtual ~CWS2812Output() {}
+
+public:
+    virtual bool initialize(uint8_t gpio_pin_no, uint8_t channel, uint16_t pixel_cnt) = 0;
+    virtual bool release() = 0;
+    virtual bool transmit(const uint32_t *grb, size_t pixel_cnt) = 0;
+    virtual bool wait_done(uint32_t timeout_ms) = 0;
+};
+
+/**
+ * RMT backend: whole frame is encoded into rmt items (96 bytes/pixel)
+ * suitable for short strips
+ */
+class CWS2812RmtOutput : public CWS2812Output
+{
+public:
+    CWS2812RmtOutput();
+    virtual ~CWS2812RmtOutput();
+
+public:
+    bool initialize(uint8_t gpio_pin_no, uint8_t channel, uint16_t pixel_cnt) override;
+    bool release() override;
+    bool transmit(const uint32_t *grb, size_t pixel_cnt) override;
+    bool wait_done(uint32_t timeout_ms) override;
+
+private:
+    rmt_channel_t m_channel;
+    bool m_installed;
+    WS2812RmtTiming m_timing;
+    std::vector<uint32_t> m_items;
+};
+
+/**
+ * SPI(DMA) streaming backend: the frame is copied (4 bytes/pixel) and encoded chunk by chunk
+ * into two small ping-pong buffers, memory usage does not depend on the encoded size
+ * all chunk transactions of a frame are queued at once, the completion interrupt (post_cb)
+ * encodes the chunk after next into the buffer just sent, so the line never idles
+ * between chunks however late the led task runs
+ */
+class CWS2812SpiOutput : public CWS2812Output
+{
+public:
+    CWS2812SpiOutput();
+    virtual ~CWS2812SpiOutput();
+
+public:
+    bool initialize(uint8_t gpio_pin_no, uint8_t channel, uint16_t pixel_cnt) override;
+    bool release() override;
+    bool transmit(const uint32_t *grb, size_t pixel_cnt) override;
+    bool wait_done(uint32_t timeout_ms) override;
+
+private:
+    spi_host_device_t m_host;
+    spi_device_handle_t m_handle;
+    uint8_t *m_buffer[2];
+    uint8_t *m_reset_buffer;
+    uint32_t *m_frame;                          // copy of the frame being sent, read by the interrupt
+    size_t m_frame_capacity;
+    size_t m_frame_cnt;
+    size_t m_encoded_cnt;                       // pixels encoded so far (interrupt side while sending)
+    std::vector<spi_transaction_t> m_transaction;   // one per chunk + latch
+    int m_pending;
+
+    esp_err_t queue(spi_transaction_t *trans, const uint8_t *data, size_t len, void *user);
+    void encode_chunk(uint8_t *buffer);
+    static void post_transaction(spi_transaction_t *trans);
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,69 @@
+#ifndef _WS2812_SCENE_H_
+#define _WS2812_SCENE_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ws2812_color.h"
+
+/**
+ * scene binary encoding (hardware independent), little endian
+ *   WS2812SceneHeader
+ *   frame payload      pixel_cnt pixels, raw rgb or run length encoded (WS2812_SCENE_FLAG_RLE)
+ * rle packets: [n - 1] + rgb          run of n (1..128) equal pixels
+ *              [0x80 | (n - 1)] + n rgb   n (1..128) literal pixels
+ */
+#define WS2812_SCENE_MAGIC          0x454E4353  // "SCNE"
+#define WS2812_SCENE_VERSION        1
+#define WS2812_SCENE_NAME_LEN       24          // including nul
+#define WS2812_SCENE_FLAG_FRAME     0x01        // per pixel frame follows the header
+#define WS2812_SCENE_FLAG_RLE       0x02        // frame payload is run length encoded
+
+typedef struct st_ws2812_scene_header
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint16_t pixel_cnt;         // frame pixels (all strips back to back)
+    uint32_t payload_len;       // encoded frame bytes
+    uint8_t brightness;
+    uint8_t effect_id;          // WS2812_EFFECT_NONE: frame is shown
+    uint8_t effect_speed;
+    uint8_t effect_size;
+    uint8_t effect_rgb[3];
+    uint8_t rgb[3];             // common color
+    uint8_t reserved[2];
+    char name[WS2812_SCENE_NAME_LEN];
+} WS2812SceneHeader;
+
+static_assert(sizeof(WS2812SceneHeader) == 48, "scene layout");
+
+#define WS2812_SCENE_MAX_SIZE(pixel_cnt)    (sizeof(WS2812SceneHeader) + (pixel_cnt) * 3)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @return encoded bytes, 0 if out_size is too small
+ */
+size_t ws2812_scene_rle_encode(const RGB *pixels, size_t pixel_cnt, uint8_t *out, size_t out_size);
+bool ws2812_scene_rle_decode(const uint8_t *data, size_t len, RGB *pixels, size_t pixel_cnt);
+
+/**
+ * @brief header (magic, version, payload fields are set here) + frame (if WS2812_SCENE_FLAG_FRAME),
+ *        rle is used when it is smaller than the raw frame
+ * @return scene bytes, 0 if out_size is too small
+ */
+size_t ws2812_scene_encode(const WS2812SceneHeader *header, const RGB *pixels, uint8_t *out, size_t out_size);
+
+/**
+ * @brief validate and decode a scene, frame pixels are written if pixels != nullptr
+ * @return false on bad magic, unknown version, truncated data or more than pixel_capacity pixels
+ */
+bool ws2812_scene_decode(const uint8_t *data, size_t len, WS2812SceneHeader *header, RGB *pixels, size_t pixel_capacity);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,92 @@
+#ifndef _WS2812_STREAM_H_
+#define _WS2812_STREAM_H_
+#pragma once
+
+#include "ws2812_color.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define WS2812_STREAM_DMX_PIXELS        170     // pixels per dmx universe (510 of 512 slots)
+#define WS2812_STREAM_MAX_UNIVERSES     32      // universe mask width
+
+typedef enum
+{
+    WS2812_STREAM_DDP = 0,
+    WS2812_STREAM_E131,     // sACN
+    WS2812_STREAM_ARTNET,
+    WS2812_STREAM_PROTOCOL_COUNT
+} eStreamProtocol;
+
+typedef struct st_ws2812_stream_stats
+{
+    uint32_t packets;           // datagrams fed to the decoder
+    uint32_t bytes;             // pixel payload bytes written to the frame
+    uint32_t frames;            // completed frames
+    uint32_t sync_packets;      // e1.31 / art-net sync
+    uint32_t dropped_stale;     // out of order or duplicated sequence numbers
+    uint32_t dropped_malformed; // bad header or length
+    uint32_t dropped_ignored;   // valid but not for us (universe out of range, preview, query, ...)
+    uint32_t frames_rejected;   // completed but not shown, frame buffer busy or geometry changed (receiver)
+} WS2812StreamStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * DDP / E1.31 / Art-Net packet decoder (hardware independent)
+ * payloads are assembled into a packed rgb frame, feed() returns true when the frame is complete
+ *   DDP       : byte offset into the frame, frame completes on the push flag
+ *   E1.31     : universe n (from first universe) holds pixels [n * 170, n * 170 + 170),
+ *   Art-Net     frame completes on sync (if the sender uses a sync address) or
+ *               when every universe seen in the previous frame has arrived
+ */
+class CWS2812StreamDecoder
+{
+public:
+    CWS2812StreamDecoder(uint16_t e131_first_universe = 1, uint16_t artnet_first_universe = 0);
+
+public:
+    bool resize(size_t pixel_cnt);
+    size_t get_pixel_count() const { return m_frame.size(); }
+    const RGB* get_frame() const { return m_frame.data(); }
+    void reset();   // forget sequence numbers and pending universes (sender restarted or timed out)
+
+    bool feed(uint8_t protocol, const uint8_t *data, size_t len);
+
+    void get_stats(WS2812StreamStats *stats) const { *stats = m_stats; }
+    void reset_stats();
+
+private:
+    std::vector<RGB> m_frame;
+    uint16_t m_first_universe[WS2812_STREAM_PROTOCOL_COUNT];
+    uint8_t m_universe_cnt;
+    uint32_t m_universe_pending;    // universes received since the last completed frame
+    uint32_t m_universe_active;     // universes that made up the previous frame
+    uint8_t m_universe_seq[WS2812_STREAM_MAX_UNIVERSES];
+    uint32_t m_universe_seq_valid;
+    uint16_t m_sync_address;        // e1.31 sync universe announced by data packets (0: none)
+    bool m_artnet_sync;             // art-net sender uses ArtSync
+    uint8_t m_ddp_seq;              // 0: not tracked
+    WS2812StreamStats m_stats;
+
+    bool feed_ddp(const uint8_t *data, size_t len);
+    bool feed_e131(const uint8_t *data, size_t len);
+    bool feed_artnet(const uint8_t *data, size_t len);
+    bool write_universe(uint8_t protocol, uint16_t universe, bool has_seq, uint8_t seq, const uint8_t *slots, size_t slot_cnt, bool synced);
+    bool complete_frame();
+};
+
+/**
+ * sequence checks, true if the packet has to be dropped
+ * e1.31 / art-net (e1.31 6.7.2): duplicated or up to 19 behind the last one
+ * ddp (4 bit, 1 ~ 15): up to 4 behind, equal numbers pass (senders may number frames instead of packets)
+ */
+bool ws2812_stream_seq_stale(uint8_t last, uint8_t seq);
+bool ws2812_stream_ddp_seq_stale(uint8_t last, uint8_t seq);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,94 @@
+#ifndef _WS2812_TIMELINE_H_
+#define _WS2812_TIMELINE_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WS2812_TIMELINE_MAX_KEYFRAMES   12
+#define WS2812_TIMELINE_MAX_SEQUENCES   4
+#define WS2812_TIMELINE_MAX_CHANNELS    3
+#define WS2812_Q16_ONE                  65536UL
+
+typedef enum
+{
+    WS2812_EASE_LINEAR = 0,
+    WS2812_EASE_IN,         // quadratic
+    WS2812_EASE_OUT,        // quadratic
+    WS2812_EASE_IN_OUT,     // smoothstep
+    WS2812_EASE_STEP,       // jump to target at keyframe start and hold
+} eEasingType;
+
+typedef struct st_ws2812_keyframe
+{
+    uint32_t duration_ms;   // transition time from previous value to this keyframe
+    uint8_t easing;
+    uint8_t value[WS2812_TIMELINE_MAX_CHANNELS];
+} WS2812Keyframe;
+
+typedef struct st_ws2812_sequence
+{
+    WS2812Keyframe keys[WS2812_TIMELINE_MAX_KEYFRAMES];
+    uint8_t key_count;
+    uint16_t repeat;        // number of plays, 0: forever
+} WS2812Sequence;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief easing curve in Q16 fixed point
+ * @param t progress (0 ~ WS2812_Q16_ONE)
+ * @return eased progress (0 ~ WS2812_Q16_ONE)
+ */
+uint32_t ws2812_ease(uint8_t easing, uint32_t t);
+
+/**
+ * @brief interpolate between a and b with Q16 weight (rounded)
+ */
+uint8_t ws2812_lerp_u8(uint8_t a, uint8_t b, uint32_t w);
+
+/**
+ * @brief helpers to build sequences
+ */
+void ws2812_sequence_init(WS2812Sequence *seq, uint16_t repeat);
+bool ws2812_sequence_add(WS2812Sequence *seq, uint32_t duration_ms, uint8_t easing, const uint8_t *value, uint8_t channels);
+
+/**
+ * Keyframe track for one parameter (brightness or color)
+ * advanced by the LED task once per frame tick, no dynamic allocation
+ */
+class CWS2812Track
+{
+public:
+    CWS2812Track();
+    virtual ~CWS2812Track();
+
+public:
+    void reset(const uint8_t *value, uint8_t channels);
+    bool play(const WS2812Sequence *seq, uint32_t now_ms, bool enqueue);
+    void stop();
+    bool advance(uint32_t now_ms);
+    bool is_active() { return m_count > 0; }
+    const uint8_t *get_value() { return m_value; }
+
+private:
+    WS2812Sequence m_queue[WS2812_TIMELINE_MAX_SEQUENCES];
+    uint8_t m_head;
+    uint8_t m_count;
+    uint8_t m_key;
+    uint16_t m_loop;
+    uint32_t m_key_start_ms;
+    uint8_t m_channels;
+    uint8_t m_from[WS2812_TIMELINE_MAX_CHANNELS];
+    uint8_t m_value[WS2812_TIMELINE_MAX_CHANNELS];
+
+    bool set_value(const uint8_t *value);
+    void begin(uint32_t now_ms);
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
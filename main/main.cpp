@@ -17,10 +17,71 @@
 #include "network.h"
 #include "webserver.h"
 #include "memory.h"
+#include "scene_store.h"
+#include "stream_receiver.h"
+#include "boot_timeline.h"
+
+static void func_boot_wifi(void *param)
+{
+    if (activate_wifi_softap()) {
+        boot_timeline_mark(BOOT_PHASE_WIFI);
+    }
+    GetStreamReceiver()->start();   // multicast groups are joined on the soft-ap interface
+    vTaskDelete(nullptr);
+}
+
+static void func_boot_web(void *param)
+{
+    if (GetWebServer()->start()) {
+        boot_timeline_mark(BOOT_PHASE_HTTP);
+    }
+    vTaskDelete(nullptr);
+}
 
 extern "C" void app_main(void)
 {
     esp_err_t err;
+    boot_timeline_mark(BOOT_PHASE_APP_MAIN);
+    StartLogger();  // records logged before this are kept in the rings
+
+    // light first: the persisted state is shown before any networking is started
+    bool nvs_ready = GetMemory()->start();
+    if (nvs_ready) {
+        boot_timeline_mark(BOOT_PHASE_NVS);
+    }
+    WS2812Geometry geometry = ws2812_default_geometry();
+    GetMemory()->load_ws2812_geometry(&geometry);
+    GetWS2812Ctrl()->initialize(geometry);
+
+    WS2812Calibration calibration = ws2812_default_calibration();
+    if (GetMemory()->load_ws2812_calibration(&calibration)) {
+        GetWS2812Ctrl()->set_calibration(calibration, false);
+    }
+    boot_timeline_mark(BOOT_PHASE_LEDS);
+
+    GetSceneStore()->initialize();
+    bool restored = false;
+#if SCENE_RESTORE_ON_BOOT
+    restored = GetSceneStore()->restore_last();
+#endif
+    if (!restored) {
+        // brightness and color in one batch (one wake-up, one fade), values come from nvs
+        uint8_t red = 0, green = 0, blue = 0;
+        WS2812Update update{};
+        update.fields = WS2812_UPDATE_BRIGHTNESS | WS2812_UPDATE_COLOR;
+        update.strip = WS2812_STRIP_ALL;
+        update.fade_ms = WS2812_FADE_TIME_MS;
+        GetMemory()->load_ws2812_brightness(&update.brightness);
+        GetMemory()->load_ws2812_color(&red, &green, &blue);
+        update.color = RGB(red, green, blue);
+        GetWS2812Ctrl()->apply_update(update);
+    }
+
+    if (!nvs_ready) {
+        // wifi needs nvs (calibration data), leds stay on with the default state
+        GetLogger(eLogType::Error)->Log("nvs is not available, wifi and http server are not started");
+        return;
+    }
 
     err = esp_netif_init();
     if (err != ESP_OK) {
@@ -31,17 +92,9 @@ extern "C" void app_main(void)
     if (err != ESP_OK) {
         GetLogger(eLogType::Error)->Log("Failed to create event loop (ret: %d)", err);
     }
+    boot_timeline_mark(BOOT_PHASE_NETIF);
 
-    activate_wifi_softap();
-    GetWS2812Ctrl()->initialize(PIN_WS2812_DATA, WS2812_PIXEL_COUNT);
-
-    uint8_t brightness = 0;
-    GetMemory()->load_ws2812_brightness(&brightness);
-    GetWS2812Ctrl()->set_brightness(brightness);
-
-    uint8_t red = 0, green = 0, blue = 0;
-    GetMemory()->load_ws2812_color(&red, &green, &blue);
-    GetWS2812Ctrl()->set_common_color(red, green, blue);
-    
-    GetWebServer()->start();
+    // soft-ap and http server come up in parallel (spiffs mount does not wait for the radio)
+    xTaskCreate(func_boot_wifi, "TASK_BOOT_WIFI", 4096, nullptr, TASK_PRIORITY_BOOT, nullptr);
+    xTaskCreate(func_boot_web, "TASK_BOOT_WEB", 4096, nullptr, TASK_PRIORITY_BOOT, nullptr);
 }
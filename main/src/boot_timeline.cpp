@@ -0,0 +1,66 @@
+/**
+ * @file boot_timeline.cpp
+ * @author yogyui
+ * @brief boot phase timestamps (time to first light, time to first http response)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "boot_timeline.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+static const char *phase_names[BOOT_PHASE_COUNT] = {
+    "app_main",
+    "nvs",
+    "leds",
+    "first_light",
+    "netif",
+    "wifi",
+    "http",
+    "http_response",
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t s_reached = 0;     // phase bits, read without the lock (hot paths)
+static int64_t s_timestamps[BOOT_PHASE_COUNT];
+
+void boot_timeline_mark(eBootPhase phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || (s_reached & (1UL << phase))) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (!(s_reached & (1UL << phase))) {
+        s_timestamps[phase] = now;
+        s_reached |= (1UL << phase);
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+bool boot_timeline_reached(eBootPhase phase)
+{
+    return phase < BOOT_PHASE_COUNT && (s_reached & (1UL << phase));
+}
+
+int64_t boot_timeline_get(eBootPhase phase)
+{
+    int64_t timestamp = -1;
+    portENTER_CRITICAL(&s_lock);
+    if (boot_timeline_reached(phase)) {
+        timestamp = s_timestamps[phase];
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return timestamp;
+}
+
+const char* boot_phase_name(uint8_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT)
+        return "unknown";
+    return phase_names[phase];
+}
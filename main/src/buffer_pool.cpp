@@ -0,0 +1,58 @@
+/**
+ * @file buffer_pool.cpp
+ * @author yogyui
+ * @brief fixed size buffer pool
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "buffer_pool.h"
+#include "logger.h"
+
+CBufferPool::CBufferPool(size_t block_size, size_t block_cnt)
+{
+    m_block_size = block_size;
+    m_block_cnt = 0;
+    m_memory = new char[block_size * block_cnt];
+    m_queue_free = xQueueCreate(block_cnt, sizeof(char *));
+    if (!m_memory || !m_queue_free) {
+        GetLogger(eLogType::Error)->Log("Failed to allocate buffer pool (%d x %d)", block_cnt, block_size);
+        return;
+    }
+
+    for (size_t i = 0; i < block_cnt; i++) {
+        char *block = m_memory + i * block_size;
+        xQueueSend(m_queue_free, &block, 0);
+    }
+    m_block_cnt = block_cnt;
+}
+
+CBufferPool::~CBufferPool()
+{
+    if (m_queue_free) {
+        vQueueDelete(m_queue_free);
+    }
+    delete[] m_memory;
+}
+
+char* CBufferPool::acquire(TickType_t wait_ticks/*=portMAX_DELAY*/)
+{
+    char *block = nullptr;
+    if (!m_block_cnt || xQueueReceive(m_queue_free, &block, wait_ticks) != pdTRUE) {
+        return nullptr;
+    }
+    return block;
+}
+
+void CBufferPool::release(char *block)
+{
+    if (block) {
+        xQueueSend(m_queue_free, &block, 0);
+    }
+}
+
+size_t CBufferPool::get_available()
+{
+    return m_block_cnt ? uxQueueMessagesWaiting(m_queue_free) : 0;
+}
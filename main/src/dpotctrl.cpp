@@ -20,6 +20,7 @@ CDpotCtrl::CDpotCtrl()
 {
     m_handle = nullptr;
     m_value = 0;
+    m_state_version = 1;
     memset(&m_spi_transaction, 0, sizeof(m_spi_transaction));
     m_spi_transaction.length = 8;
     m_spi_transaction.rxlength = 0;
@@ -91,6 +92,7 @@ bool CDpotCtrl::set_raw_value(uint8_t value)
     }
 
     m_value = value;
+    m_state_version++;
     m_spi_transaction.tx_buffer=&value;
     esp_err_t ret = spi_device_polling_transmit(m_handle, &m_spi_transaction);
     if (ret != ESP_OK) {
@@ -100,9 +102,9 @@ bool CDpotCtrl::set_raw_value(uint8_t value)
 
     float rwb = (float)value / 256.f * DPOT_RAB_RESISTANCE + DPOT_RW_RESISTANCE;
     if (rwb < 1000)
-        GetLogger(eLogType::Info)->Log("set dpot value: %d, expected resistance Rwb=%g", value, rwb);
+        GetLogger(eLogType::Debug)->Log("set dpot value: %d, expected resistance Rwb=%g", value, rwb);
     else
-        GetLogger(eLogType::Info)->Log("set dpot value: %d, expected resistance Rwb=%gK", value, rwb / 1000.f);
+        GetLogger(eLogType::Debug)->Log("set dpot value: %d, expected resistance Rwb=%gK", value, rwb / 1000.f);
     return true;
 }
 
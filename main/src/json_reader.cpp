@@ -0,0 +1,353 @@
+/**
+ * @file json_reader.cpp
+ * @author yogyui
+ * @brief schema driven json reader without allocation (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "json_reader.h"
+#include <string.h>
+
+#define JSON_MAX_NAME   24      // enum names (effect, color order)
+
+typedef struct st_json_cursor
+{
+    const char *p;
+    const char *end;
+} JsonCursor;
+
+static void skip_ws(JsonCursor *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r' || *c->p == '\n'))
+        c->p++;
+}
+
+static bool expect(JsonCursor *c, char ch)
+{
+    skip_ws(c);
+    if (c->p < c->end && *c->p == ch) {
+        c->p++;
+        return true;
+    }
+    return false;
+}
+
+static bool peek(JsonCursor *c, char ch)
+{
+    skip_ws(c);
+    return c->p < c->end && *c->p == ch;
+}
+
+static bool match_literal(JsonCursor *c, const char *literal)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, literal, len) != 0)
+        return false;
+    c->p += len;
+    return true;
+}
+
+/**
+ * read a string into out (nul terminated), out == nullptr: skip
+ * escapes are decoded except \u (replaced with '?')
+ */
+static bool read_string(JsonCursor *c, char *out, size_t out_size)
+{
+    if (!expect(c, '"'))
+        return false;
+
+    size_t len = 0;
+    while (c->p < c->end) {
+        char ch = *c->p++;
+        if (ch == '"') {
+            if (out)
+                out[len] = '\0';
+            return true;
+        }
+        if ((unsigned char)ch < 0x20)
+            return false;
+        if (ch == '\\') {
+            if (c->p >= c->end)
+                return false;
+            char esc = *c->p++;
+            switch (esc) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'u':
+                if (c->end - c->p < 4)
+                    return false;
+                c->p += 4;
+                ch = '?';
+                break;
+            default: ch = esc; break;   // " \ /
+            }
+        }
+        if (out) {
+            if (len + 1 >= out_size)
+                return false;
+            out[len++] = ch;
+        }
+    }
+    return false;
+}
+
+/**
+ * number as fixed point x 100 (rounded), exponents are not supported
+ */
+static bool read_number_x100(JsonCursor *c, int64_t *value)
+{
+    skip_ws(c);
+    bool negative = false;
+    if (c->p < c->end && *c->p == '-') {
+        negative = true;
+        c->p++;
+    }
+    if (c->p >= c->end || *c->p < '0' || *c->p > '9')
+        return false;
+
+    int64_t integer = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        integer = integer * 10 + (*c->p++ - '0');
+        if (integer > 0xFFFFFFFFLL)
+            return false;
+    }
+    int64_t fraction = 0;   // x 1000
+    if (c->p < c->end && *c->p == '.') {
+        c->p++;
+        if (c->p >= c->end || *c->p < '0' || *c->p > '9')
+            return false;
+        int64_t scale = 100;
+        while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+            fraction += (*c->p++ - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (c->p < c->end && (*c->p == 'e' || *c->p == 'E'))
+        return false;
+
+    int64_t x100 = integer * 100 + (fraction + 5) / 10;
+    *value = negative ? -x100 : x100;
+    return true;
+}
+
+static bool skip_value(JsonCursor *c, int depth)
+{
+    if (depth > JSON_READER_MAX_DEPTH)
+        return false;
+
+    skip_ws(c);
+    if (c->p >= c->end)
+        return false;
+
+    int64_t number;
+    switch (*c->p) {
+    case '"':
+        return read_string(c, nullptr, 0);
+    case '{':
+        c->p++;
+        if (expect(c, '}'))
+            return true;
+        do {
+            if (!read_string(c, nullptr, 0) || !expect(c, ':') || !skip_value(c, depth + 1))
+                return false;
+        } while (expect(c, ','));
+        return expect(c, '}');
+    case '[':
+        c->p++;
+        if (expect(c, ']'))
+            return true;
+        do {
+            if (!skip_value(c, depth + 1))
+                return false;
+        } while (expect(c, ','));
+        return expect(c, ']');
+    case 't':
+        return match_literal(c, "true");
+    case 'f':
+        return match_literal(c, "false");
+    case 'n':
+        return match_literal(c, "null");
+    default:
+        // numbers with exponent are valid json, only rejected for known fields
+        if (read_number_x100(c, &number))
+            return true;
+        while (c->p < c->end && (*c->p == 'e' || *c->p == 'E' || *c->p == '+' || *c->p == '-' || (*c->p >= '0' && *c->p <= '9')))
+            c->p++;
+        return true;
+    }
+}
+
+static bool read_uint(JsonCursor *c, uint32_t max, uint32_t *value)
+{
+    int64_t x100;
+    if (!read_number_x100(c, &x100) || x100 < 0 || x100 / 100 > (int64_t)max)
+        return false;
+    *value = (uint32_t)(x100 / 100);    // fraction is truncated
+    return true;
+}
+
+static bool read_object(JsonCursor *c, const JsonSchema *schema, uint8_t *target, uint32_t *present);
+
+static bool read_field(JsonCursor *c, const JsonField *field, uint8_t *target)
+{
+    uint8_t *dst = target + field->offset;
+    uint32_t value;
+    int64_t x100;
+
+    switch (field->type) {
+    case JSON_UINT8:
+        if (!read_uint(c, 0xFF, &value))
+            return false;
+        *dst = (uint8_t)value;
+        return true;
+    case JSON_UINT16:
+        if (!read_uint(c, 0xFFFF, &value))
+            return false;
+        {
+            uint16_t v16 = (uint16_t)value;
+            memcpy(dst, &v16, sizeof(v16));
+        }
+        return true;
+    case JSON_UINT32:
+        if (!read_uint(c, 0xFFFFFFFF, &value))
+            return false;
+        memcpy(dst, &value, sizeof(value));
+        return true;
+    case JSON_BOOL:
+        skip_ws(c);
+        if (match_literal(c, "true")) {
+            *reinterpret_cast<bool *>(dst) = true;
+        } else if (match_literal(c, "false")) {
+            *reinterpret_cast<bool *>(dst) = false;
+        } else if (read_number_x100(c, &x100)) {
+            *reinterpret_cast<bool *>(dst) = x100 != 0;
+        } else {
+            return false;
+        }
+        return true;
+    case JSON_FIXED100:
+        if (!read_number_x100(c, &x100) || x100 < 0 || x100 > 0xFFFF)
+            return false;
+        {
+            uint16_t v16 = (uint16_t)x100;
+            memcpy(dst, &v16, sizeof(v16));
+        }
+        return true;
+    case JSON_UINT8_ARRAY:
+        if (!expect(c, '['))
+            return false;
+        if (expect(c, ']'))
+            return true;
+        for (uint16_t i = 0; ; i++) {
+            if (i < field->capacity) {
+                if (!read_uint(c, 0xFF, &value))
+                    return false;
+                dst[i] = (uint8_t)value;
+            } else if (!skip_value(c, 1)) {
+                return false;
+            }
+            if (!expect(c, ','))
+                break;
+        }
+        return expect(c, ']');
+    case JSON_ENUM:
+        if (peek(c, '"')) {
+            char name[JSON_MAX_NAME];
+            if (!read_string(c, name, sizeof(name)) || !field->from_name)
+                return false;
+            int index = field->from_name(name);
+            if (index < 0 || index > 0xFF)
+                return false;
+            *dst = (uint8_t)index;
+            return true;
+        }
+        if (!read_uint(c, 0xFF, &value))
+            return false;
+        *dst = (uint8_t)value;
+        return true;
+    case JSON_OBJECT_ARRAY:
+        if (!expect(c, '['))
+            return false;
+        target[field->count_offset] = 0;
+        if (expect(c, ']'))
+            return true;
+        for (uint16_t i = 0; ; i++) {
+            if (i >= field->capacity || !read_object(c, field->schema, dst + i * field->stride, nullptr))
+                return false;
+            target[field->count_offset] = (uint8_t)(i + 1);
+            if (!expect(c, ','))
+                break;
+        }
+        return expect(c, ']');
+    case JSON_STRING:
+        return read_string(c, reinterpret_cast<char *>(dst), field->capacity);
+    default:
+        return false;
+    }
+}
+
+static bool read_object(JsonCursor *c, const JsonSchema *schema, uint8_t *target, uint32_t *present)
+{
+    uint32_t found = 0;
+    if (!expect(c, '{'))
+        return false;
+
+    if (!expect(c, '}')) {
+        do {
+            char key[JSON_MAX_NAME];
+            // keys longer than any field name cannot match, skip them
+            JsonCursor key_start = *c;
+            bool known = read_string(c, key, sizeof(key));
+            if (!known) {
+                *c = key_start;
+                if (!read_string(c, nullptr, 0))
+                    return false;
+            }
+            if (!expect(c, ':'))
+                return false;
+
+            int index = -1;
+            for (uint8_t i = 0; known && i < schema->field_cnt; i++) {
+                if (strcmp(schema->fields[i].name, key) == 0) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index < 0) {
+                if (!skip_value(c, 1))
+                    return false;
+                continue;
+            }
+            if (!read_field(c, &schema->fields[index], target))
+                return false;
+            found |= 1UL << index;
+        } while (expect(c, ','));
+
+        if (!expect(c, '}'))
+            return false;
+    }
+
+    if ((found & schema->required) != schema->required)
+        return false;
+    if (present)
+        *present = found;
+    return true;
+}
+
+bool json_read_object(const char *json, size_t len, const JsonSchema *schema, void *target, uint32_t *present)
+{
+    if (!json || !schema || schema->field_cnt > JSON_READER_MAX_FIELDS)
+        return false;
+
+    JsonCursor c = { json, json + len };
+    if (!read_object(&c, schema, static_cast<uint8_t *>(target), present))
+        return false;
+
+    skip_ws(&c);
+    return c.p == c.end;
+}
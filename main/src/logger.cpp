@@ -1,115 +1,442 @@
 /**
  * @file logger.cpp
  * @author yogyui
- * @brief terminal log module for esp-32
+ * @brief terminal log module for esp-32 (asynchronous, per core ring buffers)
  * @version 0.1
  * @date 2023-03-14
- * 
+ *
  * @copyright Copyright (c) 2023
  */
 #include "logger.h"
 #include "esp_log.h"
-#include <vector>
-#include <cstdarg>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
 
-CLogger* CLogger::_instance;
 static const char *TAG = "logger";
 
-CLogger::CLogger()
+#define LOG_RECORD_FREE     0       // consumed space is zeroed, a record is free until it is published
+#define LOG_RECORD_READY    1
+#define LOG_RECORD_PADDING  2       // rest of the ring, the record did not fit before the wrap
+
+static_assert((LOGGER_RING_SIZE & (LOGGER_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+
+typedef struct st_log_record
 {
-    m_eLogType = eLogType::Info;
-    m_funcname = "";
-    m_filename = "";
-    m_fileline = 0;
-}
+    uint8_t state;              // LOG_RECORD_*, published last (release)
+    uint8_t level;
+    uint16_t size;              // header + args + strings, multiple of 8
+    uint8_t arg_cnt;
+    uint8_t funcname_len;       // 0: funcname is the full __PRETTY_FUNCTION__
+    uint8_t reserved[2];
+    uint32_t fileline;
+    int64_t timestamp;          // esp_timer_get_time()
+    const char *format;
+    const char *funcname;
+    const char *filename;       // basename
+} LogRecord;                    // followed by LogArg[arg_cnt] and the copied strings
 
-CLogger::~CLogger()
+typedef struct st_log_ring
 {
-    
+    std::atomic<uint32_t> head;         // reserved bytes (producers, compare-and-swap)
+    std::atomic<uint32_t> tail;         // consumed bytes (drain task)
+    std::atomic<uint32_t> dropped;      // ring was full
+    alignas(8) uint8_t buffer[LOGGER_RING_SIZE];
+} LogRing;
+
+static LogRing s_rings[portNUM_PROCESSORS];
+static TaskHandle_t s_drain_task = nullptr;
+
+// half_full: the reservation filled the ring past half
+static uint8_t* reserve_record(LogRing *ring, uint32_t size, bool *half_full)
+{
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    uint32_t pos, pad;
+    do {
+        pos = head & (LOGGER_RING_SIZE - 1);
+        pad = pos + size > LOGGER_RING_SIZE ? LOGGER_RING_SIZE - pos : 0;
+        if (head + pad + size - ring->tail.load(std::memory_order_acquire) > LOGGER_RING_SIZE) {
+            return nullptr;
+        }
+    } while (!ring->head.compare_exchange_weak(head, head + pad + size, std::memory_order_acq_rel, std::memory_order_relaxed));
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    *half_full = head - tail < LOGGER_RING_SIZE / 2 && head + pad + size - tail >= LOGGER_RING_SIZE / 2;
+
+    if (pad) {
+        LogRecord *skip = (LogRecord *)&ring->buffer[pos];
+        skip->size = (uint16_t)pad;
+        __atomic_store_n(&skip->state, LOG_RECORD_PADDING, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+    return &ring->buffer[pos];
 }
 
-CLogger* CLogger::Instance(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline)
+bool CLogger::Start()
 {
-    if (!_instance) {
-        _instance = new CLogger();
+    if (s_drain_task) {
+        return true;
     }
+    return xTaskCreate(func_drain, "TASK_LOGGER", 4096, nullptr, TASK_PRIORITY_LOGGER, &s_drain_task) == pdPASS;
+}
 
-    _instance->m_eLogType = logtype;
-    _instance->m_funcname.assign(funcname, strlen(funcname));
-    _instance->m_fileline = fileline;
+static void output_record(const LogRecord *rec);
 
-    std::string temp;
-    temp.assign(filename, strlen(filename));
-    size_t pos = temp.rfind("/");
-    if (pos != std::string::npos) {
-        _instance->m_filename.assign(temp.substr(pos + 1, temp.length()));
+// a burst filled half of the ring: the drain task starts before its poll interval ends
+static void wake_drain()
+{
+    if (!s_drain_task) {
+        return;
+    }
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_drain_task, &woken);
+        portYIELD_FROM_ISR(woken);
     } else {
-        _instance->m_filename.assign("?");
+        xTaskNotifyGive(s_drain_task);
     }
+}
 
-    return _instance;
+static void fill_record(uint8_t *data, size_t size, eLogType logtype, const char* funcname, uint8_t funcname_len, const char* filename,
+                        unsigned long fileline, int64_t timestamp, const char* format, const LogArg* args, uint8_t arg_cnt, const uint8_t *str_len)
+{
+    LogRecord *rec = (LogRecord *)data;
+    rec->level = (uint8_t)logtype;
+    rec->size = (uint16_t)size;
+    rec->arg_cnt = arg_cnt;
+    rec->funcname_len = funcname_len;
+    rec->fileline = (uint32_t)fileline;
+    rec->timestamp = timestamp;
+    rec->format = format;
+    rec->funcname = funcname;
+    rec->filename = filename;
+    LogArg *rec_args = (LogArg *)(rec + 1);
+    size_t offset = sizeof(LogRecord) + arg_cnt * sizeof(LogArg);
+    for (uint8_t i = 0; i < arg_cnt; i++) {
+        rec_args[i] = args[i];
+        if (args[i].type == LOG_ARG_STRING && args[i].value.p) {
+            // the caller's buffer may be gone when the record is formatted
+            memcpy(data + offset, args[i].value.p, str_len[i]);
+            data[offset + str_len[i]] = '\0';
+            rec_args[i].offset = (uint16_t)offset;
+            rec_args[i].size = str_len[i];
+            offset += str_len[i] + 1;
+        }
+    }
 }
 
-void CLogger::Release()
+// record and output buffers (~1.4KB) are on the caller's stack only while the ring is full
+static void __attribute__((noinline)) write_sync(size_t size, eLogType logtype, const char* funcname, uint8_t funcname_len, const char* filename,
+                                                 unsigned long fileline, int64_t timestamp, const char* format, const LogArg* args, uint8_t arg_cnt, const uint8_t *str_len)
 {
-    if (_instance) {
-        delete _instance;
-        _instance = nullptr;
+    alignas(8) uint8_t local[sizeof(LogRecord) + LOGGER_MAX_ARGS * (sizeof(LogArg) + LOGGER_MAX_STRING + 1) + 8];
+    fill_record(local, size, logtype, funcname, funcname_len, filename, fileline, timestamp, format, args, arg_cnt, str_len);
+    LogRecord *rec = (LogRecord *)local;
+    if (!funcname_len) {
+        // the name cache belongs to the drain task
+        size_t begin = log_funcname_begin(funcname);
+        rec->funcname = funcname + begin;
+        rec->funcname_len = (uint8_t)std::min<size_t>(log_funcname_end(funcname) - begin, UINT8_MAX);
     }
+    output_record(rec);
 }
 
-void CLogger::Log(const char* msg, ...)
+void CLogger::Write(eLogType logtype, const char* funcname, uint8_t funcname_len, const char* filename, 
+                    unsigned long fileline, const char* format, const LogArg* args, uint8_t arg_cnt)
 {
-    va_list vaArgs;
-    va_start(vaArgs, msg);
+    int64_t timestamp = esp_timer_get_time();
+
+    size_t size = sizeof(LogRecord) + arg_cnt * sizeof(LogArg);
+    uint8_t str_len[LOGGER_MAX_ARGS];
+    for (uint8_t i = 0; i < arg_cnt; i++) {
+        if (args[i].type == LOG_ARG_STRING && args[i].value.p) {
+            str_len[i] = (uint8_t)strnlen((const char *)args[i].value.p, LOGGER_MAX_STRING);
+            size += str_len[i] + 1;
+        }
+    }
+    size = (size + 7) & ~(size_t)7;
+
+    LogRing *ring = &s_rings[xPortGetCoreID()];
+    bool half_full = false;
+    uint8_t *data = reserve_record(ring, (uint32_t)size, &half_full);
+    if (data) {
+        fill_record(data, size, logtype, funcname, funcname_len, filename, fileline, timestamp, format, args, arg_cnt, str_len);
+        __atomic_store_n(&((LogRecord *)data)->state, LOG_RECORD_READY, __ATOMIC_RELEASE);
+        if (half_full) {
+            wake_drain();
+        }
+        return;
+    }
 
-    va_list vaArgsCopy;
-    va_copy(vaArgsCopy, vaArgs);
-    const int len = vsnprintf(nullptr, 0, msg, vaArgsCopy);
-    va_end(vaArgsCopy);
+    if (log_severity(logtype) < log_severity(eLogType::Warning) || xPortInIsrContext()) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
-    std::vector<char> zc(len + 1);
-    vsnprintf(zc.data(), zc.size(), msg, vaArgs);
-    va_end(vaArgs);
+    // ring full: warnings and errors are written by the caller (esp_log_write), ahead of older buffered records
+    write_sync(size, logtype, funcname, funcname_len, filename, fileline, timestamp, format, args, arg_cnt, str_len);
+}
 
-    Process(std::string(zc.data(), len));
+uint32_t CLogger::GetDropped()
+{
+    uint32_t dropped = 0;
+    for (auto & ring : s_rings) {
+        dropped += ring.dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
 }
 
-void CLogger::Process(std::string msg)
+static LogRecord* peek_record(LogRing *ring)
 {
-    std::string fullmsg;
-    size_t colons, begin, end;
-    colons = m_funcname.find("::");
-    if (colons != std::string::npos) {
-        begin = m_funcname.substr(0, colons).rfind(" ") + 1;
-        end = m_funcname.rfind("(") - begin;
-    } else {
-        begin = m_funcname.substr(0, colons).find(" ") + 1;
-        end = m_funcname.rfind("(") - begin;
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    while (tail != ring->head.load(std::memory_order_acquire)) {
+        LogRecord *rec = (LogRecord *)&ring->buffer[tail & (LOGGER_RING_SIZE - 1)];
+        uint8_t state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+        if (state != LOG_RECORD_PADDING) {
+            // reserved but not published yet: later records wait for it
+            return state == LOG_RECORD_READY ? rec : nullptr;
+        }
+        tail += rec->size;
+        memset(rec, 0, rec->size);
+        ring->tail.store(tail, std::memory_order_release);
     }
-    std::string funcname = m_funcname.substr(begin, end);
+    return nullptr;
+}
 
-    char szlog[256]{0,};
-    snprintf(szlog, sizeof(szlog), "[%s] %s [%s:%lu]", funcname.c_str(), msg.c_str(), m_filename.c_str(), m_fileline);
-    
-    switch (m_eLogType) {
-	case eLogType::Info:
-		ESP_LOGI(TAG, "%s", szlog);
-		break;
+static void consume_record(LogRing *ring, LogRecord *rec)
+{
+    uint32_t size = rec->size;
+    memset(rec, 0, size);
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+}
+
+static int64_t arg_int(const LogArg *arg)
+{
+    switch (arg->type) {
+    case LOG_ARG_INT:
+        return arg->value.i;
+    case LOG_ARG_DOUBLE:
+        return (int64_t)arg->value.d;
+    default:
+        return (int64_t)arg->value.u;
+    }
+}
+
+static uint64_t arg_uint(const LogArg *arg)
+{
+    switch (arg->type) {
+    case LOG_ARG_INT:
+        // width of the argument, %x of a negative int prints 32 bits
+        return arg->size < 8 ? arg->value.u & ((1ULL << (arg->size * 8)) - 1) : arg->value.u;
+    case LOG_ARG_DOUBLE:
+        return (uint64_t)arg->value.d;
+    default:
+        return arg->value.u;
+    }
+}
+
+static double arg_double(const LogArg *arg)
+{
+    switch (arg->type) {
+    case LOG_ARG_INT:
+        return (double)arg->value.i;
+    case LOG_ARG_DOUBLE:
+        return arg->value.d;
+    default:
+        return (double)arg->value.u;
+    }
+}
+
+static void format_message(const LogRecord *rec, char *out, size_t out_size)
+{
+    const LogArg *args = (const LogArg *)(rec + 1);
+    const char *f = rec->format;
+    size_t len = 0;
+    uint8_t next = 0;
+
+    while (*f && len + 1 < out_size) {
+        if (*f != '%') {
+            out[len++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            out[len++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // flags, width, precision are kept, the length modifier is replaced by the stored width
+        const char *start = f++;
+        while (*f && strchr("-+ #0", *f)) {
+            f++;
+        }
+        while ((*f >= '0' && *f <= '9') || *f == '.') {
+            f++;
+        }
+        const char *modifier = f;
+        while (*f && strchr("hlLqjzt", *f)) {
+            f++;
+        }
+        char conv = *f;
+        if (!conv) {
+            break;
+        }
+        f++;
+
+        char spec[16];
+        size_t n = std::min<size_t>(modifier - start, sizeof(spec) - 4);
+        memcpy(spec, start, n);
+        const LogArg *arg = next < rec->arg_cnt ? &args[next++] : nullptr;
+        size_t room = out_size - len;
+        int written = -1;
+        if (arg) {
+            switch (conv) {
+            case 'd':
+            case 'i':
+                memcpy(spec + n, "lld", 4);
+                written = snprintf(out + len, room, spec, (long long)arg_int(arg));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                spec[n] = 'l';
+                spec[n + 1] = 'l';
+                spec[n + 2] = conv;
+                spec[n + 3] = '\0';
+                written = snprintf(out + len, room, spec, (unsigned long long)arg_uint(arg));
+                break;
+            case 'c':
+                memcpy(spec + n, "c", 2);
+                written = snprintf(out + len, room, spec, (int)arg_int(arg));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                spec[n] = conv;
+                spec[n + 1] = '\0';
+                written = snprintf(out + len, room, spec, arg_double(arg));
+                break;
+            case 's':
+                if (arg->type == LOG_ARG_STRING) {
+                    memcpy(spec + n, "s", 2);
+                    written = snprintf(out + len, room, spec, arg->value.p ? (const char *)rec + arg->offset : "(null)");
+                }
+                break;
+            case 'p':
+                memcpy(spec + n, "p", 2);
+                written = snprintf(out + len, room, spec, arg->value.p);
+                break;
+            default:
+                break;
+            }
+        }
+        if (written < 0) {
+            // missing or mismatched argument
+            written = snprintf(out + len, room, "<?>");
+        }
+        len += std::min<size_t>(written, room - 1);
+    }
+    out[len] = '\0';
+}
+
+/**
+ * function names of records without a resolved name (gcc 8 log sites, see LOG_FUNCNAME_LEN),
+ * extracted once per function and cached, drain task only
+ */
+typedef struct st_log_funcname
+{
+    const char *pretty;         // __PRETTY_FUNCTION__ of the log site
+    uint16_t begin;
+    uint16_t len;
+} LogFuncName;
+
+static LogFuncName s_funcnames[LOGGER_FUNCNAME_CACHE];
+
+static const char* resolve_funcname(const char *pretty, size_t *len)
+{
+    LogFuncName *entry = &s_funcnames[((uintptr_t)pretty >> 2) % LOGGER_FUNCNAME_CACHE];
+    if (entry->pretty != pretty) {
+        // same extraction as the compile time path (logger.h)
+        entry->pretty = pretty;
+        entry->begin = (uint16_t)log_funcname_begin(pretty);
+        entry->len = (uint16_t)(log_funcname_end(pretty) - entry->begin);
+    }
+    *len = entry->len;
+    return pretty + entry->begin;
+}
+
+static void output_record(const LogRecord *rec)
+{
+    char funcname[64];
+    char msg[MAXLEN_LOG_MSG];
+    char szlog[MAXLEN_LOG_MSG + 96];    // message, function name and location
+    const char *name = rec->funcname;
+    size_t name_len = rec->funcname_len;    // resolved at compile time (log site)
+    if (!name_len) {
+        name = resolve_funcname(rec->funcname, &name_len);
+    }
+    size_t n = std::min<size_t>(name_len, sizeof(funcname) - 1);
+    memcpy(funcname, name, n);
+    funcname[n] = '\0';
+    format_message(rec, msg, sizeof(msg));
+    snprintf(szlog, sizeof(szlog), "[%s] %s [%s:%lu]", funcname, msg, rec->filename, (unsigned long)rec->fileline);
+
+    // time of the log call, not of the output
+    uint32_t timestamp_ms = (uint32_t)(rec->timestamp / 1000);
+    switch (rec->level) {
 	case eLogType::Warning:
-        ESP_LOGW(TAG, "%s", szlog);
+        esp_log_write(ESP_LOG_WARN, TAG, LOG_FORMAT(W, "%s"), timestamp_ms, TAG, szlog);
 		break;
 	case eLogType::Error:
-        ESP_LOGE(TAG, "%s", szlog);
+	case eLogType::Exception:
+        esp_log_write(ESP_LOG_ERROR, TAG, LOG_FORMAT(E, "%s"), timestamp_ms, TAG, szlog);
 		break;
 	case eLogType::Debug:
-        ESP_LOGD(TAG, "%s", szlog);
-		break;
-	case eLogType::Exception:
-        ESP_LOGE(TAG, "%s", szlog);
+        esp_log_write(ESP_LOG_DEBUG, TAG, LOG_FORMAT(D, "%s"), timestamp_ms, TAG, szlog);
 		break;
     default:
-        ESP_LOGI(TAG, "%s", szlog);
+        esp_log_write(ESP_LOG_INFO, TAG, LOG_FORMAT(I, "%s"), timestamp_ms, TAG, szlog);
         break;
 	}
 }
+
+void CLogger::func_drain(void *param)
+{
+    uint32_t dropped_reported = 0;
+
+    while (true) {
+        // oldest record of all cores first
+        LogRing *ring = nullptr;
+        LogRecord *rec = nullptr;
+        for (auto & r : s_rings) {
+            LogRecord *candidate = peek_record(&r);
+            if (candidate && (!rec || candidate->timestamp < rec->timestamp)) {
+                ring = &r;
+                rec = candidate;
+            }
+        }
+
+        if (rec) {
+            output_record(rec);
+            consume_record(ring, rec);
+            continue;
+        }
+
+        uint32_t dropped = GetDropped();
+        if (dropped != dropped_reported) {
+            esp_log_write(ESP_LOG_WARN, TAG, LOG_FORMAT(W, "%u log records dropped (ring full)"),
+                (uint32_t)(esp_timer_get_time() / 1000), TAG, dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOGGER_DRAIN_MS));
+    }
+}
@@ -1,28 +1,61 @@
 /**
  * @file memory.cpp
  * @author yogyui
- * @brief nvs memory manager 
+ * @brief nvs memory manager (write-behind)
  * @version 0.1
  * @date 2023-03-14
  * 
  * @copyright Copyright (c) 2023
  */
 #include "memory.h"
+#include "memory_blob.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "logger.h"
 #include "ws2812.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include <string.h>
 
 #define MEMORY_NAMESPACE "yogyui"
+#define MEMORY_STATE_KEY "state"
+#define MEMORY_STATE_VERSION 1
+#define MEMORY_BLOB_SIZE (sizeof(MemoryBlobHeader) + sizeof(MemoryState))
+
+// layout guard: a size change means a field was inserted or resized, bump the version instead
+static_assert(sizeof(MemoryState) == 62, "memory state v1 layout");
 
 CMemory* CMemory::_instance;
 
 CMemory::CMemory()
 {
+    m_handle = 0;
+    m_handle_opened = false;
+    m_lock = portMUX_INITIALIZER_UNLOCKED;
+    m_flush_mutex = xSemaphoreCreateMutex();
+    m_task_handle = nullptr;
+    memset(static_cast<void *>(&m_state), 0, sizeof(m_state));
+    m_state.calibration = ws2812_default_calibration();
+    m_loaded = false;
+    m_dirty = 0;
+    m_stored = 0;
+    m_legacy = 0;
+    m_first_dirty_tick = 0;
+    m_last_dirty_tick = 0;
+    m_writes_requested = 0;
+    m_writes_coalesced = 0;
+    m_writes_skipped = 0;
+    m_commits = 0;
+    memset(m_commit_minutes, 0, sizeof(m_commit_minutes));
+    memset(m_commit_minute_stamp, 0, sizeof(m_commit_minute_stamp));
 }
 
 CMemory::~CMemory()
 {
+    flush();
+    if (m_handle_opened) {
+        nvs_close(m_handle);
+    }
 }
 
 CMemory* CMemory::Instance()
@@ -42,60 +75,364 @@ void CMemory::Release()
     }
 }
 
-bool CMemory::read_nvs(const char *key, void *out, size_t data_size)
+bool CMemory::start()
 {
-    nvs_handle handle;
-
-    esp_err_t err = nvs_open(MEMORY_NAMESPACE, NVS_READWRITE, &handle);
+    if (m_task_handle) {
+        return true;
+    }
+    // first nvs user at boot (light state is restored before wifi, which needs nvs as well)
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // partition is full or written by a newer nvs format: erase it and start with defaults
+        GetLogger(eLogType::Warning)->Log("nvs flash is not usable (ret: %d), erase", err);
+        err = nvs_flash_erase();
+        if (err == ESP_OK) {
+            err = nvs_flash_init();
+        }
+    }
     if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to open nvs (ret=%d)", err);
+        GetLogger(eLogType::Error)->Log("Failed to initialize nvs flash (ret: %d)", err);
+        return false;
+    }
+    if (!open_handle()) {
         return false;
     }
 
-    size_t temp = data_size;
-    err = nvs_get_blob(handle, key, out, &temp);
+    load_state();
+
+    xTaskCreate(func_persist, "TASK_MEMORY", 4096, this, TASK_PRIORITY_MEMORY, &m_task_handle);
+    err = esp_register_shutdown_handler(on_shutdown);
     if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to get blob (%s, ret=%d)", key, err);
-        nvs_close(handle);
-        return false;
+        GetLogger(eLogType::Error)->Log("Failed to register shutdown handler (ret=%d)", err);
     }
 
-    nvs_close(handle);
     return true;
 }
 
-bool CMemory::write_nvs(const char *key, const void *data, const size_t data_size)
+bool CMemory::open_handle()
 {
-    nvs_handle handle;
+    // called with m_flush_mutex held (or before the task is started)
+    if (m_handle_opened) {
+        return true;
+    }
 
-    esp_err_t err = nvs_open(MEMORY_NAMESPACE, NVS_READWRITE, &handle);
+    esp_err_t err = nvs_open(MEMORY_NAMESPACE, NVS_READWRITE, &m_handle);
     if (err != ESP_OK) {
         GetLogger(eLogType::Error)->Log("Failed to open nvs (ret=%d)", err);
         return false;
     }
+    m_handle_opened = true;
 
-    err = nvs_set_blob(handle, key, data, data_size);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to set nvs blob (%s, ret=%d)", key, err);
-        nvs_close(handle);
+    return true;
+}
+
+void CMemory::load_state()
+{
+    // one nvs read for all items, called before any load_*
+    if (xSemaphoreTake(m_flush_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    if (m_loaded || !open_handle()) {
+        xSemaphoreGive(m_flush_mutex);
+        return;
+    }
+
+    uint8_t blob[MEMORY_BLOB_SIZE];
+    size_t size = sizeof(blob);
+    MemoryState state = m_state;
+    state.valid = 0;
+    esp_err_t err = nvs_get_blob(m_handle, MEMORY_STATE_KEY, blob, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        load_legacy_items();
+    } else {
+        // a blob larger than the current state can only come from a newer firmware
+        eMemoryBlobResult result = MEMORY_BLOB_CORRUPT;
+        if (err == ESP_OK) {
+            // no per version fixups yet (v1 is the first blob layout)
+            result = memory_blob_decode(blob, size, MEMORY_STATE_VERSION, &state, sizeof(state), nullptr);
+        } else if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+            result = MEMORY_BLOB_TOO_NEW;
+        }
+        if (result == MEMORY_BLOB_OK || result == MEMORY_BLOB_MIGRATED) {
+            portENTER_CRITICAL(&m_lock);
+            m_state = state;
+            m_stored = state.valid;
+            if (result == MEMORY_BLOB_MIGRATED) {
+                // written back in the current layout with the next flush
+                m_dirty |= state.valid;
+                m_stored = 0;
+                m_first_dirty_tick = m_last_dirty_tick = xTaskGetTickCount();
+            }
+            portEXIT_CRITICAL(&m_lock);
+        } else {
+            // defaults are used, the blob is replaced with the next save
+            GetLogger(eLogType::Error)->Log("Failed to load memory state (%s, ret=%d), using defaults", 
+                memory_blob_result_name(result), err);
+        }
+        if (result == MEMORY_BLOB_MIGRATED) {
+            GetLogger(eLogType::Info)->Log("memory state migrated to v%d", MEMORY_STATE_VERSION);
+        }
+    }
+    m_loaded = true;
+    xSemaphoreGive(m_flush_mutex);
+}
+
+void CMemory::load_legacy_items()
+{
+    // settings of older firmware (one key per item), called with m_flush_mutex held
+    for (int item = 0; item < ITEM_COUNT; item++) {
+        size_t data_size;
+        void *cache = item_cache((ITEM)item, &data_size);
+        uint8_t temp[sizeof(MemoryState)];
+        size_t size = data_size;
+        if (nvs_get_blob(m_handle, item_key((ITEM)item), temp, &size) != ESP_OK || size != data_size) {
+            continue;
+        }
+        portENTER_CRITICAL(&m_lock);
+        memcpy(cache, temp, data_size);
+        m_state.valid |= 1U << item;
+        m_legacy |= 1U << item;
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+    if (m_legacy) {
+        portENTER_CRITICAL(&m_lock);
+        m_dirty |= m_legacy;
+        m_first_dirty_tick = m_last_dirty_tick = xTaskGetTickCount();
+        portEXIT_CRITICAL(&m_lock);
+        GetLogger(eLogType::Info)->Log("migrate legacy memory keys (0x%02x)", m_legacy);
+    }
+}
+
+void* CMemory::item_cache(ITEM item, size_t *data_size)
+{
+    switch (item) {
+    case BRIGHTNESS:
+        *data_size = sizeof(m_state.brightness);
+        return &m_state.brightness;
+    case COLOR:
+        *data_size = sizeof(m_state.rgb);
+        return &m_state.rgb;
+    case CALIBRATION:
+        *data_size = sizeof(m_state.calibration);
+        return &m_state.calibration;
+    case GEOMETRY:
+        *data_size = sizeof(m_state.geometry);
+        return &m_state.geometry;
+    default:
+        *data_size = 0;
+        return nullptr;
+    }
+}
+
+const char* CMemory::item_key(ITEM item)
+{
+    // legacy keys (before the state blob), only read for migration
+    static const char *keys[ITEM_COUNT] = {"ws2812_br", "ws2812_rgb", "ws2812_cal", "ws2812_geo"};
+    return item < ITEM_COUNT ? keys[item] : "";
+}
+
+bool CMemory::load_item(ITEM item, void *out)
+{
+    if (!m_loaded) {
+        load_state();
+    }
+
+    size_t data_size;
+    void *cache = item_cache(item, &data_size);
+    uint8_t bit = 1U << item;
+
+    portENTER_CRITICAL(&m_lock);
+    bool valid = (m_state.valid & bit) != 0;
+    if (valid) {
+        memcpy(out, cache, data_size);
+    }
+    portEXIT_CRITICAL(&m_lock);
+
+    if (!valid) {
+        GetLogger(eLogType::Warning)->Log("No <%s> in memory", item_key(item));
+    }
+    return valid;
+}
+
+void CMemory::save_items(const ITEM *items, const void * const *data, uint8_t count)
+{
+    bool changed = false;
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&m_lock);
+    for (uint8_t i = 0; i < count; i++) {
+        size_t data_size;
+        void *cache = item_cache(items[i], &data_size);
+        uint8_t bit = 1U << items[i];
+        if (!(m_dirty & bit) && (m_stored & bit) && memcmp(cache, data[i], data_size) == 0) {
+            m_writes_skipped++;
+            continue;
+        }
+        if (m_dirty & bit) {
+            m_writes_coalesced++;
+        }
+        memcpy(cache, data[i], data_size);
+        m_state.valid |= bit;
+        if (!m_dirty) {
+            m_first_dirty_tick = now;
+        }
+        m_dirty |= bit;
+        m_writes_requested++;
+        changed = true;
+    }
+    if (changed) {
+        m_last_dirty_tick = now;
+    }
+    portEXIT_CRITICAL(&m_lock);
+
+    // debounce window restarts, the task recalculates its deadline
+    if (changed && m_task_handle) {
+        xTaskNotifyGive(m_task_handle);
+    }
+}
+
+bool CMemory::flush()
+{
+    if (xSemaphoreTake(m_flush_mutex, pdMS_TO_TICKS(MEMORY_FLUSH_WAIT_MS)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("Failed to flush memory (busy)");
+        return false;
+    }
+    if (!open_handle()) {
+        xSemaphoreGive(m_flush_mutex);
         return false;
     }
 
-    err = nvs_commit(handle);
+    // snapshot, saves coming in meanwhile stay dirty for the next flush
+    portENTER_CRITICAL(&m_lock);
+    uint8_t dirty = m_dirty;
+    uint8_t legacy = m_legacy;
+    m_dirty = 0;
+    MemoryState state = m_state;
+    portEXIT_CRITICAL(&m_lock);
+
+    if (!dirty) {
+        xSemaphoreGive(m_flush_mutex);
+        return true;
+    }
+
+    // whole state in one blob, migrated legacy keys are erased with the same commit
+    uint8_t blob[MEMORY_BLOB_SIZE];
+    size_t size = memory_blob_encode(MEMORY_STATE_VERSION, &state, sizeof(state), blob, sizeof(blob));
+    esp_err_t err = nvs_set_blob(m_handle, MEMORY_STATE_KEY, blob, size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to set nvs blob (%s, ret=%d)", MEMORY_STATE_KEY, err);
+    }
+    for (int item = 0; item < ITEM_COUNT && err == ESP_OK; item++) {
+        if (legacy & (1U << item)) {
+            esp_err_t ret = nvs_erase_key(m_handle, item_key((ITEM)item));
+            if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+                GetLogger(eLogType::Warning)->Log("Failed to erase legacy key (%s, ret=%d)", item_key((ITEM)item), ret);
+            }
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(m_handle);
+        if (err != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to commit nvs (ret=%d)", err);
+        }
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    portENTER_CRITICAL(&m_lock);
+    if (err == ESP_OK) {
+        m_stored |= dirty;
+        m_legacy &= ~legacy;
+    } else {
+        // retried after the next debounce window
+        m_dirty |= dirty;
+        m_first_dirty_tick = now;
+        m_last_dirty_tick = now;
+    }
+    portEXIT_CRITICAL(&m_lock);
+    xSemaphoreGive(m_flush_mutex);
+
     if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to commit nvs (ret=%d)", err);
-        nvs_close(handle);
         return false;
     }
+    count_commit();
+    GetLogger(eLogType::Info)->Log("save memory (%s%s%s%s)", (dirty & (1U << BRIGHTNESS)) ? "brightness " : "",
+        (dirty & (1U << COLOR)) ? "rgb " : "", (dirty & (1U << CALIBRATION)) ? "calibration " : "",
+        (dirty & (1U << GEOMETRY)) ? "geometry" : "");
 
-    nvs_close(handle);
     return true;
 }
 
+void CMemory::count_commit()
+{
+    uint32_t minute = (uint32_t)(esp_timer_get_time() / 60000000LL);
+    int index = minute % MEMORY_STATS_MINUTES;
+    portENTER_CRITICAL(&m_lock);
+    if (m_commit_minute_stamp[index] != minute) {
+        m_commit_minute_stamp[index] = minute;
+        m_commit_minutes[index] = 0;
+    }
+    m_commit_minutes[index]++;
+    m_commits++;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void CMemory::get_stats(MemoryStats *stats)
+{
+    uint32_t minute = (uint32_t)(esp_timer_get_time() / 60000000LL);
+    portENTER_CRITICAL(&m_lock);
+    stats->writes_requested = m_writes_requested;
+    stats->writes_coalesced = m_writes_coalesced;
+    stats->writes_skipped = m_writes_skipped;
+    stats->commits = m_commits;
+    stats->commits_last_hour = 0;
+    for (int i = 0; i < MEMORY_STATS_MINUTES; i++) {
+        if (minute - m_commit_minute_stamp[i] < MEMORY_STATS_MINUTES) {
+            stats->commits_last_hour += m_commit_minutes[i];
+        }
+    }
+    stats->pending = __builtin_popcount(m_dirty);
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void CMemory::func_persist(void *param)
+{
+    CMemory *obj = static_cast<CMemory *>(param);
+
+    GetLogger(eLogType::Info)->Log("Memory Persistence Task Started");
+    while (true) {
+        // sleep until something is dirty, then until the debounce window (or the max delay) is over
+        TickType_t wait_ticks = portMAX_DELAY;
+        TickType_t now = xTaskGetTickCount();
+        portENTER_CRITICAL(&obj->m_lock);
+        if (obj->m_dirty) {
+            int32_t idle_left = (int32_t)pdMS_TO_TICKS(MEMORY_DEBOUNCE_MS) - (int32_t)(now - obj->m_last_dirty_tick);
+            int32_t max_left = (int32_t)pdMS_TO_TICKS(MEMORY_MAX_DELAY_MS) - (int32_t)(now - obj->m_first_dirty_tick);
+            int32_t left = idle_left < max_left ? idle_left : max_left;
+            wait_ticks = left > 0 ? (TickType_t)left : 0;
+        }
+        portEXIT_CRITICAL(&obj->m_lock);
+
+        if (wait_ticks == 0) {
+            obj->flush();
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, wait_ticks);
+    }
+}
+
+void CMemory::on_shutdown()
+{
+    // esp_restart: pending values must not be lost
+    if (_instance) {
+        _instance->flush();
+    }
+}
+
 bool CMemory::load_ws2812_brightness(uint8_t *brightness)
 {
     uint8_t temp;
-    if (read_nvs("ws2812_br", &temp, sizeof(uint8_t))) {
+    if (load_item(BRIGHTNESS, &temp)) {
         GetLogger(eLogType::Info)->Log("load <ws2812 brightness> from memory: %d", temp);
         *brightness = temp;
     } else{
@@ -107,19 +444,16 @@ bool CMemory::load_ws2812_brightness(uint8_t *brightness)
 
 bool CMemory::save_ws2812_brightness(const uint8_t brightness)
 {
-    if (write_nvs("ws2812_br", &brightness, sizeof(uint8_t))) {
-        GetLogger(eLogType::Info)->Log("save <ws2812 brightness> to memory: %d", brightness);
-    } else {
-        return false;
-    }
-
+    ITEM item = BRIGHTNESS;
+    const void *data = &brightness;
+    save_items(&item, &data, 1);
     return true;
 }
 
 bool CMemory::load_ws2812_color(uint8_t *red, uint8_t *green, uint8_t *blue)
 {
     RGB rgb;
-    if (read_nvs("ws2812_rgb", &rgb, sizeof(RGB))) {
+    if (load_item(COLOR, &rgb)) {
         GetLogger(eLogType::Info)->Log("load <ws2812 rgb> from memory");
         *red = rgb.r;
         *green = rgb.g;
@@ -134,11 +468,68 @@ bool CMemory::load_ws2812_color(uint8_t *red, uint8_t *green, uint8_t *blue)
 bool CMemory::save_ws2812_color(const uint8_t red, uint8_t green, uint8_t blue)
 {
     RGB rgb = RGB(red, green, blue);
-    if (write_nvs("ws2812_rgb", &rgb, sizeof(RGB))) {
-        GetLogger(eLogType::Info)->Log("save <ws2812 rgb> to memory");
-    } else {
+    ITEM item = COLOR;
+    const void *data = &rgb;
+    save_items(&item, &data, 1);
+    return true;
+}
+
+bool CMemory::save_ws2812_light(const uint8_t *brightness, const RGB *rgb)
+{
+    ITEM items[2];
+    const void *data[2];
+    uint8_t count = 0;
+    if (brightness) {
+        items[count] = BRIGHTNESS;
+        data[count++] = brightness;
+    }
+    if (rgb) {
+        items[count] = COLOR;
+        data[count++] = rgb;
+    }
+    save_items(items, data, count);
+    return true;
+}
+
+bool CMemory::load_ws2812_calibration(WS2812Calibration *cal)
+{
+    WS2812Calibration temp;
+    if (load_item(CALIBRATION, &temp)) {
+        GetLogger(eLogType::Info)->Log("load <ws2812 calibration> from memory: gamma %d, wb (%d,%d,%d)",
+            temp.gamma_x100, temp.white_balance[0], temp.white_balance[1], temp.white_balance[2]);
+        *cal = temp;
+    } else{
         return false;
     }
 
     return true;
 }
+
+bool CMemory::save_ws2812_calibration(const WS2812Calibration *cal)
+{
+    ITEM item = CALIBRATION;
+    const void *data = cal;
+    save_items(&item, &data, 1);
+    return true;
+}
+
+bool CMemory::load_ws2812_geometry(WS2812Geometry *geometry)
+{
+    WS2812Geometry temp;
+    if (load_item(GEOMETRY, &temp)) {
+        GetLogger(eLogType::Info)->Log("load <ws2812 geometry> from memory: %d strips", temp.strip_cnt);
+        *geometry = temp;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+bool CMemory::save_ws2812_geometry(const WS2812Geometry *geometry)
+{
+    ITEM item = GEOMETRY;
+    const void *data = geometry;
+    save_items(&item, &data, 1);
+    return true;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file memory_blob.cpp
+ * @author yogyui
+ * @brief versioned settings blob with crc and forward migration (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "memory_blob.h"
+#include <string.h>
+
+uint32_t memory_blob_crc32(uint32_t crc, const void *data, size_t len)
+{
+    // reflected 0xEDB88320, nibble table (the blob is read once per boot)
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint32_t blob_crc(const MemoryBlobHeader *header, const uint8_t *payload)
+{
+    MemoryBlobHeader hdr = *header;
+    hdr.crc = 0;
+    uint32_t crc = memory_blob_crc32(0, &hdr, sizeof(hdr));
+    return memory_blob_crc32(crc, payload, hdr.length);
+}
+
+size_t memory_blob_encode(uint16_t version, const void *state, size_t state_size, uint8_t *out, size_t out_size)
+{
+    if (state_size > UINT16_MAX || out_size < sizeof(MemoryBlobHeader) + state_size) {
+        return 0;
+    }
+
+    MemoryBlobHeader hdr;
+    hdr.magic = MEMORY_BLOB_MAGIC;
+    hdr.version = version;
+    hdr.length = (uint16_t)state_size;
+    hdr.crc = 0;
+    uint8_t *payload = out + sizeof(hdr);
+    memcpy(payload, state, state_size);
+    hdr.crc = blob_crc(&hdr, payload);
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return sizeof(hdr) + state_size;
+}
+
+eMemoryBlobResult memory_blob_decode(const uint8_t *data, size_t len, uint16_t version, void *state, size_t state_size, 
+                                     MemoryBlobMigration migrate)
+{
+    if (len < sizeof(MemoryBlobHeader)) {
+        return MEMORY_BLOB_CORRUPT;
+    }
+
+    MemoryBlobHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    const uint8_t *payload = data + sizeof(hdr);
+    if (hdr.magic != MEMORY_BLOB_MAGIC || hdr.version == 0 || hdr.length != len - sizeof(hdr)) {
+        return MEMORY_BLOB_CORRUPT;
+    }
+    if (blob_crc(&hdr, payload) != hdr.crc) {
+        return MEMORY_BLOB_CORRUPT;
+    }
+    if (hdr.version > version) {
+        return MEMORY_BLOB_TOO_NEW;
+    }
+    if (hdr.version == version) {
+        if (hdr.length != state_size) {
+            return MEMORY_BLOB_CORRUPT;
+        }
+        memcpy(state, payload, state_size);
+        return MEMORY_BLOB_OK;
+    }
+
+    // older layout is a prefix of the current one, appended fields keep their defaults
+    if (hdr.length > state_size) {
+        return MEMORY_BLOB_CORRUPT;
+    }
+    memcpy(state, payload, hdr.length);
+    for (uint16_t from = hdr.version; from < version; from++) {
+        if (migrate) {
+            migrate(from, state);
+        }
+    }
+
+    return MEMORY_BLOB_MIGRATED;
+}
+
+const char* memory_blob_result_name(eMemoryBlobResult result)
+{
+    switch (result) {
+    case MEMORY_BLOB_OK:
+        return "ok";
+    case MEMORY_BLOB_MIGRATED:
+        return "migrated";
+    case MEMORY_BLOB_CORRUPT:
+        return "corrupt";
+    case MEMORY_BLOB_TOO_NEW:
+        return "too new";
+    default:
+        return "unknown";
+    }
+}
@@ -9,7 +9,6 @@
  */
 #include "network.h"
 #include "esp_wifi.h"
-#include <nvs_flash.h>
 #include "logger.h"
 #include "definition.h"
 #include <string.h>
@@ -32,12 +31,6 @@ bool activate_wifi_softap()
     esp_err_t err;
     wifi_mode_t cur_mode = WIFI_MODE_NULL;
 
-    err = nvs_flash_init();
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to initialize nvs flash (ret: %d)", err);
-        return false;
-    }
-
     esp_netif_t* wifiAP = esp_netif_create_default_wifi_ap();
     esp_netif_ip_info_t ipInfo;
 
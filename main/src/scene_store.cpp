@@ -0,0 +1,305 @@
+/**
+ * @file scene_store.cpp
+ * @author yogyui
+ * @brief named scene store (nvs)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "scene_store.h"
+#include "ws2812.h"
+#include "logger.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+#define SCENE_NAMESPACE     "scenes"
+#define SCENE_KEY_INDEX     "index"
+#define SCENE_KEY_LAST      "last"
+
+CSceneStore* CSceneStore::_instance = nullptr;
+
+CSceneStore::CSceneStore()
+{
+    m_handle = 0;
+    m_initialized = false;
+    m_mutex = xSemaphoreCreateMutex();
+    memset(m_index, 0, sizeof(m_index));
+    m_count = 0;
+    m_last = -1;
+}
+
+CSceneStore::~CSceneStore()
+{
+    if (m_initialized) {
+        nvs_close(m_handle);
+    }
+}
+
+CSceneStore* CSceneStore::Instance()
+{
+    if (!_instance) {
+        _instance = new CSceneStore();
+    }
+
+    return _instance;
+}
+
+bool CSceneStore::initialize()
+{
+    if (m_initialized) {
+        return true;
+    }
+
+    esp_err_t err = nvs_open(SCENE_NAMESPACE, NVS_READWRITE, &m_handle);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to open scene nvs (ret=%d)", err);
+        return false;
+    }
+    size_t size = sizeof(m_index);
+    err = nvs_get_blob(m_handle, SCENE_KEY_INDEX, m_index, &size);
+    if (err == ESP_OK && size % sizeof(SceneInfo) == 0) {
+        m_count = (uint8_t)(size / sizeof(SceneInfo));
+        for (uint8_t i = 0; i < m_count; i++) {
+            m_index[i].load_us = 0;
+        }
+    } else {
+        m_count = 0;
+    }
+    uint8_t last;
+    if (nvs_get_u8(m_handle, SCENE_KEY_LAST, &last) == ESP_OK && find(last) >= 0) {
+        m_last = last;
+    }
+    m_initialized = true;
+    GetLogger(eLogType::Info)->Log("scene store: %d scenes, last %d", m_count, m_last);
+
+    return true;
+}
+
+void CSceneStore::make_key(uint8_t id, char *key, size_t key_size)
+{
+    snprintf(key, key_size, "scene_%03u", id);
+}
+
+int CSceneStore::find(uint8_t id)
+{
+    for (uint8_t i = 0; i < m_count; i++) {
+        if (m_index[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void CSceneStore::reserve(size_t pixel_cnt)
+{
+    // sized from the geometry, grown only (recall does not allocate until the strips get longer)
+    if (m_frame.size() < pixel_cnt) {
+        std::vector<RGB>(pixel_cnt).swap(m_frame);
+        std::vector<uint8_t>(WS2812_SCENE_MAX_SIZE(pixel_cnt)).swap(m_blob);
+    }
+}
+
+bool CSceneStore::write_index()
+{
+    // empty index is stored as a single zero length blob
+    esp_err_t err = nvs_set_blob(m_handle, SCENE_KEY_INDEX, m_index, m_count * sizeof(SceneInfo));
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to write scene index (ret=%d)", err);
+        return false;
+    }
+    return true;
+}
+
+bool CSceneStore::save(uint8_t id, const char *name)
+{
+    if (!m_initialized) {
+        return false;
+    }
+
+    WS2812SceneHeader header{};
+    WS2812EffectParam param;
+    RGB rgb = GetWS2812Ctrl()->get_common_color();
+    header.brightness = GetWS2812Ctrl()->get_brightness();
+    header.effect_id = GetWS2812Ctrl()->get_effect(&param);
+    header.effect_speed = param.speed;
+    header.effect_size = param.size;
+    header.effect_rgb[0] = param.color.r;
+    header.effect_rgb[1] = param.color.g;
+    header.effect_rgb[2] = param.color.b;
+    header.rgb[0] = rgb.r;
+    header.rgb[1] = rgb.g;
+    header.rgb[2] = rgb.b;
+    snprintf(header.name, sizeof(header.name), "%s", name ? name : "");
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int index = find(id);
+    if (index < 0 && m_count >= SCENE_MAX_COUNT) {
+        xSemaphoreGive(m_mutex);
+        GetLogger(eLogType::Error)->Log("scene store is full (%d)", SCENE_MAX_COUNT);
+        return false;
+    }
+
+    // running effects are stored as effect, a static picture as frame
+    reserve(GetWS2812Ctrl()->get_pixel_count());
+    if (header.effect_id == WS2812_EFFECT_NONE) {
+        size_t pixel_cnt = GetWS2812Ctrl()->read_frame(m_frame.data(), m_frame.size());
+        if (pixel_cnt) {
+            header.flags = WS2812_SCENE_FLAG_FRAME;
+            header.pixel_cnt = (uint16_t)pixel_cnt;
+        }
+    }
+    size_t len = ws2812_scene_encode(&header, m_frame.data(), m_blob.data(), m_blob.size());
+    WS2812SceneHeader encoded;
+    memcpy(&encoded, m_blob.data(), sizeof(encoded));
+
+    char key[16];
+    make_key(id, key, sizeof(key));
+    esp_err_t err = len ? nvs_set_blob(m_handle, key, m_blob.data(), len) : ESP_FAIL;
+    if (err != ESP_OK) {
+        xSemaphoreGive(m_mutex);
+        GetLogger(eLogType::Error)->Log("Failed to write scene %d (ret=%d)", id, err);
+        return false;
+    }
+
+    if (index < 0) {
+        index = m_count++;
+    }
+    SceneInfo *info = &m_index[index];
+    info->id = id;
+    info->flags = encoded.flags;
+    info->effect_id = encoded.effect_id;
+    info->pixel_cnt = encoded.pixel_cnt;
+    info->size = (uint16_t)len;
+    memcpy(info->name, encoded.name, sizeof(info->name));
+    info->load_us = 0;
+    // scene and index go with one commit
+    bool result = write_index() && nvs_commit(m_handle) == ESP_OK;
+    xSemaphoreGive(m_mutex);
+
+    GetLogger(eLogType::Info)->Log("save scene %d '%s' (%d bytes, %s)", id, info->name, len,
+        (encoded.flags & WS2812_SCENE_FLAG_RLE) ? "rle" : (encoded.flags & WS2812_SCENE_FLAG_FRAME) ? "raw" : "no frame");
+    return result;
+}
+
+bool CSceneStore::recall(uint8_t id, uint32_t fade_ms/*=0*/)
+{
+    if (!m_initialized) {
+        return false;
+    }
+
+    int64_t time_start = esp_timer_get_time();
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int index = find(id);
+    if (index < 0) {
+        xSemaphoreGive(m_mutex);
+        GetLogger(eLogType::Error)->Log("scene %d not found", id);
+        return false;
+    }
+
+    char key[16];
+    make_key(id, key, sizeof(key));
+    // a scene saved with a longer geometry is decoded as a whole (apply_update takes the first pixels)
+    reserve(std::max<size_t>(GetWS2812Ctrl()->get_pixel_count(), m_index[index].pixel_cnt));
+    size_t len = m_blob.size();
+    WS2812SceneHeader header;
+    esp_err_t err = nvs_get_blob(m_handle, key, m_blob.data(), &len);
+    if (err != ESP_OK || !ws2812_scene_decode(m_blob.data(), len, &header, m_frame.data(), m_frame.size())) {
+        xSemaphoreGive(m_mutex);
+        GetLogger(eLogType::Error)->Log("Failed to load scene %d (ret=%d)", id, err);
+        return false;
+    }
+
+    // one batch update: brightness + (frame or color/effect) in the same frame
+    WS2812Update update{};
+    update.strip = WS2812_STRIP_ALL;
+    update.fade_ms = fade_ms;
+    update.save_memory = true;
+    update.fields = WS2812_UPDATE_BRIGHTNESS;
+    update.brightness = header.brightness;
+    if (header.flags & WS2812_SCENE_FLAG_FRAME) {
+        update.fields |= WS2812_UPDATE_PIXELS;
+        update.frame = m_frame.data();
+        update.frame_pixel_cnt = header.pixel_cnt;
+    } else {
+        update.fields |= WS2812_UPDATE_COLOR;
+        update.color = RGB(header.rgb[0], header.rgb[1], header.rgb[2]);
+        if (header.effect_id != WS2812_EFFECT_NONE) {
+            update.fields |= WS2812_UPDATE_EFFECT;
+            update.effect = header.effect_id;
+            update.effect_param.speed = header.effect_speed;
+            update.effect_param.size = header.effect_size;
+            update.effect_param.color = RGB(header.effect_rgb[0], header.effect_rgb[1], header.effect_rgb[2]);
+        }
+    }
+    bool result = GetWS2812Ctrl()->apply_update(update);
+    uint32_t load_us = (uint32_t)(esp_timer_get_time() - time_start);
+    m_index[index].load_us = load_us;
+
+    if (result && m_last != id) {
+        m_last = id;
+        if (nvs_set_u8(m_handle, SCENE_KEY_LAST, id) != ESP_OK || nvs_commit(m_handle) != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to store last scene");
+        }
+    }
+    xSemaphoreGive(m_mutex);
+
+    GetLogger(eLogType::Info)->Log("recall scene %d '%s' (%d us)", id, header.name, load_us);
+    return result;
+}
+
+bool CSceneStore::remove(uint8_t id)
+{
+    if (!m_initialized) {
+        return false;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int index = find(id);
+    if (index < 0) {
+        xSemaphoreGive(m_mutex);
+        return false;
+    }
+
+    char key[16];
+    make_key(id, key, sizeof(key));
+    nvs_erase_key(m_handle, key);
+    memmove(&m_index[index], &m_index[index + 1], (m_count - index - 1) * sizeof(SceneInfo));
+    m_count--;
+    if (m_last == id) {
+        m_last = -1;
+        nvs_erase_key(m_handle, SCENE_KEY_LAST);
+    }
+    bool result = write_index() && nvs_commit(m_handle) == ESP_OK;
+    xSemaphoreGive(m_mutex);
+
+    GetLogger(eLogType::Info)->Log("remove scene %d", id);
+    return result;
+}
+
+bool CSceneStore::restore_last()
+{
+    if (m_last < 0) {
+        return false;
+    }
+    return recall((uint8_t)m_last);
+}
+
+uint8_t CSceneStore::get_scene_count()
+{
+    return m_count;
+}
+
+bool CSceneStore::get_info(uint8_t index, SceneInfo *info)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool result = index < m_count;
+    if (result) {
+        *info = m_index[index];
+    }
+    xSemaphoreGive(m_mutex);
+
+    return result;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file stream_receiver.cpp
+ * @author yogyui
+ * @brief UDP pixel stream receiver (DDP / E1.31 / Art-Net)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "stream_receiver.h"
+#include "ws2812.h"
+#include "logger.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+CStreamReceiver* CStreamReceiver::_instance = nullptr;
+
+static const uint16_t stream_ports[WS2812_STREAM_PROTOCOL_COUNT] = {
+    STREAM_DDP_PORT,
+    STREAM_E131_PORT,
+    STREAM_ARTNET_PORT
+};
+
+static uint32_t get_time_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+CStreamReceiver::CStreamReceiver()
+    : m_decoder(STREAM_E131_FIRST_UNIVERSE, STREAM_ARTNET_FIRST_UNIVERSE)
+{
+    for (auto & sock : m_sockets) {
+        sock = -1;
+    }
+    m_joined_universes = 0;
+    m_last_packet_ms = 0;
+    m_streaming = false;
+    m_frames_rejected = 0;
+    m_task_handle = nullptr;
+    m_task_keepalive = true;
+}
+
+CStreamReceiver::~CStreamReceiver()
+{
+    m_task_keepalive = false;
+    close_sockets();
+}
+
+CStreamReceiver* CStreamReceiver::Instance()
+{
+    if (!_instance) {
+        _instance = new CStreamReceiver();
+    }
+
+    return _instance;
+}
+
+bool CStreamReceiver::start()
+{
+    if (m_task_handle) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < WS2812_STREAM_PROTOCOL_COUNT; i++) {
+        m_sockets[i] = open_socket(stream_ports[i]);
+        if (m_sockets[i] < 0) {
+            close_sockets();
+            return false;
+        }
+    }
+    sync_geometry();
+
+    xTaskCreate(func_receive, "TASK_STREAM_RECV", 4096, this, TASK_PRIORITY_STREAM, &m_task_handle);
+    GetLogger(eLogType::Info)->Log("Pixel stream receiver started (ddp: %d, e1.31: %d, art-net: %d)",
+        STREAM_DDP_PORT, STREAM_E131_PORT, STREAM_ARTNET_PORT);
+
+    return true;
+}
+
+int CStreamReceiver::open_socket(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        GetLogger(eLogType::Error)->Log("Failed to create udp socket (errno: %d)", errno);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        GetLogger(eLogType::Error)->Log("Failed to bind udp port %d (errno: %d)", port, errno);
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+void CStreamReceiver::close_sockets()
+{
+    for (auto & sock : m_sockets) {
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    m_joined_universes = 0;
+}
+
+bool CStreamReceiver::sync_geometry()
+{
+    size_t pixel_cnt = GetWS2812Ctrl()->get_pixel_count();
+    if (pixel_cnt == m_decoder.get_pixel_count()) {
+        return true;
+    }
+
+    if (!m_decoder.resize(pixel_cnt)) {
+        GetLogger(eLogType::Error)->Log("too many pixels for stream (%d)", pixel_cnt);
+        return false;
+    }
+    join_universes((uint8_t)((pixel_cnt + WS2812_STREAM_DMX_PIXELS - 1) / WS2812_STREAM_DMX_PIXELS));
+
+    return true;
+}
+
+void CStreamReceiver::join_universes(uint8_t universe_cnt)
+{
+    // sACN multicast address 239.255.{universe hi}.{universe lo}, groups are kept when the strip shrinks
+    for (uint8_t i = m_joined_universes; i < universe_cnt; i++) {
+        uint16_t universe = STREAM_E131_FIRST_UNIVERSE + i;
+        struct ip_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_multiaddr.s_addr = htonl(0xEFFF0000UL | universe);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(m_sockets[WS2812_STREAM_E131], IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            GetLogger(eLogType::Warning)->Log("Failed to join multicast group of universe %d (errno: %d)", universe, errno);
+            break;
+        }
+        m_joined_universes = i + 1;
+    }
+}
+
+void CStreamReceiver::present_frame()
+{
+    size_t pixel_cnt = m_decoder.get_pixel_count();
+    if (pixel_cnt != GetWS2812Ctrl()->get_pixel_count()) {
+        m_frames_rejected++;
+        return;
+    }
+
+    RGB *pixels = GetWS2812Ctrl()->begin_frame_write(0, (uint16_t)pixel_cnt);
+    if (!pixels) {
+        m_frames_rejected++;
+        return;
+    }
+    memcpy(pixels, m_decoder.get_frame(), pixel_cnt * sizeof(RGB));
+    GetWS2812Ctrl()->end_frame_write(true);
+}
+
+void CStreamReceiver::get_stats(WS2812StreamStats *stats)
+{
+    // counters are only written by the receiver task
+    m_decoder.get_stats(stats);
+    stats->frames_rejected = m_frames_rejected;
+}
+
+bool CStreamReceiver::is_streaming()
+{
+    return m_streaming;
+}
+
+void CStreamReceiver::func_receive(void *param)
+{
+    CStreamReceiver *obj = static_cast<CStreamReceiver *>(param);
+
+    GetLogger(eLogType::Info)->Log("Realtime Task for Pixel Stream Started");
+    while (obj->m_task_keepalive) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        int max_fd = -1;
+        for (auto sock : obj->m_sockets) {
+            FD_SET(sock, &read_fds);
+            if (sock > max_fd)
+                max_fd = sock;
+        }
+
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ret = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+        uint32_t now_ms = get_time_ms();
+        if (obj->m_streaming && now_ms - obj->m_last_packet_ms > STREAM_TIMEOUT_MS) {
+            // the sender stopped (or restarted), do not compare new sequence numbers with old ones
+            GetLogger(eLogType::Info)->Log("pixel stream timeout");
+            obj->m_decoder.reset();
+            obj->m_streaming = false;
+        }
+        if (ret <= 0) {
+            // geometry may have changed while idle (multicast groups)
+            obj->sync_geometry();
+            continue;
+        }
+
+        for (uint8_t i = 0; i < WS2812_STREAM_PROTOCOL_COUNT; i++) {
+            if (!FD_ISSET(obj->m_sockets[i], &read_fds))
+                continue;
+            int len = recvfrom(obj->m_sockets[i], obj->m_packet, sizeof(obj->m_packet), 0, nullptr, nullptr);
+            if (len <= 0)
+                continue;
+
+            if (!obj->m_streaming) {
+                GetLogger(eLogType::Info)->Log("pixel stream started (port %d)", stream_ports[i]);
+                obj->m_streaming = true;
+            }
+            obj->m_last_packet_ms = now_ms;
+            if (!obj->sync_geometry()) {
+                continue;
+            }
+            if (obj->m_decoder.feed(i, obj->m_packet, (size_t)len)) {
+                obj->present_frame();
+            }
+        }
+    }
+
+    vTaskDelete(nullptr);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file web_image.cpp
+ * @author yogyui
+ * @brief packed web asset image lookup (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "web_image.h"
+#include <string.h>
+#include <stdio.h>
+
+CWebImage::CWebImage()
+{
+    m_base = nullptr;
+    m_size = 0;
+    m_entries = nullptr;
+    m_entry_cnt = 0;
+}
+
+bool CWebImage::attach(const void *base, size_t size)
+{
+    m_base = nullptr;
+    if (!base || size < sizeof(WebImageHeader)) {
+        return false;
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(base);
+    const WebImageHeader *header = reinterpret_cast<const WebImageHeader *>(bytes);
+    if (header->magic != WEB_IMAGE_MAGIC || header->version != WEB_IMAGE_VERSION || header->image_size > size ||
+        sizeof(WebImageHeader) + (size_t)header->entry_cnt * sizeof(WebImageEntry) > header->image_size) {
+        return false;
+    }
+
+    m_base = bytes;
+    m_size = header->image_size;
+    m_entries = reinterpret_cast<const WebImageEntry *>(bytes + sizeof(WebImageHeader));
+    m_entry_cnt = header->entry_cnt;
+
+    // offsets are checked once, lookups trust the index afterwards
+    for (uint16_t i = 0; i < m_entry_cnt; i++) {
+        if (!validate_entry(&m_entries[i]) ||
+            (i > 0 && strcmp(get_string(m_entries[i - 1].path_offset), get_string(m_entries[i].path_offset)) >= 0)) {
+            m_base = nullptr;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CWebImage::validate_entry(const WebImageEntry *entry) const
+{
+    if (entry->path_offset >= m_size || entry->mime_offset >= m_size ||
+        memchr(m_base + entry->path_offset, 0, m_size - entry->path_offset) == nullptr ||
+        memchr(m_base + entry->mime_offset, 0, m_size - entry->mime_offset) == nullptr) {
+        return false;
+    }
+    if (entry->data_offset > m_size || entry->data_length > m_size - entry->data_offset) {
+        return false;
+    }
+    if (entry->gzip_length && (entry->gzip_offset > m_size || entry->gzip_length > m_size - entry->gzip_offset)) {
+        return false;
+    }
+    return true;
+}
+
+const WebImageEntry* CWebImage::find(const char *path, size_t path_len) const
+{
+    if (!m_base) {
+        return nullptr;
+    }
+
+    int lo = 0, hi = (int)m_entry_cnt - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const char *entry_path = get_string(m_entries[mid].path_offset);
+        int cmp = strncmp(entry_path, path, path_len);
+        if (cmp == 0 && entry_path[path_len] != '\0') {
+            cmp = 1;    // entry path is longer
+        }
+        if (cmp == 0) {
+            return &m_entries[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return nullptr;
+}
+
+void web_image_format_etag(const WebImageEntry *entry, bool gzip, char *buffer, size_t buffer_len)
+{
+    char hex[WEB_IMAGE_ETAG_LEN * 2 + 1];
+    for (int i = 0; i < WEB_IMAGE_ETAG_LEN; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", entry->etag[i]);
+    }
+    snprintf(buffer, buffer_len, gzip ? "\"%s-gz\"" : "\"%s\"", hex);
+}
@@ -11,26 +11,202 @@
 #include "logger.h"
 #include "definition.h"
 #include <fcntl.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include "lwip/sockets.h"
 #include "esp_system.h"
 #include "esp_spiffs.h"
 #include "esp_vfs.h"
+#include "esp_timer.h"
 #include "cJSON.h"
+#include "json_reader.h"
 #include "ws2812.h"
 #include "dpotctrl.h"
+#include "stream_receiver.h"
+#include "memory.h"
+#include "scene_store.h"
+#include "boot_timeline.h"
 
-#define FILE_PATH_MAX                       ESP_VFS_PATH_MAX + 128
-#define SCRATCH_BUFSIZE                     10240
 #define CHECK_FILE_EXTENSION(filename, ext) (strcasecmp(&filename[strlen(filename) - strlen(ext)], ext) == 0)
 #define SPIFFS_BASE_PATH                    "/spiffs"
 #define PARTITION_LABEL                     "web"
+#define ASSET_MANIFEST_PATH                 SPIFFS_BASE_PATH "/asset-manifest.txt"
+#define CACHE_CONTROL_IMMUTABLE             "public, max-age=31536000, immutable"
+#define CACHE_CONTROL_REVALIDATE            "no-cache"
+
+#define HTTPD_413                           "413 Payload Too Large"
 
-static char buffer[SCRATCH_BUFSIZE]{};
 CWebServer* CWebServer::_instance = nullptr;
 
+/**
+ * request bodies of the json api (parsed with json_reader, no cJSON tree)
+ */
+typedef struct st_dpot_config_request
+{
+    uint8_t raw_value;
+} DpotConfigRequest;
+
+static const JsonField dpot_config_fields[] = {
+    JSON_FIELD("raw_value", JSON_UINT8, DpotConfigRequest, raw_value),
+};
+static const JsonSchema dpot_config_schema = JSON_SCHEMA(dpot_config_fields, 0x01);
+
+static const JsonField pixel_range_fields[] = {
+    JSON_FIELD("offset", JSON_UINT16, WS2812PixelRange, offset),
+    JSON_FIELD("length", JSON_UINT16, WS2812PixelRange, length),
+    JSON_FIELD_ARRAY("rgb", WS2812PixelRange, rgb, 3),
+};
+static const JsonSchema pixel_range_schema = JSON_SCHEMA(pixel_range_fields, 0x07);
+
+typedef struct st_config_request
+{
+    uint8_t brightness;
+    uint8_t rgb[3];
+    uint8_t strip;
+    uint32_t fade;
+    bool enqueue;
+    uint8_t effect;
+    uint8_t speed;
+    uint8_t size;
+    uint8_t effect_rgb[3];
+    uint8_t range_cnt;
+    WS2812PixelRange ranges[WS2812_UPDATE_MAX_RANGES];
+} ConfigRequest;
+
+static const JsonField config_fields[] = {
+    JSON_FIELD("brightness", JSON_UINT8, ConfigRequest, brightness),
+    JSON_FIELD_ARRAY("rgb", ConfigRequest, rgb, 3),
+    JSON_FIELD("strip", JSON_UINT8, ConfigRequest, strip),
+    JSON_FIELD("fade", JSON_UINT32, ConfigRequest, fade),
+    JSON_FIELD("queue", JSON_BOOL, ConfigRequest, enqueue),
+    JSON_FIELD_ENUM("effect", ConfigRequest, effect, ws2812_effect_from_name),
+    JSON_FIELD("speed", JSON_UINT8, ConfigRequest, speed),
+    JSON_FIELD("size", JSON_UINT8, ConfigRequest, size),
+    JSON_FIELD_ARRAY("effect_rgb", ConfigRequest, effect_rgb, 3),
+    JSON_FIELD_OBJECTS("ranges", ConfigRequest, ranges, WS2812_UPDATE_MAX_RANGES, range_cnt, pixel_range_schema),
+};
+static const JsonSchema config_schema = JSON_SCHEMA(config_fields, 0);
+#define CONFIG_FIELD_BRIGHTNESS     (1UL << 0)
+#define CONFIG_FIELD_RGB            (1UL << 1)
+#define CONFIG_FIELD_EFFECT         (1UL << 5)
+#define CONFIG_FIELD_SPEED          (1UL << 6)
+#define CONFIG_FIELD_SIZE           (1UL << 7)
+#define CONFIG_FIELD_EFFECT_RGB     (1UL << 8)
+#define CONFIG_FIELD_RANGES         (1UL << 9)
+
+typedef struct st_blink_request
+{
+    uint32_t duration;
+    uint32_t count;
+    bool demo;
+    bool enqueue;
+} BlinkRequest;
+
+static const JsonField blink_fields[] = {
+    JSON_FIELD("duration", JSON_UINT32, BlinkRequest, duration),
+    JSON_FIELD("count", JSON_UINT32, BlinkRequest, count),
+    JSON_FIELD("demo", JSON_BOOL, BlinkRequest, demo),
+    JSON_FIELD("queue", JSON_BOOL, BlinkRequest, enqueue),
+};
+static const JsonSchema blink_schema = JSON_SCHEMA(blink_fields, 0);
+
+typedef struct st_effect_request
+{
+    uint8_t effect;
+    uint8_t speed;
+    uint8_t size;
+    uint8_t rgb[3];
+    uint8_t strip;
+} EffectRequest;
+
+static const JsonField effect_fields[] = {
+    JSON_FIELD_ENUM("effect", EffectRequest, effect, ws2812_effect_from_name),
+    JSON_FIELD("speed", JSON_UINT8, EffectRequest, speed),
+    JSON_FIELD("size", JSON_UINT8, EffectRequest, size),
+    JSON_FIELD_ARRAY("rgb", EffectRequest, rgb, 3),
+    JSON_FIELD("strip", JSON_UINT8, EffectRequest, strip),
+};
+static const JsonSchema effect_schema = JSON_SCHEMA(effect_fields, 0);
+#define EFFECT_FIELD_EFFECT         (1UL << 0)
+#define EFFECT_FIELD_SPEED          (1UL << 1)
+#define EFFECT_FIELD_SIZE           (1UL << 2)
+#define EFFECT_FIELD_RGB            (1UL << 3)
+
+static const JsonField calibration_fields[] = {
+    JSON_FIELD("gamma", JSON_FIXED100, WS2812Calibration, gamma_x100),
+    JSON_FIELD_ARRAY("white_balance", WS2812Calibration, white_balance, 3),
+    JSON_FIELD("dither", JSON_BOOL, WS2812Calibration, dither),
+};
+static const JsonSchema calibration_schema = JSON_SCHEMA(calibration_fields, 0);
+
+static const JsonField strip_config_fields[] = {
+    JSON_FIELD("gpio", JSON_UINT8, WS2812StripConfig, gpio_pin_no),
+    JSON_FIELD("pixels", JSON_UINT16, WS2812StripConfig, pixel_cnt),
+    JSON_FIELD_ENUM("order", WS2812StripConfig, color_order, ws2812_color_order_from_name),
+};
+static const JsonSchema strip_config_schema = JSON_SCHEMA(strip_config_fields, 0x03);   // gpio, pixels
+
+static const JsonField geometry_fields[] = {
+    JSON_FIELD("pwm_pin", JSON_UINT8, WS2812Geometry, pwm_pin_no),
+    JSON_FIELD_OBJECTS("strips", WS2812Geometry, strips, WS2812_MAX_STRIPS, strip_cnt, strip_config_schema),
+};
+static const JsonSchema geometry_schema = JSON_SCHEMA(geometry_fields, 0);
+
+enum {
+    SCENE_ACTION_SAVE = 0,
+    SCENE_ACTION_RECALL,
+    SCENE_ACTION_DELETE,
+};
+
+static int scene_action_from_name(const char *name)
+{
+    static const char *names[] = {"save", "recall", "delete"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (!strcmp(name, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+typedef struct st_scene_request
+{
+    uint8_t id;
+    uint8_t action;
+    char name[WS2812_SCENE_NAME_LEN];
+    uint32_t fade;
+} SceneRequest;
+
+static const JsonField scene_fields[] = {
+    JSON_FIELD("id", JSON_UINT8, SceneRequest, id),
+    JSON_FIELD_ENUM("action", SceneRequest, action, scene_action_from_name),
+    JSON_FIELD_STRING("name", SceneRequest, name),
+    JSON_FIELD("fade", JSON_UINT32, SceneRequest, fade),
+};
+static const JsonSchema scene_schema = JSON_SCHEMA(scene_fields, 0x03);    // id, action
+
 CWebServer::CWebServer()
 {
     m_handle = nullptr;
-    init_spiffs();
+    m_ws_push_queued = false;
+    memset(&m_ws_stats, 0, sizeof(m_ws_stats));
+    m_image_handle = 0;
+    m_buffer_pool = nullptr;
+    m_queue_file_jobs = nullptr;
+    m_file_lock = portMUX_INITIALIZER_UNLOCKED;
+    m_boot_id = esp_random();
+    m_dpot_state.version = 0;
+    m_dpot_state.length = 0;
+    m_ws2812_state.version = 0;
+    m_ws2812_state.length = 0;
+    for (auto & slot : m_file_sockets) {
+        slot.sockfd = -1;
+        slot.close_pending = false;
+    }
+    if (!map_web_image()) {
+        init_spiffs();
+    }
 }
 
 CWebServer::~CWebServer()
@@ -46,6 +222,43 @@ CWebServer* CWebServer::Instance()
     return _instance;
 }
 
+bool CWebServer::map_web_image()
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (!partition) {
+        GetLogger(eLogType::Error)->Log("Failed to find web partition");
+        return false;
+    }
+
+    WebImageHeader header;
+    esp_err_t result = esp_partition_read(partition, 0, &header, sizeof(header));
+    if (result != ESP_OK || header.magic != WEB_IMAGE_MAGIC) {
+        // spiffs image (build_spiffs_web_partition.sh)
+        return false;
+    }
+    if (header.image_size > partition->size) {
+        GetLogger(eLogType::Error)->Log("web image is larger than partition (%d > %d)", header.image_size, partition->size);
+        return false;
+    }
+
+    // files are sent straight from flash (no file system, no copy)
+    const void *base = nullptr;
+    result = esp_partition_mmap(partition, 0, header.image_size, SPI_FLASH_MMAP_DATA, &base, &m_image_handle);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to map web image (%s)", esp_err_to_name(result));
+        return false;
+    }
+    if (!m_image.attach(base, header.image_size)) {
+        GetLogger(eLogType::Error)->Log("invalid web image");
+        spi_flash_munmap(m_image_handle);
+        m_image_handle = 0;
+        return false;
+    }
+
+    GetLogger(eLogType::Info)->Log("mapped web image (%d files, %d bytes)", m_image.get_entry_count(), header.image_size);
+    return true;
+}
+
 void CWebServer::init_spiffs()
 {
     esp_vfs_spiffs_conf_t conf;
@@ -75,6 +288,50 @@ void CWebServer::init_spiffs()
     }
 
     GetLogger(eLogType::Info)->Log("initialized SPIFFS");
+    load_asset_manifest();
+}
+
+void CWebServer::load_asset_manifest()
+{
+    // one line per file: <path> <content hash> <gzip variant 0/1> <hashed file name 0/1>
+    FILE *fp = fopen(ASSET_MANIFEST_PATH, "r");
+    if (!fp) {
+        GetLogger(eLogType::Warning)->Log("asset manifest not found, files are served without cache headers");
+        return;
+    }
+
+    char line[160];
+    char path[128], hash[40];
+    int gzip, immutable;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%127s %39s %d %d", path, hash, &gzip, &immutable) != 4) {
+            continue;
+        }
+        WebAsset asset;
+        asset.path = path;
+        asset.etag = std::string("\"") + hash + "\"";
+        asset.etag_gzip = std::string("\"") + hash + "-gz\"";
+        asset.gzip = gzip != 0;
+        asset.immutable = immutable != 0;
+        m_assets.push_back(asset);
+    }
+    fclose(fp);
+
+    std::sort(m_assets.begin(), m_assets.end(), [](const WebAsset &a, const WebAsset &b) {
+        return a.path < b.path;
+    });
+    GetLogger(eLogType::Info)->Log("loaded asset manifest (%d files)", m_assets.size());
+}
+
+const WebAsset* CWebServer::find_asset(const std::string &path)
+{
+    auto it = std::lower_bound(m_assets.begin(), m_assets.end(), path, [](const WebAsset &a, const std::string &p) {
+        return a.path < p;
+    });
+    if (it == m_assets.end() || it->path != path) {
+        return nullptr;
+    }
+    return &(*it);
 }
 
 bool CWebServer::start()
@@ -84,6 +341,10 @@ bool CWebServer::start()
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = WEB_SERVER_PORT;
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = WEB_SERVER_MAX_URI;
+    // sockets handed over to the file workers are no longer sessions, but still lwip sockets
+    config.max_open_sockets = WEB_SERVER_MAX_SOCKETS - WEB_SERVER_FILE_SOCKETS;
+    config.close_fn = CWebServer::on_session_close;
 
     GetLogger(eLogType::Info)->Log("Starting HTTP Server (port %d)", config.server_port);
     esp_err_t result = httpd_start(&m_handle, &config);
@@ -96,14 +357,48 @@ bool CWebServer::start()
     register_uri_handler_get_dpot_state();
     register_uri_handler_post_dpot_config();
     register_uri_handler_get_ws2812_state();
+    register_uri_handler_get_ws2812_stats();
     register_uri_handler_post_ws2812_config();
     register_uri_handler_post_ws2812_blink();
+    register_uri_handler_get_ws2812_effect();
+    register_uri_handler_post_ws2812_effect();
+    register_uri_handler_get_ws2812_calibration();
+    register_uri_handler_post_ws2812_calibration();
+    register_uri_handler_get_ws2812_geometry();
+    register_uri_handler_post_ws2812_geometry();
+    register_uri_handler_get_ws2812_frame();
+    register_uri_handler_post_ws2812_frame();
+    register_uri_handler_get_ws2812_scenes();
+    register_uri_handler_post_ws2812_scene();
+    register_uri_handler_get_system_boot();
+    register_uri_handler_ws2812_ws();
     register_uri_handler_get_common();
+    start_file_workers();
+
+    // state changes from any source (http, websocket, boot) are pushed to websocket clients
+    GetWS2812Ctrl()->set_state_listener(CWebServer::on_ws2812_state_changed, this);
     
     GetLogger(eLogType::Info)->Log("Started");
     return true;
 }
 
+void CWebServer::start_file_workers()
+{
+    if (!m_buffer_pool) {
+        m_buffer_pool = new CBufferPool(WEB_SERVER_BUFFER_SIZE, WEB_SERVER_BUFFER_COUNT);
+    }
+    if (m_queue_file_jobs || WEB_SERVER_FILE_WORKERS == 0) {
+        return;
+    }
+
+    m_queue_file_jobs = xQueueCreate(WEB_SERVER_FILE_QUEUE, sizeof(WebFileJob));
+    for (int i = 0; i < WEB_SERVER_FILE_WORKERS; i++) {
+        char name[24];
+        snprintf(name, sizeof(name), "TASK_WEB_FILE_%d", i);
+        xTaskCreate(func_file_worker, name, 4096, this, TASK_PRIORITY_WEB_WORKER, nullptr);
+    }
+}
+
 bool CWebServer::stop()
 {
     if (m_handle) {
@@ -120,6 +415,80 @@ bool CWebServer::stop()
     return true;
 }
 
+static bool request_header_contains(httpd_req_t *req, const char *field, const char *token)
+{
+    size_t len = httpd_req_get_hdr_value_len(req, field);
+    if (len == 0 || len > 256) {
+        return false;
+    }
+    char value[257]{};
+    if (httpd_req_get_hdr_value_str(req, field, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strstr(value, token) != nullptr;
+}
+
+esp_err_t CWebServer::send_state(httpd_req_t *req, WebStateCache *cache, uint32_t version, WebStateFormatter formatter)
+{
+    boot_timeline_mark(BOOT_PHASE_HTTP_RESPONSE);
+    // version is read before formatting, a change in between only causes one extra regeneration
+    if (cache->version != version) {
+        cache->length = formatter(cache->body, sizeof(cache->body));
+        if (cache->length == 0) {
+            cache->version = 0;
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "State response too large");
+            return ESP_FAIL;
+        }
+        cache->version = version;
+        snprintf(cache->etag, sizeof(cache->etag), "\"%08x-%u\"", m_boot_id, version);
+    }
+
+    httpd_resp_set_hdr(req, "ETag", cache->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", CACHE_CONTROL_REVALIDATE);
+    if (request_header_contains(req, "If-None-Match", cache->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, cache->body, cache->length);
+}
+
+bool CWebServer::recv_json_body(httpd_req_t *req, const JsonSchema *schema, void *target, uint32_t *present, esp_err_t *result)
+{
+    // bounded body in a fixed buffer (handlers run in the httpd task one at a time)
+    if (req->content_len > sizeof(m_request_body)) {
+        GetLogger(eLogType::Error)->Log("request body too large (%d)", req->content_len);
+        httpd_resp_set_status(req, HTTPD_413);
+        httpd_resp_send(req, "NG", 3);
+        *result = ESP_FAIL;     // body is not consumed, close the session
+        return false;
+    }
+
+    size_t offset = 0;
+    int ret;
+    while (offset < req->content_len) {
+        ret = httpd_req_recv(req, m_request_body + offset, req->content_len - offset);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            *result = ESP_FAIL;
+            return false;
+        }
+        offset += ret;
+    }
+
+    if (!json_read_object(m_request_body, offset, schema, target, present)) {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+        *result = ESP_OK;
+        return false;
+    }
+
+    return true;
+}
+
 bool CWebServer::register_uri_handler_get_common()
 {
     httpd_uri_t conf;
@@ -144,70 +513,284 @@ bool CWebServer::register_uri_handler_get_common()
 
 esp_err_t CWebServer::uri_handler_get_common(httpd_req_t *req)
 {
-    char filepath[FILE_PATH_MAX]{};
+    CWebServer *server = GetWebServer();
+    boot_timeline_mark(BOOT_PHASE_HTTP_RESPONSE);
+    WebFileJob job{};
     char message[256]{};
-    snprintf(filepath, sizeof(filepath), SPIFFS_BASE_PATH);   // base-path
+    job.sockfd = httpd_req_to_sockfd(req);
+    snprintf(job.file_path, sizeof(job.file_path), SPIFFS_BASE_PATH);   // base-path
 
-    // set file path from uri 
+    // set file path from uri (query string is not part of the file name)
     // vue router path will not add trailing slash!
     std::string uri_str = std::string(req->uri);
+    uri_str = uri_str.substr(0, uri_str.find('?'));
     std::string extension = uri_str.substr(uri_str.find_last_of(".") + 1);
     if (extension.at(0) == '/') {
-        strlcat(filepath, "/index.html", sizeof(filepath));
-    } else {
-        strlcat(filepath, req->uri, sizeof(filepath));
+        uri_str = "/index.html";
     }
-
-    // open file
-    int fd = open(filepath, O_RDONLY, 0);
-    if (fd == -1) {
-        snprintf(message, sizeof(message), "Failed to read existing file (%s)", filepath);
+    strlcat(job.file_path, uri_str.c_str(), sizeof(job.file_path));
+
+    bool accept_gzip = request_header_contains(req, "Accept-Encoding", "gzip");
+    if (server->m_image.is_attached()) {
+        const WebImageEntry *entry = server->m_image.find(uri_str.c_str(), uri_str.length());
+        if (!entry) {
+            snprintf(message, sizeof(message), "File not found (%s)", uri_str.c_str());
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, message);
+            return ESP_FAIL;
+        }
+        prepare_image_job(&server->m_image, entry, accept_gzip, &job);
+    } else if (!prepare_spiffs_job(server->find_asset(uri_str), accept_gzip, &job)) {
+        snprintf(message, sizeof(message), "Failed to read existing file (%s)", job.file_path);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, message);
         return ESP_FAIL;
     }
 
-    // set http type
-    const char *type = "text/plain";
+    // conditional request
+    if (job.etag[0] && request_header_contains(req, "If-None-Match", job.etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_set_hdr(req, "ETag", job.etag);
+        httpd_resp_set_hdr(req, "Cache-Control", job.cache_control);
+        if (job.vary) {
+            httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+        }
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    // body is sent by a worker task, the httpd task keeps answering api calls meanwhile
+    // the connection is handed over: httpd drops the session (its control messages are handled before
+    // the sessions in the next loop, so no further request is read from this socket) and the worker
+    // is the only writer until it closes the socket after the body
+    job.close = true;
+    if (server->post_file_job(job)) {
+        if (httpd_sess_trigger_close(req->handle, job.sockfd) != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to hand over socket %d", job.sockfd);
+        }
+        return ESP_OK;
+    }
+    job.close = false;
+
+    // all workers busy (or none configured): send in the httpd task
+    char *buffer = server->m_buffer_pool ? server->m_buffer_pool->acquire(pdMS_TO_TICKS(WEB_SERVER_BUFFER_WAIT_MS)) : nullptr;
+    if (!buffer) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server busy");
+        return ESP_FAIL;
+    }
+    bool result = send_file_job(job, buffer, server->m_buffer_pool->get_block_size());
+    server->m_buffer_pool->release(buffer);
+
+    return result ? ESP_OK : ESP_FAIL;
+}
+
+void CWebServer::prepare_image_job(const CWebImage *image, const WebImageEntry *entry, bool accept_gzip, WebFileJob *job)
+{
+    job->gzip = entry->gzip_length > 0 && accept_gzip;
+    job->vary = entry->gzip_length > 0;
+    job->content_type = image->get_string(entry->mime_offset);
+    job->cache_control = (entry->flags & WEB_IMAGE_FLAG_IMMUTABLE) ? CACHE_CONTROL_IMMUTABLE : CACHE_CONTROL_REVALIDATE;
+    web_image_format_etag(entry, job->gzip, job->etag, sizeof(job->etag));
+    // files are sent straight from mapped flash
+    if (job->gzip) {
+        job->data = image->get_data(entry->gzip_offset);
+        job->length = entry->gzip_length;
+    } else {
+        job->data = image->get_data(entry->data_offset);
+        job->length = entry->data_length;
+    }
+}
+
+bool CWebServer::prepare_spiffs_job(const WebAsset *asset, bool accept_gzip, WebFileJob *job)
+{
+    const char *filepath = job->file_path;
+    job->content_type = "text/plain";
     if (CHECK_FILE_EXTENSION(filepath, ".html")) {
-        type = "text/html";
+        job->content_type = "text/html";
     } else if (CHECK_FILE_EXTENSION(filepath, ".js")) {
-        type = "application/javascript";
+        job->content_type = "application/javascript";
     } else if (CHECK_FILE_EXTENSION(filepath, ".css")) {
-        type = "text/css";
+        job->content_type = "text/css";
     } else if (CHECK_FILE_EXTENSION(filepath, ".png")) {
-        type = "image/png";
+        job->content_type = "image/png";
     } else if (CHECK_FILE_EXTENSION(filepath, ".ico")) {
-        type = "image/x-icon";
+        job->content_type = "image/x-icon";
     } else if (CHECK_FILE_EXTENSION(filepath, ".svg")) {
-        type = "text/xml";
+        job->content_type = "text/xml";
     }
-    httpd_resp_set_type(req, type);
 
-    // read file
-    ssize_t read_bytes;
-    while (true) {
-        read_bytes = read(fd, buffer, SCRATCH_BUFSIZE);
-        if (read_bytes == -1) {
-            GetLogger(eLogType::Error)->Log("Failed to read file (%s)", filepath);
+    struct stat st;
+    if (asset && asset->gzip && accept_gzip) {
+        size_t path_len = strlen(job->file_path);
+        strlcat(job->file_path, ".gz", sizeof(job->file_path));
+        if (stat(job->file_path, &st) == 0) {
+            job->gzip = true;
+        } else {
+            job->file_path[path_len] = '\0';
+        }
+    }
+    if (!job->gzip && stat(job->file_path, &st) != 0) {
+        return false;
+    }
+    job->length = st.st_size;
+    job->data = nullptr;
+
+    if (asset) {
+        strlcpy(job->etag, job->gzip ? asset->etag_gzip.c_str() : asset->etag.c_str(), sizeof(job->etag));
+        job->cache_control = asset->immutable ? CACHE_CONTROL_IMMUTABLE : CACHE_CONTROL_REVALIDATE;
+        job->vary = asset->gzip;
+    }
+    return true;
+}
+
+static bool send_all(int sockfd, const char *data, size_t len)
+{
+    while (len > 0) {
+        int sent = send(sockfd, data, len, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+bool CWebServer::send_file_job(const WebFileJob &job, char *buffer, size_t buffer_size)
+{
+    // the response is written to the socket directly (httpd is not involved after the handler returned)
+    int len = snprintf(buffer, buffer_size, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\n", 
+        job.content_type, (unsigned)job.length);
+    if (job.etag[0]) {
+        len += snprintf(buffer + len, buffer_size - len, "ETag: %s\r\nCache-Control: %s\r\n", job.etag, job.cache_control);
+    }
+    if (job.vary) {
+        len += snprintf(buffer + len, buffer_size - len, "Vary: Accept-Encoding\r\n");
+    }
+    if (job.gzip) {
+        len += snprintf(buffer + len, buffer_size - len, "Content-Encoding: gzip\r\n");
+    }
+    if (job.close) {
+        len += snprintf(buffer + len, buffer_size - len, "Connection: close\r\n");
+    }
+    len += snprintf(buffer + len, buffer_size - len, "\r\n");
+
+    // first piece of the body goes out with the headers
+    if (job.data) {
+        size_t piece = std::min(job.length, buffer_size - len);
+        memcpy(buffer + len, job.data, piece);
+        return send_all(job.sockfd, buffer, len + piece) &&
+            send_all(job.sockfd, reinterpret_cast<const char *>(job.data) + piece, job.length - piece);
+    }
+
+    int fd = open(job.file_path, O_RDONLY, 0);
+    if (fd == -1) {
+        GetLogger(eLogType::Error)->Log("Failed to open file (%s)", job.file_path);
+        return false;
+    }
+    size_t remain = job.length;
+    bool result = true;
+    while (remain > 0) {
+        ssize_t read_bytes = read(fd, buffer + len, std::min(remain, buffer_size - len));
+        if (read_bytes <= 0) {
+            // length was announced, the connection has to be closed
+            GetLogger(eLogType::Error)->Log("Failed to read file (%s)", job.file_path);
+            result = false;
             break;
-        } else if (read_bytes == 0) {
+        }
+        if (!send_all(job.sockfd, buffer, len + read_bytes)) {
+            result = false;
             break;
-        } else if (read_bytes > 0) {
-            // send buffer
-            if (httpd_resp_send_chunk(req, buffer, read_bytes) != ESP_OK) {
-                close(fd);
-                GetLogger(eLogType::Error)->Log("Failed to send buffer");
-                httpd_resp_sendstr_chunk(req, nullptr); // abort sending file
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-                return ESP_FAIL;
-            }
         }
+        remain -= read_bytes;
+        len = 0;
     }
     close(fd);
-    // response empty chunk (reason: response completion)
-    httpd_resp_send_chunk(req, NULL, 0);
 
-    return ESP_OK;
+    return result;
+}
+
+bool CWebServer::post_file_job(const WebFileJob &job)
+{
+    if (!m_queue_file_jobs) {
+        return false;
+    }
+
+    // the socket must not be closed (and its number reused) while a worker writes to it,
+    // at most WEB_SERVER_FILE_SOCKETS are handed over (the others are sent inline)
+    bool claimed = false;
+    portENTER_CRITICAL(&m_file_lock);
+    for (auto & slot : m_file_sockets) {
+        if (slot.sockfd == -1) {
+            slot.sockfd = job.sockfd;
+            slot.close_pending = false;
+            claimed = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&m_file_lock);
+    if (!claimed) {
+        return false;
+    }
+
+    if (xQueueSend(m_queue_file_jobs, &job, 0) != pdTRUE) {
+        release_file_socket(job.sockfd);
+        return false;
+    }
+    return true;
+}
+
+void CWebServer::release_file_socket(int sockfd)
+{
+    bool close_pending = false;
+    portENTER_CRITICAL(&m_file_lock);
+    for (auto & slot : m_file_sockets) {
+        if (slot.sockfd == sockfd) {
+            close_pending = slot.close_pending;
+            slot.sockfd = -1;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&m_file_lock);
+
+    if (close_pending) {
+        close(sockfd);
+    }
+}
+
+void CWebServer::on_session_close(httpd_handle_t hd, int sockfd)
+{
+    CWebServer *server = GetWebServer();
+    bool busy = false;
+    portENTER_CRITICAL(&server->m_file_lock);
+    for (auto & slot : server->m_file_sockets) {
+        if (slot.sockfd == sockfd) {
+            // closed by the worker when the response is done
+            slot.close_pending = true;
+            busy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&server->m_file_lock);
+
+    if (!busy) {
+        close(sockfd);
+    }
+}
+
+void CWebServer::func_file_worker(void *param)
+{
+    CWebServer *server = static_cast<CWebServer *>(param);
+    WebFileJob job;
+
+    while (true) {
+        if (xQueueReceive(server->m_queue_file_jobs, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        char *buffer = server->m_buffer_pool->acquire();
+        // an incomplete body is ended by the close (shorter than the announced length)
+        send_file_job(job, buffer, server->m_buffer_pool->get_block_size());
+        server->m_buffer_pool->release(buffer);
+        // closed here if httpd has dropped the session already, otherwise by on_session_close
+        server->release_file_socket(job.sockfd);
+    }
 }
 
 bool CWebServer::register_uri_handler_get_dpot_state()
@@ -234,18 +817,14 @@ bool CWebServer::register_uri_handler_get_dpot_state()
 
 esp_err_t CWebServer::uri_handler_get_dpot_state(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-
-    cJSON *root = cJSON_CreateObject();
-    if (root) {
-        cJSON_AddNumberToObject(root, "raw_value", GetDPotCtrl()->get_raw_value());
-        const char *info = cJSON_Print(root);
-        httpd_resp_sendstr(req, info);
-        free((void *)info);
-        cJSON_Delete(root);
-    }
+    CWebServer *server = GetWebServer();
+    return server->send_state(req, &server->m_dpot_state, GetDPotCtrl()->get_state_version(), format_dpot_state);
+}
 
-    return ESP_OK;
+size_t CWebServer::format_dpot_state(char *buffer, size_t buffer_size)
+{
+    int len = snprintf(buffer, buffer_size, "{\"raw_value\":%u}", GetDPotCtrl()->get_raw_value());
+    return (len < 0 || (size_t)len >= buffer_size) ? 0 : (size_t)len;
 }
 
 bool CWebServer::register_uri_handler_post_dpot_config()
@@ -272,48 +851,20 @@ bool CWebServer::register_uri_handler_post_dpot_config()
 
 esp_err_t CWebServer::uri_handler_post_dpot_config(httpd_req_t *req)
 {
-    char *buf = new char[req->content_len + 1];
-    size_t offset = 0;
-    int ret;
-
-    if (!buf) {
-        GetLogger(eLogType::Error)->Log("Failed to allocate buffer");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-
-    while (offset < req->content_len) {
-        ret = httpd_req_recv(req, buf + offset, req->content_len - offset);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                httpd_resp_send_408(req);
-            }
-            delete[] buf;
-            return ESP_FAIL;
-        }
-        offset += ret;
+    CWebServer *server = GetWebServer();
+    DpotConfigRequest body{};
+    esp_err_t result;
+    if (!server->recv_json_body(req, &dpot_config_schema, &body, nullptr, &result)) {
+        return result;
     }
-    buf[offset] = '\0';
-
-    cJSON *item = cJSON_ParseWithLength(buf, offset);
-    delete[] buf;
-
-    if (item) {
-        const cJSON *item_raw_value = cJSON_GetObjectItemCaseSensitive(item, "raw_value");
-        if (item_raw_value) {
-            uint8_t value = (uint8_t)item_raw_value->valuedouble;
-
-            // GetLogger(eLogType::Info)->Log("dpot post type %d raw value: %g (%d)", item_raw_value->type, item_raw_value->valuedouble, value);
-            if (GetDPotCtrl()->set_raw_value(value)) {
-                httpd_resp_set_status(req, HTTPD_200);
-                httpd_resp_send(req, "OK", 3);
-            } else {
-                httpd_resp_set_status(req, HTTPD_500);
-                httpd_resp_send(req, "NG", 3);
-            }
-        }
 
-        cJSON_Delete(item);
+    // GetLogger(eLogType::Info)->Log("dpot post raw value: %d", body.raw_value);
+    if (GetDPotCtrl()->set_raw_value(body.raw_value)) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_500);
+        httpd_resp_send(req, "NG", 3);
     }
 
     return ESP_OK;
@@ -342,16 +893,106 @@ bool CWebServer::register_uri_handler_get_ws2812_state()
 }
 
 esp_err_t CWebServer::uri_handler_get_ws2812_state(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    return server->send_state(req, &server->m_ws2812_state, GetWS2812Ctrl()->get_state_version(), format_ws2812_state);
+}
+
+size_t CWebServer::format_ws2812_state(char *buffer, size_t buffer_size)
+{
+    RGB rgb = GetWS2812Ctrl()->get_common_color();
+    int len = snprintf(buffer, buffer_size, "{\"brightness\":%u,\"red\":%u,\"green\":%u,\"blue\":%u,\"strips\":[",
+        GetWS2812Ctrl()->get_brightness(), rgb.r, rgb.g, rgb.b);
+    for (uint8_t i = 0; i < GetWS2812Ctrl()->get_strip_count(); i++) {
+        if (len < 0 || (size_t)len >= buffer_size) {
+            return 0;
+        }
+        WS2812StripConfig config;
+        GetWS2812Ctrl()->get_strip_config(i, &config);
+        RGB strip_rgb = GetWS2812Ctrl()->get_common_color(i);
+        len += snprintf(&buffer[len], buffer_size - len,
+            "%s{\"gpio\":%u,\"pixels\":%u,\"order\":\"%s\",\"rgb\":[%u,%u,%u],\"effect\":\"%s\"}",
+            i ? "," : "", config.gpio_pin_no, config.pixel_cnt, ws2812_color_order_name(config.color_order),
+            strip_rgb.r, strip_rgb.g, strip_rgb.b, ws2812_effect_name(GetWS2812Ctrl()->get_effect(nullptr, i)));
+    }
+    if (len < 0 || (size_t)len >= buffer_size) {
+        return 0;
+    }
+    len += snprintf(&buffer[len], buffer_size - len, "]}");
+    return (len < 0 || (size_t)len >= buffer_size) ? 0 : (size_t)len;
+}
+
+bool CWebServer::register_uri_handler_get_ws2812_stats()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/stats";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_stats;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_stats(httpd_req_t *req)
 {
     httpd_resp_set_type(req, "application/json");
 
+    WS2812Stats stats;
+    GetWS2812Ctrl()->get_stats(&stats);
+
     cJSON *root = cJSON_CreateObject();
     if (root) {
-        cJSON_AddNumberToObject(root, "brightness", GetWS2812Ctrl()->get_brightness());
-        RGB rgb = GetWS2812Ctrl()->get_common_color();
-        cJSON_AddNumberToObject(root, "red", rgb.r);
-        cJSON_AddNumberToObject(root, "green", rgb.g);
-        cJSON_AddNumberToObject(root, "blue", rgb.b);
+        cJSON_AddNumberToObject(root, "frames_sent", stats.frames_sent);
+        cJSON_AddNumberToObject(root, "frames_skipped", stats.frames_skipped);
+        cJSON_AddNumberToObject(root, "frames_dithered", stats.frames_dithered);
+        cJSON_AddNumberToObject(root, "frames_streamed", stats.frames_streamed);
+        cJSON_AddNumberToObject(root, "frame_generation", stats.frame_generation);
+        cJSON_AddNumberToObject(root, "queue_depth", stats.queue_depth);
+        cJSON_AddNumberToObject(root, "commands_posted", stats.commands_posted);
+        cJSON_AddNumberToObject(root, "commands_coalesced", stats.commands_coalesced);
+        cJSON_AddNumberToObject(root, "commands_dropped", stats.commands_dropped);
+        WebSocketStats ws_stats;
+        GetWebServer()->get_ws_stats(&ws_stats);
+        cJSON *ws = cJSON_AddObjectToObject(root, "websocket");
+        cJSON_AddNumberToObject(ws, "messages", ws_stats.messages);
+        cJSON_AddNumberToObject(ws, "rejected", ws_stats.rejected);
+        cJSON_AddNumberToObject(ws, "latency_avg_us", ws_stats.latency_avg_us);
+        cJSON_AddNumberToObject(ws, "latency_max_us", ws_stats.latency_max_us);
+        cJSON_AddNumberToObject(ws, "pushes", ws_stats.pushes);
+        WS2812StreamStats stream_stats;
+        GetStreamReceiver()->get_stats(&stream_stats);
+        cJSON *stream = cJSON_AddObjectToObject(root, "stream");
+        cJSON_AddBoolToObject(stream, "active", GetStreamReceiver()->is_streaming());
+        cJSON_AddNumberToObject(stream, "packets", stream_stats.packets);
+        cJSON_AddNumberToObject(stream, "bytes", stream_stats.bytes);
+        cJSON_AddNumberToObject(stream, "frames", stream_stats.frames);
+        cJSON_AddNumberToObject(stream, "frames_rejected", stream_stats.frames_rejected);
+        cJSON_AddNumberToObject(stream, "sync_packets", stream_stats.sync_packets);
+        cJSON_AddNumberToObject(stream, "dropped_stale", stream_stats.dropped_stale);
+        cJSON_AddNumberToObject(stream, "dropped_malformed", stream_stats.dropped_malformed);
+        cJSON_AddNumberToObject(stream, "dropped_ignored", stream_stats.dropped_ignored);
+        MemoryStats memory_stats;
+        GetMemory()->get_stats(&memory_stats);
+        cJSON *memory = cJSON_AddObjectToObject(root, "memory");
+        cJSON_AddNumberToObject(memory, "writes_requested", memory_stats.writes_requested);
+        cJSON_AddNumberToObject(memory, "writes_coalesced", memory_stats.writes_coalesced);
+        cJSON_AddNumberToObject(memory, "writes_skipped", memory_stats.writes_skipped);
+        cJSON_AddNumberToObject(memory, "commits", memory_stats.commits);
+        cJSON_AddNumberToObject(memory, "commits_last_hour", memory_stats.commits_last_hour);
+        cJSON_AddNumberToObject(memory, "pending", memory_stats.pending);
+        cJSON *logger = cJSON_AddObjectToObject(root, "logger");
+        cJSON_AddNumberToObject(logger, "dropped", CLogger::GetDropped());
         const char *info = cJSON_Print(root);
         httpd_resp_sendstr(req, info);
         free((void *)info);
@@ -385,84 +1026,276 @@ bool CWebServer::register_uri_handler_post_ws2812_config()
 
 esp_err_t CWebServer::uri_handler_post_ws2812_config(httpd_req_t *req)
 {
-    char *buf = new char[req->content_len + 1];
-    size_t offset = 0;
-    int ret;
-
-    if (!buf) {
-        GetLogger(eLogType::Error)->Log("Failed to allocate buffer");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    CWebServer *server = GetWebServer();
+    ConfigRequest body{};
+    body.fade = WS2812_FADE_TIME_MS;
+    body.strip = WS2812_STRIP_ALL;
+    uint32_t present = 0;
+    esp_err_t result;
+    if (!server->recv_json_body(req, &config_schema, &body, &present, &result)) {
+        return result;
     }
 
-    while (offset < req->content_len) {
-        ret = httpd_req_recv(req, buf + offset, req->content_len - offset);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                httpd_resp_send_408(req);
-            }
-            delete[] buf;
-            return ESP_FAIL;
+    // all fields are applied as one transaction (single nvs commit, single frame)
+    WS2812Update update{};
+    update.strip = body.strip;
+    update.fade_ms = body.fade;
+    update.enqueue = body.enqueue;
+    update.save_memory = true;
+    if (present & CONFIG_FIELD_BRIGHTNESS) {
+        update.fields |= WS2812_UPDATE_BRIGHTNESS;
+        update.brightness = body.brightness;
+    }
+    if (present & CONFIG_FIELD_RGB) {
+        update.fields |= WS2812_UPDATE_COLOR;
+        update.color = RGB(body.rgb[0], body.rgb[1], body.rgb[2]);
+    }
+    if (present & (CONFIG_FIELD_EFFECT | CONFIG_FIELD_SPEED | CONFIG_FIELD_SIZE | CONFIG_FIELD_EFFECT_RGB)) {
+        // effect fields not in the request keep the current value of the strip
+        update.fields |= WS2812_UPDATE_EFFECT;
+        update.effect = GetWS2812Ctrl()->get_effect(&update.effect_param, body.strip == WS2812_STRIP_ALL ? 0 : body.strip);
+        if (present & CONFIG_FIELD_EFFECT) {
+            update.effect = body.effect;
+        }
+        if (present & CONFIG_FIELD_SPEED) {
+            update.effect_param.speed = body.speed;
+        }
+        if (present & CONFIG_FIELD_SIZE) {
+            update.effect_param.size = body.size;
+        }
+        if (present & CONFIG_FIELD_EFFECT_RGB) {
+            update.effect_param.color = RGB(body.effect_rgb[0], body.effect_rgb[1], body.effect_rgb[2]);
         }
-        offset += ret;
     }
-    buf[offset] = '\0';
+    if (present & CONFIG_FIELD_RANGES) {
+        update.fields |= WS2812_UPDATE_PIXELS;
+        update.range_cnt = body.range_cnt;
+        memcpy(update.ranges, body.ranges, sizeof(update.ranges));
+    }
 
-    cJSON *item = cJSON_ParseWithLength(buf, offset);
-    delete[] buf;
+    if (GetWS2812Ctrl()->apply_update(update)) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+    }
 
-    if (item) {
-        const cJSON *item_brightness = cJSON_GetObjectItemCaseSensitive(item, "brightness");
-        if (item_brightness) {
-            uint8_t value = (uint8_t)(item_brightness->valuedouble);
-            if (GetWS2812Ctrl()->set_brightness(value)) {
-                httpd_resp_set_status(req, HTTPD_200);
-                httpd_resp_send(req, "OK", 3);
-            } else {
-                httpd_resp_set_status(req, HTTPD_500);
-                httpd_resp_send(req, "NG", 3);
-            }
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_blink()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/blink";
+    conf.method = HTTP_POST;
+    conf.handler = CWebServer::uri_handler_post_ws2812_blink;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_post_ws2812_blink(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    BlinkRequest body{};
+    body.duration = 1000;
+    body.count = 1;
+    esp_err_t result;
+    if (!server->recv_json_body(req, &blink_schema, &body, nullptr, &result)) {
+        return result;
+    }
+
+    if (body.demo) {
+        GetWS2812Ctrl()->blink_demo(body.enqueue);
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        if (GetWS2812Ctrl()->blink(body.duration, body.count, body.enqueue)) {
+            httpd_resp_set_status(req, HTTPD_200);
+            httpd_resp_send(req, "OK", 3);
+        } else {
+            httpd_resp_set_status(req, HTTPD_500);
+            httpd_resp_send(req, "NG", 3);
         }
+    }
 
-        const cJSON *item_rgb = cJSON_GetObjectItemCaseSensitive(item, "rgb");
-        if (item_rgb) {
-            uint8_t r = 0, g = 0, b = 0;
-            cJSON *elem;
-            int arr_size = cJSON_GetArraySize(item_rgb);
-            if (arr_size >= 1) {
-                elem = cJSON_GetArrayItem(item_rgb, 0);
-                r = (uint8_t)(elem->valuedouble);
-            }
-            if (arr_size >= 2) {
-                elem = cJSON_GetArrayItem(item_rgb, 1);
-                g = (uint8_t)(elem->valuedouble);
-            }
-            if (arr_size >= 3) {
-                elem = cJSON_GetArrayItem(item_rgb, 2);
-                b = (uint8_t)(elem->valuedouble);
-            }
+    return ESP_OK;
+}
 
-            if (GetWS2812Ctrl()->set_common_color(r, g, b)) {
-                httpd_resp_set_status(req, HTTPD_200);
-                httpd_resp_send(req, "OK", 3);
-            } else {
-                httpd_resp_set_status(req, HTTPD_500);
-                httpd_resp_send(req, "NG", 3);
-            }
+bool CWebServer::register_uri_handler_get_ws2812_effect()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/effect";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_effect;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_effect(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    WS2812EffectParam param;
+    uint8_t effect = GetWS2812Ctrl()->get_effect(&param);
+
+    cJSON *root = cJSON_CreateObject();
+    if (root) {
+        cJSON_AddStringToObject(root, "effect", ws2812_effect_name(effect));
+        cJSON_AddNumberToObject(root, "speed", param.speed);
+        cJSON_AddNumberToObject(root, "size", param.size);
+        cJSON *rgb = cJSON_AddArrayToObject(root, "rgb");
+        cJSON_AddItemToArray(rgb, cJSON_CreateNumber(param.color.r));
+        cJSON_AddItemToArray(rgb, cJSON_CreateNumber(param.color.g));
+        cJSON_AddItemToArray(rgb, cJSON_CreateNumber(param.color.b));
+        cJSON *list = cJSON_AddArrayToObject(root, "effects");
+        for (int i = 0; i < WS2812_EFFECT_COUNT; i++) {
+            cJSON_AddItemToArray(list, cJSON_CreateString(ws2812_effect_name(i)));
         }
+        const char *info = cJSON_Print(root);
+        httpd_resp_sendstr(req, info);
+        free((void *)info);
+        cJSON_Delete(root);
+    }
 
-        cJSON_Delete(item);
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_effect()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/effect";
+    conf.method = HTTP_POST;
+    conf.handler = CWebServer::uri_handler_post_ws2812_effect;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_post_ws2812_effect(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    EffectRequest body{};
+    body.strip = WS2812_STRIP_ALL;
+    uint32_t present = 0;
+    esp_err_t result;
+    if (!server->recv_json_body(req, &effect_schema, &body, &present, &result)) {
+        return result;
+    }
+
+    // fields not in the request keep the current value of the strip
+    WS2812EffectParam param;
+    uint8_t effect = GetWS2812Ctrl()->get_effect(&param, body.strip == WS2812_STRIP_ALL ? 0 : body.strip);
+    if (present & EFFECT_FIELD_EFFECT) {
+        effect = body.effect;
+    }
+    if (present & EFFECT_FIELD_SPEED) {
+        param.speed = body.speed;
+    }
+    if (present & EFFECT_FIELD_SIZE) {
+        param.size = body.size;
+    }
+    if (present & EFFECT_FIELD_RGB) {
+        param.color = RGB(body.rgb[0], body.rgb[1], body.rgb[2]);
+    }
+
+    if (GetWS2812Ctrl()->set_effect(effect, param, body.strip)) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
     }
 
     return ESP_OK;
 }
 
-bool CWebServer::register_uri_handler_post_ws2812_blink()
+bool CWebServer::register_uri_handler_get_ws2812_calibration()
 {
     httpd_uri_t conf;
-    conf.uri = "/api/v1/ws2812/blink";
+    conf.uri = "/api/v1/ws2812/calibration";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_calibration;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_calibration(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    WS2812Calibration cal = GetWS2812Ctrl()->get_calibration();
+
+    cJSON *root = cJSON_CreateObject();
+    if (root) {
+        cJSON_AddNumberToObject(root, "gamma", (double)cal.gamma_x100 / 100.);
+        cJSON *wb = cJSON_AddArrayToObject(root, "white_balance");
+        cJSON_AddItemToArray(wb, cJSON_CreateNumber(cal.white_balance[0]));
+        cJSON_AddItemToArray(wb, cJSON_CreateNumber(cal.white_balance[1]));
+        cJSON_AddItemToArray(wb, cJSON_CreateNumber(cal.white_balance[2]));
+        cJSON_AddBoolToObject(root, "dither", cal.dither);
+        const char *info = cJSON_Print(root);
+        httpd_resp_sendstr(req, info);
+        free((void *)info);
+        cJSON_Delete(root);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_calibration()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/calibration";
     conf.method = HTTP_POST;
-    conf.handler = CWebServer::uri_handler_post_ws2812_blink;
+    conf.handler = CWebServer::uri_handler_post_ws2812_calibration;
     conf.user_ctx = nullptr;
 
     if (!m_handle) {
@@ -479,67 +1312,596 @@ bool CWebServer::register_uri_handler_post_ws2812_blink()
     return true;
 }
 
-esp_err_t CWebServer::uri_handler_post_ws2812_blink(httpd_req_t *req)
+esp_err_t CWebServer::uri_handler_post_ws2812_calibration(httpd_req_t *req)
 {
-    char *buf = new char[req->content_len + 1];
-    size_t offset = 0;
-    int ret;
+    CWebServer *server = GetWebServer();
+    WS2812Calibration cal = GetWS2812Ctrl()->get_calibration();
+    esp_err_t result;
+    if (!server->recv_json_body(req, &calibration_schema, &cal, nullptr, &result)) {
+        return result;
+    }
 
-    if (!buf) {
-        GetLogger(eLogType::Error)->Log("Failed to allocate buffer");
-        httpd_resp_send_500(req);
+    if (GetWS2812Ctrl()->set_calibration(cal)) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_get_ws2812_geometry()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/geometry";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_geometry;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_geometry(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    WS2812Geometry geometry = GetWS2812Ctrl()->get_geometry();
+
+    cJSON *root = cJSON_CreateObject();
+    if (root) {
+        cJSON_AddNumberToObject(root, "pwm_pin", geometry.pwm_pin_no);
+        cJSON *strips = cJSON_AddArrayToObject(root, "strips");
+        for (uint8_t i = 0; i < geometry.strip_cnt; i++) {
+            cJSON *strip = cJSON_CreateObject();
+            cJSON_AddNumberToObject(strip, "gpio", geometry.strips[i].gpio_pin_no);
+            cJSON_AddNumberToObject(strip, "pixels", geometry.strips[i].pixel_cnt);
+            cJSON_AddStringToObject(strip, "order", ws2812_color_order_name(geometry.strips[i].color_order));
+            cJSON_AddItemToArray(strips, strip);
+        }
+        const char *info = cJSON_Print(root);
+        httpd_resp_sendstr(req, info);
+        free((void *)info);
+        cJSON_Delete(root);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_geometry()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/geometry";
+    conf.method = HTTP_POST;
+    conf.handler = CWebServer::uri_handler_post_ws2812_geometry;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_post_ws2812_geometry(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    WS2812Geometry geometry = GetWS2812Ctrl()->get_geometry();
+    for (auto & strip : geometry.strips) {
+        strip.color_order = WS2812_ORDER_GRB;   // default if "order" is omitted
+    }
+    esp_err_t result;
+    if (!server->recv_json_body(req, &geometry_schema, &geometry, nullptr, &result)) {
+        return result;
+    }
+
+    if (GetWS2812Ctrl()->set_geometry(geometry)) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_get_ws2812_frame()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/frame";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_frame;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_frame(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    char *buffer = server->m_buffer_pool ? server->m_buffer_pool->acquire(pdMS_TO_TICKS(WEB_SERVER_BUFFER_WAIT_MS)) : nullptr;
+    if (!buffer) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server busy");
         return ESP_FAIL;
     }
 
+    // a long frame does not fit into a pool buffer: sent in chunks, each one copied under the stream
+    // mutex and sent after releasing it (a slow client can not stall the led task)
+    size_t chunk_cnt = server->m_buffer_pool->get_block_size() / sizeof(RGB);
+    size_t total_cnt = GetWS2812Ctrl()->get_pixel_count();
+    size_t pixel_cnt = GetWS2812Ctrl()->read_frame((RGB *)buffer, chunk_cnt);
+    esp_err_t ret = ESP_FAIL;
+    if (pixel_cnt) {
+        httpd_resp_set_type(req, "application/octet-stream");
+        size_t offset = 0;
+        ret = ESP_OK;
+        while (ret == ESP_OK && pixel_cnt) {
+            ret = httpd_resp_send_chunk(req, buffer, pixel_cnt * sizeof(RGB));
+            offset += pixel_cnt;
+            pixel_cnt = offset < total_cnt ? GetWS2812Ctrl()->read_frame((RGB *)buffer, chunk_cnt, offset) : 0;
+        }
+        // buffer busy or geometry changed in between: cut off without the final chunk (client sees an error)
+        if (ret == ESP_OK && offset < total_cnt) {
+            ret = ESP_FAIL;
+        }
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, nullptr, 0);
+        }
+    } else {
+        httpd_resp_send_500(req);
+    }
+    server->m_buffer_pool->release(buffer);
+
+    return ret;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_frame()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/frame";
+    conf.method = HTTP_POST;
+    conf.handler = CWebServer::uri_handler_post_ws2812_frame;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_post_ws2812_frame(httpd_req_t *req)
+{
+    static_assert(sizeof(RGB) == 3, "frame body is received into RGB array as is");
+
+    // body: packed rgb bytes, query: offset=<pixel>&length=<pixels> (optional)
+    char query[48], value[8];
+    uint32_t pixel_offset = 0;
+    uint32_t pixel_cnt = req->content_len / sizeof(RGB);
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "offset", value, sizeof(value)) == ESP_OK) {
+            pixel_offset = (uint32_t)atoi(value);
+        }
+        if (httpd_query_key_value(query, "length", value, sizeof(value)) == ESP_OK) {
+            pixel_cnt = (uint32_t)atoi(value);
+        }
+    }
+
+    CWebServer *server = GetWebServer();
+    if (req->content_len != pixel_cnt * sizeof(RGB) || pixel_offset > 0xFFFF || pixel_cnt == 0 ||
+        pixel_offset + pixel_cnt > GetWS2812Ctrl()->get_pixel_count() || 
+        !server->m_buffer_pool || req->content_len > server->m_buffer_pool->get_block_size()) {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+        return ESP_OK;
+    }
+
+    // socket -> request buffer, the stream mutex is only held for the copy into the back buffer
+    // (a slow client can not stall the led task)
+    char *buffer = server->m_buffer_pool->acquire(pdMS_TO_TICKS(WEB_SERVER_BUFFER_WAIT_MS));
+    if (!buffer) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server busy");
+        return ESP_FAIL;
+    }
+    size_t offset = 0;
+    int ret;
     while (offset < req->content_len) {
-        ret = httpd_req_recv(req, buf + offset, req->content_len - offset);
+        ret = httpd_req_recv(req, buffer + offset, req->content_len - offset);
         if (ret <= 0) {
+            server->m_buffer_pool->release(buffer);
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 httpd_resp_send_408(req);
             }
-            delete[] buf;
             return ESP_FAIL;
         }
         offset += ret;
     }
-    buf[offset] = '\0';
 
-    cJSON *item = cJSON_ParseWithLength(buf, offset);
-    delete[] buf;
+    bool written = GetWS2812Ctrl()->write_frame((uint16_t)pixel_offset, (const RGB *)buffer, (uint16_t)pixel_cnt);
+    server->m_buffer_pool->release(buffer);
+    if (written) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_500);
+        httpd_resp_send(req, "NG", 3);
+    }
 
-    if (item) {
-        uint32_t duration = 1000;
-        uint32_t count = 1;
-        bool demo = false;
-        const cJSON *item_duration = cJSON_GetObjectItemCaseSensitive(item, "duration");
-        if (item_duration) {
-            duration = (uint32_t)(item_duration->valuedouble);
-        }
-        const cJSON *item_count = cJSON_GetObjectItemCaseSensitive(item, "count");
-        if (item_count) {
-            count = (uint32_t)(item_count->valuedouble);
-        }
-        const cJSON *item_demo = cJSON_GetObjectItemCaseSensitive(item, "demo");
-        if (item_demo) {
-            demo = (bool)(item_demo->valuedouble);
+    return ESP_OK;
+}
+
+void CWebServer::get_ws_stats(WebSocketStats *stats)
+{
+    *stats = m_ws_stats;
+}
+
+bool CWebServer::register_uri_handler_get_ws2812_scenes()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/scenes";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_ws2812_scenes;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_ws2812_scenes(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    // index is kept in ram, listing does not read flash
+    cJSON *root = cJSON_CreateObject();
+    if (root) {
+        cJSON_AddNumberToObject(root, "last", GetSceneStore()->get_last_scene());
+        cJSON *list = cJSON_AddArrayToObject(root, "scenes");
+        SceneInfo info;
+        for (uint8_t i = 0; GetSceneStore()->get_info(i, &info); i++) {
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddNumberToObject(item, "id", info.id);
+            cJSON_AddStringToObject(item, "name", info.name);
+            cJSON_AddNumberToObject(item, "pixels", info.pixel_cnt);
+            cJSON_AddNumberToObject(item, "bytes", info.size);
+            cJSON_AddBoolToObject(item, "rle", (info.flags & WS2812_SCENE_FLAG_RLE) != 0);
+            cJSON_AddStringToObject(item, "effect", ws2812_effect_name(info.effect_id));
+            cJSON_AddNumberToObject(item, "load_us", info.load_us);
+            cJSON_AddItemToArray(list, item);
         }
+        const char *info_str = cJSON_Print(root);
+        httpd_resp_sendstr(req, info_str);
+        free((void *)info_str);
+        cJSON_Delete(root);
+    }
 
-        if (demo) {
-            GetWS2812Ctrl()->blink_demo();
-            httpd_resp_set_status(req, HTTPD_200);
-            httpd_resp_send(req, "OK", 3);
-        } else {
-            if (GetWS2812Ctrl()->blink(duration, count)) {
-                httpd_resp_set_status(req, HTTPD_200);
-                httpd_resp_send(req, "OK", 3);
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_post_ws2812_scene()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/ws2812/scene";
+    conf.method = HTTP_POST;
+    conf.handler = CWebServer::uri_handler_post_ws2812_scene;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_post_ws2812_scene(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+    SceneRequest body{};
+    uint32_t present = 0;
+    esp_err_t result;
+    if (!server->recv_json_body(req, &scene_schema, &body, &present, &result)) {
+        return result;
+    }
+
+    bool success = false;
+    switch (body.action) {
+    case SCENE_ACTION_SAVE:
+        success = GetSceneStore()->save(body.id, body.name);
+        break;
+    case SCENE_ACTION_RECALL:
+        success = GetSceneStore()->recall(body.id, body.fade);
+        break;
+    case SCENE_ACTION_DELETE:
+        success = GetSceneStore()->remove(body.id);
+        break;
+    default:
+        break;
+    }
+
+    if (success) {
+        httpd_resp_set_status(req, HTTPD_200);
+        httpd_resp_send(req, "OK", 3);
+    } else {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "NG", 3);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_get_system_boot()
+{
+    httpd_uri_t conf;
+    conf.uri = "/api/v1/system/boot";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_get_system_boot;
+    conf.user_ctx = nullptr;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_get_system_boot(httpd_req_t *req)
+{
+    boot_timeline_mark(BOOT_PHASE_HTTP_RESPONSE);
+    httpd_resp_set_type(req, "application/json");
+
+    // us since boot per phase, null: not reached (yet)
+    cJSON *root = cJSON_CreateObject();
+    if (root) {
+        cJSON *timeline = cJSON_AddObjectToObject(root, "timeline");
+        for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+            int64_t timestamp = boot_timeline_get((eBootPhase)i);
+            if (timestamp >= 0) {
+                cJSON_AddNumberToObject(timeline, boot_phase_name(i), (double)timestamp);
             } else {
-                httpd_resp_set_status(req, HTTPD_500);
-                httpd_resp_send(req, "NG", 3);
+                cJSON_AddNullToObject(timeline, boot_phase_name(i));
             }
         }
+        cJSON_AddNumberToObject(root, "uptime", (double)esp_timer_get_time());
+        const char *info = cJSON_Print(root);
+        httpd_resp_sendstr(req, info);
+        free((void *)info);
+        cJSON_Delete(root);
+    }
+
+    return ESP_OK;
+}
+
+bool CWebServer::register_uri_handler_ws2812_ws()
+{
+    httpd_uri_t conf;
+    memset(&conf, 0, sizeof(conf));
+    conf.uri = "/api/v1/ws2812/ws";
+    conf.method = HTTP_GET;
+    conf.handler = CWebServer::uri_handler_ws2812_ws;
+    conf.user_ctx = nullptr;
+    conf.is_websocket = true;
+
+    if (!m_handle) {
+        GetLogger(eLogType::Error)->Log("Server is not started");
+        return false;
+    }
+
+    esp_err_t result = httpd_register_uri_handler(m_handle, &conf);
+    if (result != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to register uri handler %s (ret: %d)", conf.uri, result);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t CWebServer::uri_handler_ws2812_ws(httpd_req_t *req)
+{
+    CWebServer *server = GetWebServer();
+
+    if (req->method == HTTP_GET) {
+        // handshake done, the new client gets the current state right away
+        GetLogger(eLogType::Info)->Log("websocket client connected (fd %d)", httpd_req_to_sockfd(req));
+        server->request_ws_push();
+        return ESP_OK;
+    }
+
+    int64_t time_start = esp_timer_get_time();
+    uint8_t msg[WEB_SOCKET_MAX_MSG];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+
+    // first call only reads the frame header (length)
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to receive websocket frame (ret: %d)", ret);
+        return ret;
+    }
+    if (frame.len > sizeof(msg)) {
+        // oversized frame can not be skipped, drop the connection
+        GetLogger(eLogType::Error)->Log("websocket frame too long (%d)", frame.len);
+        server->m_ws_stats.rejected++;
+        return ESP_FAIL;
+    }
+    if (frame.len > 0) {
+        frame.payload = msg;
+        ret = httpd_ws_recv_frame(req, &frame, frame.len);
+        if (ret != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to receive websocket payload (ret: %d)", ret);
+            return ret;
+        }
+    }
+
+    if (frame.type != HTTPD_WS_TYPE_BINARY || !server->handle_ws_message(msg, frame.len)) {
+        server->m_ws_stats.rejected++;
+        return ESP_OK;
+    }
 
-        cJSON_Delete(item);
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - time_start);
+    WebSocketStats *stats = &server->m_ws_stats;
+    stats->messages++;
+    // exponential moving average (1/8)
+    stats->latency_avg_us = stats->messages == 1 ? latency_us : stats->latency_avg_us - (stats->latency_avg_us >> 3) + (latency_us >> 3);
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
     }
 
     return ESP_OK;
 }
+
+static inline uint16_t read_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+bool CWebServer::handle_ws_message(const uint8_t *msg, size_t len)
+{
+    if (len < 1) {
+        return false;
+    }
+
+    switch (msg[0]) {
+    case WS_OP_STATE:
+        request_ws_push();
+        return true;
+    case WS_OP_BRIGHTNESS:
+        if (len < 4)
+            return false;
+        return GetWS2812Ctrl()->set_brightness(msg[1], len < 5 || (msg[4] & WS_FLAG_SAVE), false, read_u16(&msg[2]));
+    case WS_OP_COLOR:
+        if (len < 7)
+            return false;
+        return GetWS2812Ctrl()->set_common_color(msg[2], msg[3], msg[4], len < 8 || (msg[7] & WS_FLAG_SAVE), read_u16(&msg[5]), false, msg[1]);
+    case WS_OP_EFFECT: {
+        if (len < 8)
+            return false;
+        WS2812EffectParam param;
+        param.speed = msg[3];
+        param.size = msg[4];
+        param.color = RGB(msg[5], msg[6], msg[7]);
+        return GetWS2812Ctrl()->set_effect(msg[2], param, msg[1]);
+    }
+    case WS_OP_BLINK:
+        if (len < 4)
+            return false;
+        return GetWS2812Ctrl()->blink(read_u16(&msg[2]), msg[1]);
+    default:
+        return false;
+    }
+}
+
+void CWebServer::on_ws2812_state_changed(void *ctx)
+{
+    static_cast<CWebServer *>(ctx)->request_ws_push();
+}
+
+void CWebServer::request_ws_push()
+{
+    if (!m_handle || m_ws_push_queued) {
+        // a queued push sends the latest state anyway
+        return;
+    }
+
+    m_ws_push_queued = true;
+    if (httpd_queue_work(m_handle, CWebServer::work_ws_push_state, this) != ESP_OK) {
+        m_ws_push_queued = false;
+    }
+}
+
+void CWebServer::work_ws_push_state(void *arg)
+{
+    CWebServer *server = static_cast<CWebServer *>(arg);
+    server->m_ws_push_queued = false;
+
+    RGB rgb = GetWS2812Ctrl()->get_common_color();
+    uint8_t msg[7];
+    msg[0] = WS_OP_STATE | WS_OP_REPLY;
+    msg[1] = GetWS2812Ctrl()->get_brightness();
+    msg[2] = rgb.r;
+    msg[3] = rgb.g;
+    msg[4] = rgb.b;
+    msg[5] = GetWS2812Ctrl()->get_effect();
+    msg[6] = GetWS2812Ctrl()->get_strip_count();
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = HTTPD_WS_TYPE_BINARY;
+    frame.final = true;
+    frame.payload = msg;
+    frame.len = sizeof(msg);
+
+    int fds[WEB_SERVER_MAX_SOCKETS];
+    size_t fd_cnt = WEB_SERVER_MAX_SOCKETS;
+    if (httpd_get_client_list(server->m_handle, &fd_cnt, fds) != ESP_OK) {
+        return;
+    }
+    for (size_t i = 0; i < fd_cnt; i++) {
+        if (httpd_ws_get_fd_info(server->m_handle, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            continue;
+        }
+        if (httpd_ws_send_frame_async(server->m_handle, fds[i], &frame) == ESP_OK) {
+            server->m_ws_stats.pushes++;
+        }
+    }
+}
@@ -8,34 +8,86 @@
  * @copyright Copyright (c) 2023
  */
 #include "ws2812.h"
-#include "driver/gpio.h"
 #include "driver/ledc.h"
-#include "driver/rmt.h"
+#include "driver/gpio.h"
 #include "definition.h"
 #include "logger.h"
 #include "memory.h"
+#include "esp_timer.h"
+#include "boot_timeline.h"
+#include <string.h>
+#include <algorithm>
 
 CWS2812Ctrl* CWS2812Ctrl::_instance = nullptr;
 
-enum CMD_TYPE {
-    SETRGB = 0,
-    BLINK = 1,
-    BLINK_DEMO = 2,
-};
-
 CWS2812Ctrl::CWS2812Ctrl()
 {
-    m_gpio_pin_no = 0;
     m_task_keepalive = true;
     m_brightness = 0;
-    m_common_color = RGB();
-    m_blink_duration_ms = 0;
-    m_blink_count = 0;
+    m_strip_cnt = 0;
+    m_pwm_pin_no = 0xFF;
+    memset(&m_geometry, 0, sizeof(m_geometry));
+    for (auto & strip : m_strips) {
+        memset(&strip.config, 0, sizeof(strip.config));
+        strip.offset = 0;
+        strip.output = nullptr;
+        strip.common_color = RGB();
+        // color track drives r, g and b (tracks default to one channel)
+        const uint8_t black[3] = {0, 0, 0};
+        strip.track_color.reset(black, 3);
+        strip.effect_id = WS2812_EFFECT_NONE;
+        strip.effect_param = ws2812_effect_default_param();
+        strip.effect = nullptr;
+        strip.effect_type = WS2812_EFFECT_NONE;
+        strip.effect_running = false;
+    }
+    m_calibration = ws2812_default_calibration();
+    m_correction = *ws2812_default_correction();
+    m_dither = m_calibration.dither;
+    m_dither_residual = false;
+    m_dither_static = 0;
+    m_dither_frame_ms = WS2812_DITHER_FRAME_TIME_MS;
+    m_queue_command = nullptr;
+    m_mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+    memset(m_mailbox_pending, 0, sizeof(m_mailbox_pending));
+    memset(m_mailbox, 0, sizeof(m_mailbox));
+    m_commands_posted = 0;
+    m_commands_coalesced = 0;
+    m_commands_dropped = 0;
+    m_frame_generation = 1;     // first frame is always sent (clears the strip)
+    m_sent_generation = 0;
+    m_frames_sent = 0;
+    m_frames_skipped = 0;
+    m_frames_dithered = 0;
+    m_frames_streamed = 0;
+    m_stream_front = 0;
+    m_stream_lock = portMUX_INITIALIZER_UNLOCKED;
+    m_stream_mutex = xSemaphoreCreateMutex();
+    m_state_version = 1;
+    m_state_listener = nullptr;
+    m_state_listener_ctx = nullptr;
 }
 
 CWS2812Ctrl::~CWS2812Ctrl()
 {
     m_task_keepalive = false;
+    release_strips();
+}
+
+void CWS2812Ctrl::release_strips()
+{
+    for (auto & strip : m_strips) {
+        if (strip.output) {
+            delete strip.output;
+            strip.output = nullptr;
+        }
+        if (strip.effect) {
+            delete strip.effect;
+            strip.effect = nullptr;
+        }
+        strip.effect_running = false;
+    }
+    m_strip_cnt = 0;
 }
 
 CWS2812Ctrl* CWS2812Ctrl::Instance()
@@ -47,27 +99,12 @@ CWS2812Ctrl* CWS2812Ctrl::Instance()
     return _instance;
 }
 
-bool CWS2812Ctrl::initialize(uint8_t gpio_pin_no, uint16_t pixel_cnt)
+bool CWS2812Ctrl::initialize(const WS2812Geometry &geometry)
 {
-    esp_err_t ret;
-
-    m_gpio_pin_no = gpio_pin_no;
-    m_pixel_values.resize(pixel_cnt);
-    m_pixel_conv_values.resize(pixel_cnt);
-
-    m_queue_command = xQueueCreate(10, sizeof(int));
-    xTaskCreate(func_command, "TASK_WS2812_CTRL", 4096, this, TASK_PRIORITY_WS2812, &m_task_handle);
-
-    gpio_config_t gpio_cfg;
-    gpio_cfg.pin_bit_mask   = 1ULL << m_gpio_pin_no;
-    gpio_cfg.mode           = GPIO_MODE_OUTPUT;
-    gpio_cfg.pull_up_en     = GPIO_PULLUP_DISABLE;
-    gpio_cfg.pull_down_en   = GPIO_PULLDOWN_DISABLE;
-    gpio_cfg.intr_type      = GPIO_INTR_DISABLE;
-    ret = gpio_config(&gpio_cfg);
-    if (ret != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to configure GPIO (ret %d)", ret);
-        return false;
+    m_geometry = geometry;
+    if (!ws2812_validate_geometry(&m_geometry)) {
+        GetLogger(eLogType::Error)->Log("fall back to default geometry");
+        m_geometry = ws2812_default_geometry();
     }
 
     ledc_timer_config_t ledc_timer_cfg;
@@ -78,8 +115,29 @@ bool CWS2812Ctrl::initialize(uint8_t gpio_pin_no, uint16_t pixel_cnt)
     ledc_timer_cfg.clk_cfg = LEDC_AUTO_CLK;
     ledc_timer_config(&ledc_timer_cfg);
 
+    // task is not running yet, geometry is applied in the caller context only this time
+    if (!apply_geometry(m_geometry)) {
+        return false;
+    }
+
+    m_queue_command = xQueueCreate(WS2812_QUEUE_LENGTH, sizeof(WS2812Command));
+    xTaskCreate(func_command, "TASK_WS2812_CTRL", 4096, this, TASK_PRIORITY_WS2812, &m_task_handle);
+
+    return true;
+}
+
+bool CWS2812Ctrl::configure_pwm(uint8_t pwm_pin_no)
+{
+    if (m_pwm_pin_no == pwm_pin_no) {
+        return true;
+    }
+
+    if (m_pwm_pin_no != 0xFF) {
+        gpio_reset_pin((gpio_num_t)m_pwm_pin_no);
+    }
+
     ledc_channel_config_t ledc_ch_cfg;
-    ledc_ch_cfg.gpio_num = PIN_WS2812_PWM;
+    ledc_ch_cfg.gpio_num = pwm_pin_no;
     ledc_ch_cfg.speed_mode = LEDC_HIGH_SPEED_MODE;
     ledc_ch_cfg.channel = LEDC_CHANNEL_0;
     ledc_ch_cfg.intr_type = LEDC_INTR_DISABLE;
@@ -88,9 +146,151 @@ bool CWS2812Ctrl::initialize(uint8_t gpio_pin_no, uint16_t pixel_cnt)
     ledc_ch_cfg.hpoint = 0;
     ledc_ch_cfg.flags.output_invert = 1;
     
-    ledc_channel_config(&ledc_ch_cfg);
+    esp_err_t ret = ledc_channel_config(&ledc_ch_cfg);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to configure ledc channel (gpio %d, ret: %d)", pwm_pin_no, ret);
+        return false;
+    }
+    m_pwm_pin_no = pwm_pin_no;
 
-    return true;
+    // channel config resets the duty
+    return apply_brightness(m_track_brightness.get_value()[0], false);
+}
+
+bool CWS2812Ctrl::apply_geometry(const WS2812Geometry &geometry)
+{
+    bool result = true;
+
+    // raw frame readers/writers only copy while holding the stream mutex, so the wait is short
+    // a busy mutex retries on the next task loop instead of stalling rendering
+    if (xSemaphoreTake(m_stream_mutex, pdMS_TO_TICKS(WS2812_STREAM_LOCK_MS)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("frame buffer is busy, geometry is applied later");
+        WS2812Command cmd{};
+        cmd.type = RECONFIGURE;
+        post_coalesced(cmd);
+        return false;
+    }
+
+    // outputs hold item/dma buffers sized for the old strips, stop them first
+    for (auto & strip : m_strips) {
+        if (strip.output) {
+            strip.output->wait_done(WS2812_TX_TIMEOUT_MS);
+            delete strip.output;
+            strip.output = nullptr;
+        }
+    }
+
+    size_t total_cnt = 0;
+    for (uint8_t i = 0; i < WS2812_MAX_STRIPS; i++) {
+        WS2812Strip *strip = &m_strips[i];
+        if (i < geometry.strip_cnt) {
+            if (i >= m_strip_cnt) {
+                // new strip starts with the color of the first one
+                if (i > 0) {
+                    strip->common_color = m_strips[0].common_color;
+                }
+                uint8_t value[3] = {strip->common_color.r, strip->common_color.g, strip->common_color.b};
+                strip->track_color.reset(value, 3);
+            }
+            strip->config = geometry.strips[i];
+            strip->offset = (uint16_t)total_cnt;
+            total_cnt += strip->config.pixel_cnt;
+        } else {
+            memset(&strip->config, 0, sizeof(strip->config));
+            strip->offset = (uint16_t)total_cnt;
+            strip->track_color.stop();
+            strip->effect_running = false;
+            strip->effect_id = WS2812_EFFECT_NONE;     // a strip added again starts without effect
+            if (strip->effect) {
+                delete strip->effect;
+                strip->effect = nullptr;
+            }
+        }
+    }
+    m_strip_cnt = geometry.strip_cnt;
+
+    // exactly sized buffers, reallocated here only (never per frame)
+    // the stream mutex keeps raw frame readers/writers out while the buffers move
+    std::vector<RGB>(total_cnt).swap(m_pixel_values);
+    std::vector<uint16_t>(total_cnt * 3).swap(m_pixel_linear);
+    std::vector<uint8_t>(total_cnt * 3).swap(m_dither_error);
+    std::vector<uint32_t>(total_cnt).swap(m_pixel_conv_values);
+    std::vector<RGB>(total_cnt).swap(m_stream_buffer[0]);
+    std::vector<RGB>(total_cnt).swap(m_stream_buffer[1]);
+    xSemaphoreGive(m_stream_mutex);
+    ws2812_dither_seed(m_dither_error.data(), total_cnt);
+
+    // strips are sent in parallel, the longest one sets the frame time
+    uint16_t longest = 0;
+    for (uint8_t i = 0; i < m_strip_cnt; i++) {
+        longest = std::max(longest, m_strips[i].config.pixel_cnt);
+    }
+    uint32_t frame_ms = (ws2812_frame_time_us(longest) + 999) / 1000;
+    m_dither_frame_ms = std::max<uint32_t>(frame_ms, WS2812_DITHER_FRAME_TIME_MS);
+
+    // every strip has its own channel, frames are started back to back and run in parallel
+    for (uint8_t i = 0; i < m_strip_cnt; i++) {
+        WS2812Strip *strip = &m_strips[i];
+        bool initialized;
+        if (ws2812_strip_output(i) == WS2812_OUTPUT_SPI) {
+            strip->output = new CWS2812SpiOutput();
+            initialized = strip->output->initialize(strip->config.gpio_pin_no, WS2812_SPI_HOST, strip->config.pixel_cnt);
+        } else {
+            strip->output = new CWS2812RmtOutput();
+            initialized = strip->output->initialize(strip->config.gpio_pin_no, WS2812_RMT_CHANNEL + i, strip->config.pixel_cnt);
+        }
+        if (!initialized) {
+            GetLogger(eLogType::Error)->Log("Failed to initialize data line output (strip %d)", i);
+            result = false;
+        }
+        GetLogger(eLogType::Info)->Log("strip %d: gpio %d, %d pixels, %s", 
+            i, strip->config.gpio_pin_no, strip->config.pixel_cnt, ws2812_color_order_name(strip->config.color_order));
+
+        if (strip->effect) {
+            strip->effect->resize(strip->config.pixel_cnt);
+        }
+        const uint8_t *value = strip->track_color.get_value();
+        fill_strip(strip, RGB(value[0], value[1], value[2]));
+    }
+    convert_frame();
+
+    if (!configure_pwm(geometry.pwm_pin_no)) {
+        result = false;
+    }
+
+    return result;
+}
+
+bool CWS2812Ctrl::set_geometry(const WS2812Geometry &geometry, bool save_memory/*=true*/)
+{
+    if (!ws2812_validate_geometry(&geometry)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&m_mailbox_lock);
+    m_geometry = geometry;
+    portEXIT_CRITICAL(&m_mailbox_lock);
+    if (save_memory) {
+        GetMemory()->save_ws2812_geometry(&geometry);
+    }
+
+    GetLogger(eLogType::Info)->Log("set geometry (%d strips, pwm gpio %d)", geometry.strip_cnt, geometry.pwm_pin_no);
+
+    // buffers are swapped in the task, payload is taken from m_geometry (latest wins)
+    WS2812Command cmd{};
+    cmd.type = RECONFIGURE;
+    bool result = post_coalesced(cmd);
+    notify_state_changed();
+    return result;
+}
+
+WS2812Geometry CWS2812Ctrl::get_geometry()
+{
+    WS2812Geometry geometry;
+    portENTER_CRITICAL(&m_mailbox_lock);
+    geometry = m_geometry;
+    portEXIT_CRITICAL(&m_mailbox_lock);
+    return geometry;
 }
 
 bool CWS2812Ctrl::set_pwm_duty(uint32_t duty, bool verbose/*=true*/)
@@ -109,124 +309,149 @@ bool CWS2812Ctrl::set_pwm_duty(uint32_t duty, bool verbose/*=true*/)
     }
     
     if (verbose) {
-        GetLogger(eLogType::Info)->Log("set pwm duty: %d", duty);
+        GetLogger(eLogType::Debug)->Log("set pwm duty: %d", duty);
     }
 
     return true;
 }
 
-static void IRAM_ATTR set_databit_low(uint8_t pin_no)
-{
-    // T0H: 220ns ~ 380ns
-    GPIO_REG_WRITE(GPIO_OUT_W1TS_REG, 1UL << pin_no);
-    __asm__ __volatile__(
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;");
-
-    // T0L: 580ns ~ 1us
-    GPIO_REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin_no);
-    __asm__ __volatile__(
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;");
-}
-
-static void IRAM_ATTR set_databit_high(uint8_t pin_no)
-{
-    // T1H: 580ns ~ 1us
-    GPIO_REG_WRITE(GPIO_OUT_W1TS_REG, 1UL << pin_no);
-    __asm__ __volatile__(
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;");
-
-    // T1L: 220ns ~ 420ns
-    GPIO_REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin_no);
-    __asm__ __volatile__(
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;"
-    "nop; nop; nop; nop; nop; nop; nop; nop;");
-}
-
-static uint32_t convert_rgb_to_u32(RGB rgb) 
-{
-    return ((uint32_t)rgb.g) << 16 | ((uint32_t)rgb.r) << 8 | (uint32_t)rgb.b;
-}
-
-bool CWS2812Ctrl::set_pixel_rgb_value(int index, uint8_t red, uint8_t green, uint8_t blue, bool update/*=true*/)
+static bool is_coalesced_command(const WS2812Command &cmd)
 {
-    bool result = true;
-    if (index >= 0 && index < m_pixel_values.size()) {
-        m_pixel_values[index].r = red;
-        m_pixel_values[index].g = green;
-        m_pixel_values[index].b = blue;
-    } else if (index < 0) {
-        for (auto & rgb : m_pixel_values) {
-            rgb.r = red;
-            rgb.g = green;
-            rgb.b = blue;
-        }
-    } else {
-        result = false;
+    // idempotent commands, only the latest one matters (unless queued behind a transition)
+    if (cmd.enqueue)
+        return false;
+    switch (cmd.type) {
+    case CWS2812Ctrl::RECONFIGURE:
+    case CWS2812Ctrl::BRIGHTNESS:
+    case CWS2812Ctrl::COLOR:
+    case CWS2812Ctrl::EFFECT:
+    case CWS2812Ctrl::CALIBRATION:
+    case CWS2812Ctrl::FRAME:
+        return true;
+    default:
+        return false;
     }
+}
 
-    if (result && update) {
-        result = update_color();
+static int mailbox_slot(const WS2812Command &cmd)
+{
+    // slot 0: all strips (and commands without strip), slot n: strip n - 1
+    if (cmd.type != CWS2812Ctrl::COLOR && cmd.type != CWS2812Ctrl::EFFECT)
+        return 0;
+    return cmd.strip < WS2812_MAX_STRIPS ? cmd.strip + 1 : 0;
+}
+
+static uint32_t get_time_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+bool CWS2812Ctrl::post_command(const WS2812Command &cmd)
+{
+    if (!m_queue_command) {
+        return false;
     }
 
-    return result;
+    // never block the caller (http handler), a full queue is reported as drop
+    if (xQueueSend(m_queue_command, (void *)&cmd, 0) != pdTRUE) {
+        m_commands_dropped++;
+        GetLogger(eLogType::Error)->Log("Failed to add command queue (type %d)", cmd.type);
+        return false;
+    }
+    m_commands_posted++;
+
+    return true;
 }
 
-bool CWS2812Ctrl::clear_color()
+bool CWS2812Ctrl::post_coalesced(const WS2812Command &cmd)
 {
-    return set_pixel_rgb_value(-1, 0, 0, 0);
+    return post_batch(&cmd, 1);
 }
 
-bool CWS2812Ctrl::update_color()
+bool CWS2812Ctrl::post_batch(const WS2812Command *cmds, uint8_t cmd_cnt)
 {
-    int *CMD = new int[1];
-    CMD[0] = SETRGB;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+    if (!m_queue_command) {
         return false;
     }
 
+    // latest-wins per (type, strip): payload is kept in the mailbox slot, queue only carries a wake-up token
+    uint32_t replaced_cnt = 0;
+    bool wake = false;
+    portENTER_CRITICAL(&m_mailbox_lock);
+    for (uint8_t i = 0; i < cmd_cnt; i++) {
+        const WS2812Command &cmd = cmds[i];
+        int slot = mailbox_slot(cmd);
+        uint16_t bit = 1U << slot;
+        m_mailbox[cmd.type][slot] = cmd;
+        uint16_t pending = m_mailbox_pending[cmd.type];
+        // a command for all strips also replaces the pending ones for single strips
+        uint16_t replaced = slot == 0 ? pending : (pending & bit);
+        m_mailbox_pending[cmd.type] = (pending & ~replaced) | bit;
+        replaced_cnt += __builtin_popcount(replaced);
+        // pending type: its wake-up token is already in the queue (or being drained)
+        wake = wake || pending == 0;
+    }
+    portEXIT_CRITICAL(&m_mailbox_lock);
+
+    m_commands_coalesced += replaced_cnt;
+    if (!wake) {
+        return true;
+    }
+
+    // one token for the whole batch, the task drains every type on a wake-up
+    // if the queue is full the task is busy and will drain the mailbox on its next wake-up anyway
+    if (xQueueSend(m_queue_command, (void *)&cmds[0], 0) == pdTRUE) {
+        m_commands_posted++;
+    }
+
     return true;
 }
 
-bool CWS2812Ctrl::set_brightness(uint8_t value, bool save_memory/*=true*/,  bool verbose/*=true*/)
+void CWS2812Ctrl::drain_mailbox()
+{
+    WS2812Command slots[WS2812_MAX_STRIPS + 1];
+    uint16_t pending;
+
+    for (int type = 0; type < CMD_TYPE_COUNT; type++) {
+        portENTER_CRITICAL(&m_mailbox_lock);
+        pending = m_mailbox_pending[type];
+        m_mailbox_pending[type] = 0;
+        for (int slot = 0; slot <= WS2812_MAX_STRIPS; slot++) {
+            if (pending & (1U << slot)) {
+                slots[slot] = m_mailbox[type][slot];
+            }
+        }
+        portEXIT_CRITICAL(&m_mailbox_lock);
+
+        // all strips first, then single strips (posted later, otherwise they had been replaced)
+        for (int slot = 0; slot <= WS2812_MAX_STRIPS; slot++) {
+            if (pending & (1U << slot)) {
+                handle_command(slots[slot]);
+            }
+        }
+    }
+}
+
+bool CWS2812Ctrl::set_brightness(uint8_t value, bool save_memory/*=true*/,  bool verbose/*=true*/, uint32_t fade_ms/*=WS2812_FADE_TIME_MS*/, bool enqueue/*=false*/)
 {
     m_brightness = value;
     if (save_memory) {
         GetMemory()->save_ws2812_brightness(value);
     }
 
+    WS2812Command cmd{};
+    cmd.type = BRIGHTNESS;
+    cmd.enqueue = enqueue;
+    cmd.brightness.value = value;
+    cmd.brightness.verbose = verbose;
+    cmd.brightness.fade_ms = fade_ms;
+    bool result = enqueue ? post_command(cmd) : post_coalesced(cmd);
+    notify_state_changed();
+    return result;
+}
+
+bool CWS2812Ctrl::apply_brightness(uint8_t value, bool verbose/*=true*/)
+{
     uint32_t duty = (uint32_t)((double)value / 100. * PWM_DUTY_MAX);
     return set_pwm_duty(duty, verbose);
 }
@@ -236,34 +461,80 @@ uint8_t CWS2812Ctrl::get_brightness()
     return m_brightness;
 }
 
-RGB CWS2812Ctrl::get_common_color()
+uint8_t CWS2812Ctrl::get_strip_count()
 {
-    return m_common_color;
+    // requested geometry, the task may not have applied it yet
+    return m_geometry.strip_cnt;
 }
 
-bool CWS2812Ctrl::set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory/*=true*/)
+bool CWS2812Ctrl::get_strip_config(uint8_t strip, WS2812StripConfig *config)
 {
-    m_common_color.r = red;
-    m_common_color.g = green;
-    m_common_color.b = blue;
-    if (save_memory) {
+    WS2812Geometry geometry = get_geometry();
+    if (strip >= geometry.strip_cnt) {
+        return false;
+    }
+
+    *config = geometry.strips[strip];
+    return true;
+}
+
+RGB CWS2812Ctrl::get_common_color(uint8_t strip/*=0*/)
+{
+    if (strip >= WS2812_MAX_STRIPS) {
+        return RGB();
+    }
+    return m_strips[strip].common_color;
+}
+
+bool CWS2812Ctrl::set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory/*=true*/, uint32_t fade_ms/*=WS2812_FADE_TIME_MS*/, bool enqueue/*=false*/, uint8_t strip/*=WS2812_STRIP_ALL*/)
+{
+    if (strip != WS2812_STRIP_ALL && strip >= get_strip_count()) {
+        GetLogger(eLogType::Error)->Log("invalid strip (%d)", strip);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < get_strip_count(); i++) {
+        if (strip == WS2812_STRIP_ALL || strip == i) {
+            m_strips[i].common_color = RGB(red, green, blue);
+            m_strips[i].effect_id = WS2812_EFFECT_NONE;
+        }
+    }
+    // only the color shared by all strips is persisted
+    if (save_memory && strip == WS2812_STRIP_ALL) {
         GetMemory()->save_ws2812_color(red, green, blue);
     }
 
-    GetLogger(eLogType::Info)->Log("set common color(%d,%d,%d)", red, green, blue);
-    return set_pixel_rgb_value(LED_SET_ALL, red, green, blue, true);
+    if (strip == WS2812_STRIP_ALL) {
+        GetLogger(eLogType::Info)->Log("set common color(%d,%d,%d)", red, green, blue);
+    } else {
+        GetLogger(eLogType::Info)->Log("set strip %d color(%d,%d,%d)", strip, red, green, blue);
+    }
+
+    WS2812Command cmd{};
+    cmd.type = COLOR;
+    cmd.enqueue = enqueue;
+    cmd.strip = strip;
+    cmd.color.r = red;
+    cmd.color.g = green;
+    cmd.color.b = blue;
+    cmd.color.fade_ms = fade_ms;
+    bool result = enqueue ? post_command(cmd) : post_coalesced(cmd);
+    notify_state_changed();
+    return result;
 }
 
-bool CWS2812Ctrl::blink(uint32_t duration_ms/*=1000*/, uint32_t count/*=1*/)
+bool CWS2812Ctrl::blink(uint32_t duration_ms/*=1000*/, uint32_t count/*=1*/, bool enqueue/*=false*/)
 {
-    m_blink_duration_ms = duration_ms;
-    m_blink_count = count;
+    if (count == 0) {
+        return false;
+    }
 
-    int *CMD = new int[1];
-    CMD[0] = BLINK;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+    WS2812Command cmd{};
+    cmd.type = BLINK;
+    cmd.enqueue = enqueue;
+    cmd.blink.duration_ms = duration_ms;
+    cmd.blink.count = count;
+    if (!post_command(cmd)) {
         return false;
     }
 
@@ -271,15 +542,13 @@ bool CWS2812Ctrl::blink(uint32_t duration_ms/*=1000*/, uint32_t count/*=1*/)
     return true;
 }
 
-bool CWS2812Ctrl::blink_demo()
+bool CWS2812Ctrl::blink_demo(bool enqueue/*=false*/)
 {
-    m_blink_count = 10;
-
-    int *CMD = new int[1];
-    CMD[0] = BLINK_DEMO;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+    WS2812Command cmd{};
+    cmd.type = BLINK_DEMO;
+    cmd.enqueue = enqueue;
+    cmd.blink.count = 10;
+    if (!post_command(cmd)) {
         return false;
     }
 
@@ -287,94 +556,684 @@ bool CWS2812Ctrl::blink_demo()
     return true;
 }
 
-void CWS2812Ctrl::func_command(void *param)
+void CWS2812Ctrl::get_stats(WS2812Stats *stats)
 {
-    CWS2812Ctrl *obj = static_cast<CWS2812Ctrl *>(param);
-    int *cmd_type = nullptr;
-    uint8_t brightness;
-    uint32_t delay;
-    bool blink_demo = false;
+    stats->frames_sent = m_frames_sent;
+    stats->frames_skipped = m_frames_skipped;
+    stats->frames_dithered = m_frames_dithered;
+    stats->frames_streamed = m_frames_streamed;
+    stats->frame_generation = m_frame_generation;
+    stats->queue_depth = m_queue_command ? uxQueueMessagesWaiting(m_queue_command) : 0;
+    stats->commands_posted = m_commands_posted;
+    stats->commands_coalesced = m_commands_coalesced;
+    stats->commands_dropped = m_commands_dropped;
+}
 
-    GetLogger(eLogType::Info)->Log("Realtime Task for WS2812 Module Started");
-    while (obj->m_task_keepalive) {
-        if (xQueueReceive(obj->m_queue_command, (void *)&cmd_type, pdMS_TO_TICKS(WS2812_REFRESH_TIME_MS)) == pdTRUE) {
-            if (*cmd_type == SETRGB) {
-                for (size_t i = 0; i < obj->m_pixel_values.size(); i++) {
-                    RGB rgb = obj->m_pixel_values[i];
-                    obj->m_pixel_conv_values[i] = convert_rgb_to_u32(rgb);
-                }
-            } else if (*cmd_type == BLINK) {
-                delay = obj->m_blink_duration_ms / 42;
-                brightness = obj->get_brightness();
-
-                for (uint32_t i = 0; i < obj->m_blink_count; i++) {
-                    for (int v = 0; v <= 100; v+=5) {
-                        obj->set_brightness(v, false, false);
-                        vTaskDelay(pdMS_TO_TICKS(delay));
-                    }
-                    for (int v = 100; v >= 0; v-=5) {
-                        obj->set_brightness(v, false, false);
-                        vTaskDelay(pdMS_TO_TICKS(delay));
-                    }
-                }
+bool CWS2812Ctrl::set_effect(uint8_t effect, const WS2812EffectParam &param, uint8_t strip/*=WS2812_STRIP_ALL*/)
+{
+    if (effect >= WS2812_EFFECT_COUNT) {
+        GetLogger(eLogType::Error)->Log("invalid effect (%d)", effect);
+        return false;
+    }
+    if (strip != WS2812_STRIP_ALL && strip >= get_strip_count()) {
+        GetLogger(eLogType::Error)->Log("invalid strip (%d)", strip);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < get_strip_count(); i++) {
+        if (strip == WS2812_STRIP_ALL || strip == i) {
+            m_strips[i].effect_id = effect;
+            m_strips[i].effect_param = param;
+        }
+    }
 
-                obj->set_brightness(brightness, false, false);
-            } else if (*cmd_type == BLINK_DEMO) {
-                blink_demo = true;
+    WS2812Command cmd{};
+    cmd.type = EFFECT;
+    cmd.strip = strip;
+    cmd.effect.id = effect;
+    cmd.effect.speed = param.speed;
+    cmd.effect.size = param.size;
+    cmd.effect.r = param.color.r;
+    cmd.effect.g = param.color.g;
+    cmd.effect.b = param.color.b;
+
+    GetLogger(eLogType::Info)->Log("set effect %s (speed %d, size %d)", ws2812_effect_name(effect), param.speed, param.size);
+    bool result = post_coalesced(cmd);
+    notify_state_changed();
+    return result;
+}
+
+uint8_t CWS2812Ctrl::get_effect(WS2812EffectParam *param/*=nullptr*/, uint8_t strip/*=0*/)
+{
+    if (strip >= WS2812_MAX_STRIPS) {
+        return WS2812_EFFECT_NONE;
+    }
+    if (param) {
+        *param = m_strips[strip].effect_param;
+    }
+    return m_strips[strip].effect_id;
+}
+
+bool CWS2812Ctrl::set_calibration(const WS2812Calibration &cal, bool save_memory/*=true*/)
+{
+    if (cal.gamma_x100 < WS2812_GAMMA_X100_MIN || cal.gamma_x100 > WS2812_GAMMA_X100_MAX) {
+        GetLogger(eLogType::Error)->Log("invalid gamma (%d)", cal.gamma_x100);
+        return false;
+    }
+
+    m_calibration = cal;
+    if (save_memory) {
+        GetMemory()->save_ws2812_calibration(&cal);
+    }
+
+    GetLogger(eLogType::Info)->Log("set calibration gamma %d.%02d, white balance (%d,%d,%d)", 
+        cal.gamma_x100 / 100, cal.gamma_x100 % 100, cal.white_balance[0], cal.white_balance[1], cal.white_balance[2]);
+
+    // table is rebuilt in the task so that the pixel path never sees a half written lut
+    WS2812Command cmd{};
+    cmd.type = CALIBRATION;
+    cmd.calibration = cal;
+    bool result = post_coalesced(cmd);
+    notify_state_changed();
+    return result;
+}
+
+WS2812Calibration CWS2812Ctrl::get_calibration()
+{
+    return m_calibration;
+}
+
+bool CWS2812Ctrl::validate_update(const WS2812Update &update)
+{
+    if (update.strip != WS2812_STRIP_ALL && update.strip >= get_strip_count()) {
+        GetLogger(eLogType::Error)->Log("invalid strip (%d)", update.strip);
+        return false;
+    }
+    if ((update.fields & WS2812_UPDATE_EFFECT) && update.effect >= WS2812_EFFECT_COUNT) {
+        GetLogger(eLogType::Error)->Log("invalid effect (%d)", update.effect);
+        return false;
+    }
+    if ((update.fields & (WS2812_UPDATE_EFFECT | WS2812_UPDATE_PIXELS)) && update.enqueue) {
+        GetLogger(eLogType::Error)->Log("effect and pixels can not be enqueued");
+        return false;
+    }
+    if (!(update.fields & WS2812_UPDATE_PIXELS)) {
+        return true;
+    }
+    if (update.fields & WS2812_UPDATE_EFFECT) {
+        GetLogger(eLogType::Error)->Log("pixel ranges stop effects, both requested");
+        return false;
+    }
+    if (update.range_cnt > WS2812_UPDATE_MAX_RANGES) {
+        GetLogger(eLogType::Error)->Log("too many pixel ranges (%d)", update.range_cnt);
+        return false;
+    }
+    for (uint8_t i = 0; i < update.range_cnt; i++) {
+        const WS2812PixelRange *range = &update.ranges[i];
+        if (range->length == 0 || (size_t)range->offset + range->length > get_pixel_count()) {
+            GetLogger(eLogType::Error)->Log("invalid pixel range (%d + %d)", range->offset, range->length);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CWS2812Ctrl::write_update_frame(const WS2812Update &update)
+{
+    if (xSemaphoreTake(m_stream_mutex, pdMS_TO_TICKS(WS2812_STREAM_LOCK_MS)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("frame buffer is busy");
+        return false;
+    }
+
+    // current frame as base (may be torn if an effect is running, it is stopped by the frame anyway)
+    size_t total_cnt = m_stream_buffer[0].size();
+    RGB *back = m_stream_buffer[m_stream_front ^ 1].data();
+    memcpy(back, m_pixel_values.data(), total_cnt * sizeof(RGB));
+    if (update.frame) {
+        // stored for another geometry: the overlapping part is taken
+        memcpy(back, update.frame, std::min<size_t>(total_cnt, update.frame_pixel_cnt) * sizeof(RGB));
+    }
+    if (update.fields & WS2812_UPDATE_COLOR) {
+        for (uint8_t i = 0; i < m_strip_cnt; i++) {
+            const WS2812Strip *strip = &m_strips[i];
+            if ((update.strip == WS2812_STRIP_ALL || update.strip == i) && strip->offset + strip->config.pixel_cnt <= total_cnt) {
+                std::fill(back + strip->offset, back + strip->offset + strip->config.pixel_cnt, update.color);
             }
         }
+    }
+    for (uint8_t i = 0; i < update.range_cnt; i++) {
+        const WS2812PixelRange *range = &update.ranges[i];
+        if ((size_t)range->offset + range->length <= total_cnt) {
+            std::fill(back + range->offset, back + range->offset + range->length, RGB(range->rgb[0], range->rgb[1], range->rgb[2]));
+        }
+    }
+
+    portENTER_CRITICAL(&m_stream_lock);
+    m_stream_front ^= 1;
+    portEXIT_CRITICAL(&m_stream_lock);
+    xSemaphoreGive(m_stream_mutex);
+
+    return true;
+}
+
+bool CWS2812Ctrl::apply_update(const WS2812Update &update)
+{
+    if (!validate_update(update)) {
+        return false;
+    }
+
+    // requested state (getters, state response), the task applies it on the next wake-up
+    if (update.fields & WS2812_UPDATE_BRIGHTNESS) {
+        m_brightness = update.brightness;
+    }
+    for (uint8_t i = 0; i < get_strip_count(); i++) {
+        if (update.strip != WS2812_STRIP_ALL && update.strip != i) {
+            continue;
+        }
+        if (update.fields & WS2812_UPDATE_COLOR) {
+            m_strips[i].common_color = update.color;
+            m_strips[i].effect_id = WS2812_EFFECT_NONE;
+        }
+        if (update.fields & WS2812_UPDATE_EFFECT) {
+            m_strips[i].effect_id = update.effect;
+            m_strips[i].effect_param = update.effect_param;
+        }
+    }
+    if (update.fields & WS2812_UPDATE_PIXELS) {
+        for (uint8_t i = 0; i < get_strip_count(); i++) {
+            m_strips[i].effect_id = WS2812_EFFECT_NONE;
+        }
+    }
+
+    // only the color shared by all strips is persisted, both values go with one commit
+    if (update.save_memory) {
+        bool save_color = (update.fields & WS2812_UPDATE_COLOR) && update.strip == WS2812_STRIP_ALL;
+        if ((update.fields & WS2812_UPDATE_BRIGHTNESS) || save_color) {
+            GetMemory()->save_ws2812_light((update.fields & WS2812_UPDATE_BRIGHTNESS) ? &update.brightness : nullptr,
+                save_color ? &update.color : nullptr);
+        }
+    }
 
-        for (auto & value : obj->m_pixel_conv_values) {
-            for (uint8_t i = 0; i < 24; i++) {
-                if (value & (1UL << (23 - i)))
-                    set_databit_high(obj->m_gpio_pin_no);
-                else
-                    set_databit_low(obj->m_gpio_pin_no);
+    bool result;
+    if (update.enqueue) {
+        // single queue item, both transitions are started by the same wake-up
+        WS2812Command cmd{};
+        cmd.type = UPDATE;
+        cmd.enqueue = true;
+        cmd.strip = update.strip;
+        cmd.update.fields = update.fields & (WS2812_UPDATE_BRIGHTNESS | WS2812_UPDATE_COLOR);
+        cmd.update.brightness = update.brightness;
+        cmd.update.r = update.color.r;
+        cmd.update.g = update.color.g;
+        cmd.update.b = update.color.b;
+        cmd.update.fade_ms = update.fade_ms;
+        result = cmd.update.fields == 0 || post_command(cmd);
+    } else {
+        WS2812Command cmds[3]{};
+        uint8_t cmd_cnt = 0;
+        if (update.fields & WS2812_UPDATE_BRIGHTNESS) {
+            WS2812Command *cmd = &cmds[cmd_cnt++];
+            cmd->type = BRIGHTNESS;
+            cmd->brightness.value = update.brightness;
+            cmd->brightness.verbose = true;
+            cmd->brightness.fade_ms = update.fade_ms;
+        }
+        if (update.fields & WS2812_UPDATE_PIXELS) {
+            // color is painted into the frame
+            if (!write_update_frame(update)) {
+                return false;
             }
+            cmds[cmd_cnt++].type = FRAME;
+        } else if (update.fields & WS2812_UPDATE_COLOR) {
+            WS2812Command *cmd = &cmds[cmd_cnt++];
+            cmd->type = COLOR;
+            cmd->strip = update.strip;
+            cmd->color.r = update.color.r;
+            cmd->color.g = update.color.g;
+            cmd->color.b = update.color.b;
+            cmd->color.fade_ms = update.fade_ms;
         }
-        
-        if (blink_demo) {
-            if (obj->m_blink_count > 0) {
-                RGB rgb;
-                uint32_t rm = obj->m_blink_count % 8;
-                if (rm == 0) {
-                    rgb = RGB(255, 0, 0);
-                } else if (rm == 1) {
-                    rgb = RGB(0, 255, 0);
-                } else if (rm == 2) {
-                    rgb = RGB(0, 0, 255);
-                } else if (rm == 3) {
-                    rgb = RGB(255, 255, 0);
-                } else if (rm == 4) {
-                    rgb = RGB(255, 0, 255);
-                } else if (rm == 5) {
-                    rgb = RGB(0, 255, 255);
-                } else if (rm == 6) {
-                    rgb = RGB(255, 70, 0);
-                } else if (rm == 7) {
-                    rgb = RGB(0, 128, 0);
-                } else {
-                    rgb = RGB(255, 255, 255);
-                }
+        if (update.fields & WS2812_UPDATE_EFFECT) {
+            WS2812Command *cmd = &cmds[cmd_cnt++];
+            cmd->type = EFFECT;
+            cmd->strip = update.strip;
+            cmd->effect.id = update.effect;
+            cmd->effect.speed = update.effect_param.speed;
+            cmd->effect.size = update.effect_param.size;
+            cmd->effect.r = update.effect_param.color.r;
+            cmd->effect.g = update.effect_param.color.g;
+            cmd->effect.b = update.effect_param.color.b;
+        }
+        result = cmd_cnt == 0 || post_batch(cmds, cmd_cnt);
+    }
 
-                for (size_t i = 0; i < obj->m_pixel_values.size(); i++) {
-                    obj->m_pixel_conv_values[i] = convert_rgb_to_u32(rgb);
-                }
+    GetLogger(eLogType::Info)->Log("batch update (fields 0x%02x, strip %d, %d ranges)", update.fields, update.strip, 
+        (update.fields & WS2812_UPDATE_PIXELS) ? update.range_cnt : 0);
+    notify_state_changed();
+    return result;
+}
 
-                delay = 25;
-                for (int v = 0; v <= 100; v+=5) {
-                    obj->set_brightness(v, false, false);
-                    vTaskDelay(pdMS_TO_TICKS(delay));
-                }
-                for (int v = 100; v >= 0; v-=5) {
-                    obj->set_brightness(v, false, false);
-                    vTaskDelay(pdMS_TO_TICKS(delay));
-                }
+void CWS2812Ctrl::set_state_listener(WS2812StateListener listener, void *ctx)
+{
+    m_state_listener_ctx = ctx;
+    m_state_listener = listener;
+}
+
+uint32_t CWS2812Ctrl::get_state_version()
+{
+    return m_state_version;
+}
+
+void CWS2812Ctrl::notify_state_changed()
+{
+    m_state_version++;
+    if (m_state_listener) {
+        m_state_listener(m_state_listener_ctx);
+    }
+}
+
+size_t CWS2812Ctrl::get_pixel_count()
+{
+    return m_pixel_values.size();
+}
+
+RGB* CWS2812Ctrl::begin_frame_write(uint16_t offset, uint16_t pixel_cnt)
+{
+    if (xSemaphoreTake(m_stream_mutex, pdMS_TO_TICKS(WS2812_STREAM_LOCK_MS)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("frame buffer is busy");
+        return nullptr;
+    }
+
+    size_t total_cnt = m_stream_buffer[0].size();
+    if (pixel_cnt == 0 || (size_t)offset + pixel_cnt > total_cnt) {
+        GetLogger(eLogType::Error)->Log("invalid frame range (%d + %d > %d)", offset, pixel_cnt, total_cnt);
+        xSemaphoreGive(m_stream_mutex);
+        return nullptr;
+    }
+
+    // only the writer swaps, so the front index is stable while the mutex is held
+    RGB *back = m_stream_buffer[m_stream_front ^ 1].data();
+    if (pixel_cnt != total_cnt) {
+        // partial update on top of the last pushed frame
+        memcpy(back, m_stream_buffer[m_stream_front].data(), total_cnt * sizeof(RGB));
+    }
+
+    return back + offset;
+}
+
+bool CWS2812Ctrl::end_frame_write(bool commit)
+{
+    bool result = true;
+    if (commit) {
+        portENTER_CRITICAL(&m_stream_lock);
+        m_stream_front ^= 1;
+        portEXIT_CRITICAL(&m_stream_lock);
+        m_frames_streamed++;
+
+        WS2812Command cmd{};
+        cmd.type = FRAME;
+        result = post_coalesced(cmd);
+    }
+    xSemaphoreGive(m_stream_mutex);
+
+    return result;
+}
+
+bool CWS2812Ctrl::write_frame(uint16_t offset, const RGB *pixels, uint16_t pixel_cnt)
+{
+    RGB *dst = begin_frame_write(offset, pixel_cnt);
+    if (!dst) {
+        return false;
+    }
+    memcpy(dst, pixels, pixel_cnt * sizeof(RGB));
+    return end_frame_write(true);
+}
 
-                obj->m_blink_count--;
-            } else {
-                blink_demo = false;
+size_t CWS2812Ctrl::read_frame(RGB *pixels, size_t max_cnt, size_t offset/*=0*/)
+{
+    if (xSemaphoreTake(m_stream_mutex, pdMS_TO_TICKS(WS2812_STREAM_LOCK_MS)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("frame buffer is busy");
+        return 0;
+    }
+
+    // frame as rendered (before correction), may be torn if an effect is running
+    size_t pixel_cnt = offset < m_pixel_values.size() ? std::min(m_pixel_values.size() - offset, max_cnt) : 0;
+    memcpy(pixels, m_pixel_values.data() + offset, pixel_cnt * sizeof(RGB));
+    xSemaphoreGive(m_stream_mutex);
+
+    return pixel_cnt;
+}
+
+void CWS2812Ctrl::convert_frame()
+{
+    ws2812_correct_pixels(m_pixel_values.data(), m_pixel_values.size(), &m_correction, m_pixel_linear.data());
+    if (!m_dither) {
+        // with dithering the output words are produced per transmitted frame (refresh_frame)
+        for (uint8_t i = 0; i < m_strip_cnt; i++) {
+            const WS2812Strip *strip = &m_strips[i];
+            ws2812_quantize_pixels(&m_pixel_linear[strip->offset * 3], strip->config.pixel_cnt, 
+                strip->config.color_order, &m_pixel_conv_values[strip->offset]);
+        }
+    }
+    m_frame_generation++;
+}
+
+void CWS2812Ctrl::fill_strip(WS2812Strip *strip, RGB rgb)
+{
+    RGB *pixels = &m_pixel_values[strip->offset];
+    for (uint16_t i = 0; i < strip->config.pixel_cnt; i++) {
+        pixels[i] = rgb;
+    }
+}
+
+void CWS2812Ctrl::set_strip_effect(WS2812Strip *strip, uint8_t effect_id, const WS2812EffectParam &param)
+{
+    if (effect_id == WS2812_EFFECT_NONE) {
+        if (strip->effect_running) {
+            // effect off: back to common color
+            uint8_t value[3] = {strip->common_color.r, strip->common_color.g, strip->common_color.b};
+            strip->track_color.reset(value, 3);
+            fill_strip(strip, strip->common_color);
+            strip->effect_running = false;
+        }
+        return;
+    }
+
+    if (!strip->effect || strip->effect_type != effect_id) {
+        // per-pixel effect state is allocated when the effect type changes, never per frame
+        if (strip->effect) {
+            delete strip->effect;
+        }
+        strip->effect = ws2812_create_effect(effect_id);
+        strip->effect_type = effect_id;
+        if (!strip->effect) {
+            // no implementation for this id: the effect is not shown, so it is not reported either
+            GetLogger(eLogType::Error)->Log("effect %s is not available", ws2812_effect_name(effect_id));
+            strip->effect_type = WS2812_EFFECT_NONE;
+            strip->effect_running = false;
+            strip->effect_id = WS2812_EFFECT_NONE;
+            notify_state_changed();
+            return;
+        }
+        strip->effect->resize(strip->config.pixel_cnt);
+    }
+
+    strip->effect->set_param(param);
+    strip->track_color.stop();
+    strip->effect_running = true;
+}
+
+bool CWS2812Ctrl::advance_timeline(uint32_t now_ms)
+{
+    bool active = false;
+    bool changed = false;
+
+    if (m_track_brightness.advance(now_ms)) {
+        apply_brightness(m_track_brightness.get_value()[0], false);
+    }
+    active = m_track_brightness.is_active();
+
+    for (uint8_t i = 0; i < m_strip_cnt; i++) {
+        WS2812Strip *strip = &m_strips[i];
+        if (strip->track_color.advance(now_ms)) {
+            const uint8_t *value = strip->track_color.get_value();
+            fill_strip(strip, RGB(value[0], value[1], value[2]));
+            changed = true;
+        }
+
+        if (strip->effect_running) {
+            strip->effect->render(&m_pixel_values[strip->offset], strip->config.pixel_cnt, now_ms);
+            changed = true;
+        }
+
+        active = active || strip->track_color.is_active() || strip->effect_running;
+    }
+
+    // one conversion pass for all strips
+    if (changed) {
+        convert_frame();
+    }
+
+    return active;
+}
+
+bool CWS2812Ctrl::refresh_frame()
+{
+    bool result = true;
+    bool residual = false;
+
+    // a static frame is dithered for a while only, then sent rounded (fractions stop changing)
+    if (m_sent_generation != m_frame_generation) {
+        m_dither_static = 0;
+    } else if (m_dither_static < WS2812_DITHER_SETTLE_FRAMES) {
+        m_dither_static++;
+    }
+    bool dither = m_dither && m_dither_static < WS2812_DITHER_SETTLE_FRAMES;
+    m_sent_generation = m_frame_generation;
+    // transmit() only waits for the previous frame of the same channel, so all strips
+    // are clocked out in parallel and the frame takes as long as the longest strip
+    for (uint8_t i = 0; i < m_strip_cnt; i++) {
+        WS2812Strip *strip = &m_strips[i];
+        uint32_t *words = &m_pixel_conv_values[strip->offset];
+        if (dither) {
+            residual |= ws2812_dither_pixels(&m_pixel_linear[strip->offset * 3], strip->config.pixel_cnt, 
+                strip->config.color_order, &m_dither_error[strip->offset * 3], words);
+        } else if (m_dither) {
+            ws2812_quantize_pixels(&m_pixel_linear[strip->offset * 3], strip->config.pixel_cnt, 
+                strip->config.color_order, words);
+        }
+        if (!strip->output->transmit(words, strip->config.pixel_cnt)) {
+            result = false;
+        }
+    }
+    m_dither_residual = residual;
+    if (!result) {
+        return false;
+    }
+    m_frames_sent++;
+    // frames before the led phase are the cleared strips of initialize()
+    if (!boot_timeline_reached(BOOT_PHASE_FIRST_LIGHT) && boot_timeline_reached(BOOT_PHASE_LEDS)) {
+        boot_timeline_mark(BOOT_PHASE_FIRST_LIGHT);
+    }
+
+    return true;
+}
+
+void CWS2812Ctrl::handle_command(const WS2812Command &cmd)
+{
+    static const RGB demo_colors[8] = {
+        RGB(255, 0, 0), RGB(0, 255, 0), RGB(0, 0, 255), RGB(255, 255, 0),
+        RGB(255, 0, 255), RGB(0, 255, 255), RGB(255, 70, 0), RGB(0, 128, 0)
+    };
+    WS2812Sequence seq;
+    uint32_t now_ms = get_time_ms();
+    uint8_t value[3];
+    uint8_t first = 0, last = m_strip_cnt;     // target strips [first, last)
+
+    if (cmd.strip != WS2812_STRIP_ALL && (cmd.type == COLOR || cmd.type == EFFECT)) {
+        if (cmd.strip >= m_strip_cnt) {
+            // strip removed by a geometry change in between
+            return;
+        }
+        first = cmd.strip;
+        last = first + 1;
+    }
+
+    if (cmd.type == RECONFIGURE) {
+        WS2812Geometry geometry = get_geometry();
+        apply_geometry(geometry);
+    } else if (cmd.type == FRAME) {
+        // pushed frame replaces color tracks and effects until the next color/effect command
+        bool stopped = false;
+        for (uint8_t i = 0; i < m_strip_cnt; i++) {
+            WS2812Strip *strip = &m_strips[i];
+            stopped = stopped || strip->track_color.is_active() || strip->effect_running || strip->effect_id != WS2812_EFFECT_NONE;
+            strip->track_color.stop();
+            strip->effect_running = false;
+            strip->effect_id = WS2812_EFFECT_NONE;
+        }
+        portENTER_CRITICAL(&m_stream_lock);
+        memcpy(m_pixel_values.data(), m_stream_buffer[m_stream_front].data(), m_pixel_values.size() * sizeof(RGB));
+        portEXIT_CRITICAL(&m_stream_lock);
+        convert_frame();
+        // streamed frames notify only when they take over, not per frame
+        if (stopped) {
+            notify_state_changed();
+        }
+    } else if (cmd.type == BRIGHTNESS) {
+        value[0] = cmd.brightness.value;
+        ws2812_sequence_init(&seq, 1);
+        ws2812_sequence_add(&seq, cmd.brightness.fade_ms, WS2812_EASE_IN_OUT, value, 1);
+        m_track_brightness.play(&seq, now_ms, cmd.enqueue);
+        if (cmd.brightness.verbose) {
+            GetLogger(eLogType::Info)->Log("brightness transition to %d (%d ms)", value[0], cmd.brightness.fade_ms);
+        }
+    } else if (cmd.type == COLOR) {
+        value[0] = cmd.color.r;
+        value[1] = cmd.color.g;
+        value[2] = cmd.color.b;
+        ws2812_sequence_init(&seq, 1);
+        ws2812_sequence_add(&seq, cmd.color.fade_ms, WS2812_EASE_IN_OUT, value, 3);
+        for (uint8_t i = first; i < last; i++) {
+            m_strips[i].effect_running = false;
+            m_strips[i].track_color.play(&seq, now_ms, cmd.enqueue);
+        }
+    } else if (cmd.type == CALIBRATION) {
+        ws2812_build_correction(&m_correction, &cmd.calibration);
+        m_dither = cmd.calibration.dither;
+        m_dither_residual = false;
+        m_dither_static = 0;
+        convert_frame();
+    } else if (cmd.type == EFFECT) {
+        WS2812EffectParam param;
+        param.speed = cmd.effect.speed;
+        param.size = cmd.effect.size;
+        param.color = RGB(cmd.effect.r, cmd.effect.g, cmd.effect.b);
+        for (uint8_t i = first; i < last; i++) {
+            set_strip_effect(&m_strips[i], cmd.effect.id, param);
+        }
+        convert_frame();
+    } else if (cmd.type == UPDATE) {
+        WS2812Command sub{};
+        sub.enqueue = cmd.enqueue;
+        sub.strip = cmd.strip;
+        if (cmd.update.fields & WS2812_UPDATE_BRIGHTNESS) {
+            sub.type = BRIGHTNESS;
+            sub.brightness.value = cmd.update.brightness;
+            sub.brightness.verbose = true;
+            sub.brightness.fade_ms = cmd.update.fade_ms;
+            handle_command(sub);
+        }
+        if (cmd.update.fields & WS2812_UPDATE_COLOR) {
+            sub.type = COLOR;
+            sub.color.r = cmd.update.r;
+            sub.color.g = cmd.update.g;
+            sub.color.b = cmd.update.b;
+            sub.color.fade_ms = cmd.update.fade_ms;
+            handle_command(sub);
+        }
+    } else if (cmd.type == BLINK) {
+        uint32_t half = cmd.blink.duration_ms / 2;
+        uint16_t repeat = cmd.blink.count > 0xFFFF ? 0xFFFF : (uint16_t)cmd.blink.count;
+
+        ws2812_sequence_init(&seq, repeat);
+        value[0] = 100;
+        ws2812_sequence_add(&seq, half, WS2812_EASE_IN_OUT, value, 1);
+        value[0] = 0;
+        ws2812_sequence_add(&seq, half, WS2812_EASE_IN_OUT, value, 1);
+        m_track_brightness.play(&seq, now_ms, cmd.enqueue);
+
+        // back to the configured brightness afterwards
+        ws2812_sequence_init(&seq, 1);
+        value[0] = m_brightness;
+        ws2812_sequence_add(&seq, WS2812_FADE_TIME_MS, WS2812_EASE_IN_OUT, value, 1);
+        m_track_brightness.play(&seq, now_ms, true);
+    } else if (cmd.type == BLINK_DEMO) {
+        uint32_t count = cmd.blink.count;
+        if (count > WS2812_TIMELINE_MAX_KEYFRAMES) {
+            count = WS2812_TIMELINE_MAX_KEYFRAMES;
+        }
+
+        // one color per brightness pulse
+        ws2812_sequence_init(&seq, 1);
+        for (uint32_t i = count; i > 0; i--) {
+            RGB rgb = demo_colors[i % 8];
+            value[0] = rgb.r;
+            value[1] = rgb.g;
+            value[2] = rgb.b;
+            ws2812_sequence_add(&seq, WS2812_DEMO_PULSE_MS, WS2812_EASE_STEP, value, 3);
+        }
+        for (uint8_t i = 0; i < m_strip_cnt; i++) {
+            m_strips[i].track_color.play(&seq, now_ms, cmd.enqueue);
+        }
+
+        for (uint8_t i = 0; i < m_strip_cnt; i++) {
+            WS2812Strip *strip = &m_strips[i];
+            ws2812_sequence_init(&seq, 1);
+            value[0] = strip->common_color.r;
+            value[1] = strip->common_color.g;
+            value[2] = strip->common_color.b;
+            ws2812_sequence_add(&seq, WS2812_FADE_TIME_MS, WS2812_EASE_IN_OUT, value, 3);
+            strip->track_color.play(&seq, now_ms, true);
+        }
+
+        ws2812_sequence_init(&seq, (uint16_t)count);
+        value[0] = 100;
+        ws2812_sequence_add(&seq, WS2812_DEMO_PULSE_MS / 2, WS2812_EASE_LINEAR, value, 1);
+        value[0] = 0;
+        ws2812_sequence_add(&seq, WS2812_DEMO_PULSE_MS / 2, WS2812_EASE_LINEAR, value, 1);
+        m_track_brightness.play(&seq, now_ms, cmd.enqueue);
+
+        ws2812_sequence_init(&seq, 1);
+        value[0] = m_brightness;
+        ws2812_sequence_add(&seq, WS2812_FADE_TIME_MS, WS2812_EASE_IN_OUT, value, 1);
+        m_track_brightness.play(&seq, now_ms, true);
+    }
+}
+
+void CWS2812Ctrl::func_command(void *param)
+{
+    CWS2812Ctrl *obj = static_cast<CWS2812Ctrl *>(param);
+    WS2812Command cmd{};
+    bool animating = false;
+
+    GetLogger(eLogType::Info)->Log("Realtime Task for WS2812 Module Started");
+    while (obj->m_task_keepalive) {
+        // static frame: sleep until next command (or keepalive refresh)
+        TickType_t wait_ticks = portMAX_DELAY;
+        bool idle = false;
+        bool dithering = obj->m_dither && obj->m_dither_residual;
+        if (obj->m_frame_generation != obj->m_sent_generation) {
+            wait_ticks = 0;
+        } else if (dithering) {
+            wait_ticks = pdMS_TO_TICKS(obj->m_dither_frame_ms);
+        } else if (animating) {
+            wait_ticks = pdMS_TO_TICKS(WS2812_FRAME_TIME_MS);
+        } else if (WS2812_KEEPALIVE_MS > 0) {
+            wait_ticks = pdMS_TO_TICKS(WS2812_KEEPALIVE_MS);
+            idle = true;
+        }
+
+        bool keepalive = false;
+        if (xQueueReceive(obj->m_queue_command, (void *)&cmd, wait_ticks) == pdTRUE) {
+            // coalesced commands only carry a wake-up token, payload is taken from the mailbox
+            if (!is_coalesced_command(cmd)) {
+                obj->handle_command(cmd);
             }
+            obj->drain_mailbox();
+        } else {
+            keepalive = idle;
+        }
+
+        animating = obj->advance_timeline(get_time_ms());
+
+        if (keepalive || obj->m_frame_generation != obj->m_sent_generation) {
+            obj->refresh_frame();
+        } else if (dithering) {
+            obj->refresh_frame();
+            obj->m_frames_dithered++;
+        } else {
+            obj->m_frames_skipped++;
         }
     }
 
@@ -0,0 +1,267 @@
+/**
+ * @file ws2812_color.cpp
+ * @author yogyui
+ * @brief fixed point color math for pixel effects and output correction (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_color.h"
+#include <math.h>
+#include <strings.h>
+
+struct Sin8Lut {
+    uint8_t v[256];
+};
+
+static constexpr double PI = 3.14159265358979323846;
+
+static constexpr double const_sin(double x)
+{
+    // x in [-pi, pi], taylor series
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr Sin8Lut make_sin8_lut()
+{
+    Sin8Lut lut{};
+    for (int i = 0; i < 256; i++) {
+        double x = 2. * PI * i / 256.;
+        if (x > PI)
+            x -= 2. * PI;
+        double v = 128. + 127. * const_sin(x);
+        lut.v[i] = (uint8_t)(v + 0.5);
+    }
+    return lut;
+}
+
+static constexpr Sin8Lut sin8_lut = make_sin8_lut();
+static_assert(sin8_lut.v[0] == 128 && sin8_lut.v[64] == 255 && sin8_lut.v[192] == 1, "invalid sine lut");
+
+static constexpr double const_ln(double x)
+{
+    // x = m * 2^k (0.5 <= m < 1), ln(m) = 2 * atanh((m - 1) / (m + 1))
+    int k = 0;
+    while (x < 0.5) {
+        x *= 2.;
+        k--;
+    }
+    while (x >= 1.) {
+        x /= 2.;
+        k++;
+    }
+    double z = (x - 1.) / (x + 1.);
+    double z2 = z * z, term = z, sum = 0.;
+    for (int n = 1; n < 40; n += 2) {
+        sum += term / n;
+        term *= z2;
+    }
+    return 2. * sum + k * 0.69314718055994530942;
+}
+
+static constexpr double const_exp(double y)
+{
+    // exp(y) = exp(y / 2^n)^(2^n)
+    int n = 0;
+    while (y < -0.5 || y > 0.5) {
+        y /= 2.;
+        n++;
+    }
+    double term = 1., sum = 1.;
+    for (int i = 1; i < 20; i++) {
+        term *= y / i;
+        sum += term;
+    }
+    while (n-- > 0) {
+        sum *= sum;
+    }
+    return sum;
+}
+
+static constexpr uint16_t const_gamma(int value, double gamma, int full_scale)
+{
+    if (value <= 0)
+        return 0;
+    double v = const_exp(gamma * const_ln(value / 255.)) * full_scale * 256.;
+    return (uint16_t)(v + 0.5);
+}
+
+static constexpr WS2812Correction make_default_correction()
+{
+    WS2812Correction corr{};
+    for (int i = 0; i < 256; i++) {
+        uint16_t v = const_gamma(i, WS2812_DEFAULT_GAMMA_X100 / 100., 255);
+        corr.lut[0][i] = v;
+        corr.lut[1][i] = v;
+        corr.lut[2][i] = v;
+    }
+    return corr;
+}
+
+static constexpr WS2812Correction default_correction = make_default_correction();
+static_assert(default_correction.lut[0][0] == 0 && default_correction.lut[0][255] == 255 * 256, "invalid gamma lut");
+
+uint8_t ws2812_sin8(uint8_t theta)
+{
+    return sin8_lut.v[theta];
+}
+
+RGB ws2812_hsv_to_rgb(uint8_t hue, uint8_t sat, uint8_t val)
+{
+    if (sat == 0) {
+        return RGB(val, val, val);
+    }
+
+    // 6 regions of 43 steps
+    uint8_t region = hue / 43;
+    uint8_t remainder = (uint8_t)((hue - region * 43) * 6);
+
+    uint8_t p = (uint8_t)((val * (255 - sat)) >> 8);
+    uint8_t q = (uint8_t)((val * (255 - ((sat * remainder) >> 8))) >> 8);
+    uint8_t t = (uint8_t)((val * (255 - ((sat * (255 - remainder)) >> 8))) >> 8);
+
+    switch (region) {
+    case 0:
+        return RGB(val, t, p);
+    case 1:
+        return RGB(q, val, p);
+    case 2:
+        return RGB(p, val, t);
+    case 3:
+        return RGB(p, q, val);
+    case 4:
+        return RGB(t, p, val);
+    default:
+        return RGB(val, p, q);
+    }
+}
+
+WS2812Calibration ws2812_default_calibration()
+{
+    WS2812Calibration cal;
+    cal.gamma_x100 = WS2812_DEFAULT_GAMMA_X100;
+    cal.white_balance[0] = 255;
+    cal.white_balance[1] = 255;
+    cal.white_balance[2] = 255;
+    cal.dither = false;         // optional, keeps the led task refreshing while fractions are shown
+    return cal;
+}
+
+const WS2812Correction* ws2812_default_correction()
+{
+    return &default_correction;
+}
+
+void ws2812_build_correction(WS2812Correction *corr, const WS2812Calibration *cal)
+{
+    if (cal->gamma_x100 == WS2812_DEFAULT_GAMMA_X100 && 
+        cal->white_balance[0] == 255 && cal->white_balance[1] == 255 && cal->white_balance[2] == 255) {
+        *corr = default_correction;
+        return;
+    }
+
+    float gamma = (float)cal->gamma_x100 / 100.f;
+    for (int i = 0; i < 256; i++) {
+        float v = powf((float)i / 255.f, gamma);
+        for (int c = 0; c < 3; c++) {
+            corr->lut[c][i] = (uint16_t)(v * cal->white_balance[c] * 256.f + 0.5f);
+        }
+    }
+}
+
+void ws2812_correct_pixels(const RGB *pixels, size_t pixel_cnt, const WS2812Correction *corr, uint16_t *linear)
+{
+    const uint16_t *lut_r = corr->lut[0];
+    const uint16_t *lut_g = corr->lut[1];
+    const uint16_t *lut_b = corr->lut[2];
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        linear[0] = lut_r[pixels[i].r];
+        linear[1] = lut_g[pixels[i].g];
+        linear[2] = lut_b[pixels[i].b];
+        linear += 3;
+    }
+}
+
+typedef struct st_order_shift {
+    uint8_t r, g, b;
+} OrderShift;
+
+static const OrderShift order_shift[WS2812_ORDER_COUNT] = {
+    {8, 16, 0},     // GRB
+    {16, 8, 0},     // RGB
+    {8, 0, 16},     // BRG
+    {16, 0, 8},     // RBG
+    {0, 16, 8},     // GBR
+    {0, 8, 16},     // BGR
+};
+
+static const char *order_names[WS2812_ORDER_COUNT] = {
+    "GRB", "RGB", "BRG", "RBG", "GBR", "BGR"
+};
+
+static inline uint32_t round_channel(uint16_t v)
+{
+    uint32_t out = ((uint32_t)v + 128) >> 8;
+    return out > 255 ? 255 : out;
+}
+
+void ws2812_quantize_pixels(const uint16_t *linear, size_t pixel_cnt, uint8_t order, uint32_t *grb)
+{
+    const OrderShift sh = order_shift[order < WS2812_ORDER_COUNT ? order : (uint8_t)WS2812_ORDER_GRB];
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        grb[i] = round_channel(linear[0]) << sh.r | round_channel(linear[1]) << sh.g | round_channel(linear[2]) << sh.b;
+        linear += 3;
+    }
+}
+
+bool ws2812_dither_pixels(const uint16_t *linear, size_t pixel_cnt, uint8_t order, uint8_t *error, uint32_t *grb)
+{
+    const OrderShift sh = order_shift[order < WS2812_ORDER_COUNT ? order : (uint8_t)WS2812_ORDER_GRB];
+    uint32_t residual = 0;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        uint32_t out[3];
+        for (int c = 0; c < 3; c++) {
+            uint32_t frac = linear[c] & 0xFF;
+            uint32_t acc = frac + error[c];
+            // max table value is 255 * 256 (no fraction), so this never exceeds 255
+            out[c] = (linear[c] >> 8) + (acc >> 8);
+            error[c] = (uint8_t)acc;
+            residual |= frac;
+        }
+        grb[i] = out[0] << sh.r | out[1] << sh.g | out[2] << sh.b;
+        linear += 3;
+        error += 3;
+    }
+
+    return residual != 0;
+}
+
+void ws2812_dither_seed(uint8_t *error, size_t pixel_cnt)
+{
+    for (size_t i = 0; i < pixel_cnt * 3; i++) {
+        error[i] = (uint8_t)(i * 157);
+    }
+}
+
+const char* ws2812_color_order_name(uint8_t order)
+{
+    if (order >= WS2812_ORDER_COUNT) {
+        return "unknown";
+    }
+    return order_names[order];
+}
+
+int ws2812_color_order_from_name(const char *name)
+{
+    for (int i = 0; i < WS2812_ORDER_COUNT; i++) {
+        if (strcasecmp(name, order_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
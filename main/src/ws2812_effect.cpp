@@ -0,0 +1,205 @@
+/**
+ * @file ws2812_effect.cpp
+ * @author yogyui
+ * @brief generative pixel effects (integer/fixed point, hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_effect.h"
+#include <string.h>
+
+static const char *effect_names[WS2812_EFFECT_COUNT] = {
+    "none", "rainbow", "chase", "twinkle", "fire"
+};
+
+struct HeatLut {
+    uint8_t v[256][3];
+};
+
+// black -> red -> yellow -> white
+static constexpr HeatLut make_heat_lut()
+{
+    HeatLut lut{};
+    for (int i = 0; i < 256; i++) {
+        int t = (i * 191) / 255;
+        uint8_t ramp = (uint8_t)((t & 0x3F) << 2);
+        if (t > 0x80) {
+            lut.v[i][0] = 255;
+            lut.v[i][1] = 255;
+            lut.v[i][2] = ramp;
+        } else if (t > 0x40) {
+            lut.v[i][0] = 255;
+            lut.v[i][1] = ramp;
+        } else {
+            lut.v[i][0] = ramp;
+        }
+    }
+    return lut;
+}
+
+static constexpr HeatLut heat_lut = make_heat_lut();
+
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352DUL;
+    x ^= x >> 15;
+    x *= 0x846CA68BUL;
+    x ^= x >> 16;
+    return x;
+}
+
+CWS2812Effect::CWS2812Effect()
+{
+    m_param = ws2812_effect_default_param();
+}
+
+void CRainbowEffect::render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms)
+{
+    if (pixel_cnt == 0)
+        return;
+
+    // speed 128: one hue cycle per ~2 seconds, size: number of hue cycles spread over the strip (x1/64)
+    uint32_t base = (now_ms * m_param.speed) >> 8;
+    uint32_t spread = ((uint32_t)m_param.size << 16) / (uint32_t)pixel_cnt;
+    uint32_t acc = 0;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        pixels[i] = ws2812_hsv_to_rgb((uint8_t)(base + (acc >> 14)), 255, 255);
+        acc += spread;
+    }
+}
+
+void CChaseEffect::render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms)
+{
+    if (pixel_cnt == 0)
+        return;
+
+    // head moves speed/16 pixels per 100ms (Q8)
+    uint32_t tail = m_param.size ? m_param.size : 1;
+    uint32_t head = ((now_ms * m_param.speed) / 400) % pixel_cnt;
+    uint32_t step = 255 / tail;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        uint32_t dist = (head + pixel_cnt - i) % pixel_cnt;
+        if (dist < tail) {
+            uint8_t scale = (uint8_t)(255 - dist * step);
+            pixels[i] = RGB(ws2812_scale8(m_param.color.r, scale), ws2812_scale8(m_param.color.g, scale), ws2812_scale8(m_param.color.b, scale));
+        } else {
+            pixels[i] = RGB();
+        }
+    }
+}
+
+void CTwinkleEffect::render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms)
+{
+    // stateless: each pixel gets its own phase/rate from a hash of its index
+    uint32_t t = (now_ms * m_param.speed) >> 8;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        uint32_t h = hash32((uint32_t)i);
+        if ((h & 0xFF) >= m_param.size) {
+            pixels[i] = RGB();
+            continue;
+        }
+        uint8_t phase = (uint8_t)(h >> 8);
+        uint8_t rate = (uint8_t)(((h >> 16) & 0x3) + 1);
+        uint8_t wave = ws2812_sin8((uint8_t)(phase + t * rate));
+        // only upper half of the sine (sharp twinkles)
+        uint8_t scale = wave > 128 ? (uint8_t)((wave - 128) << 1) : 0;
+        pixels[i] = RGB(ws2812_scale8(m_param.color.r, scale), ws2812_scale8(m_param.color.g, scale), ws2812_scale8(m_param.color.b, scale));
+    }
+}
+
+CFireEffect::CFireEffect()
+{
+    m_random = 0x12345678;
+}
+
+uint8_t CFireEffect::random8()
+{
+    // xorshift32
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return (uint8_t)m_random;
+}
+
+bool CFireEffect::resize(size_t pixel_cnt)
+{
+    m_heat.assign(pixel_cnt, 0);
+    m_heat.shrink_to_fit();
+    return true;
+}
+
+void CFireEffect::render(RGB *pixels, size_t pixel_cnt, uint32_t now_ms)
+{
+    // fire2012 style simulation, one step per frame tick
+    size_t n = pixel_cnt < m_heat.size() ? pixel_cnt : m_heat.size();
+    if (n == 0)
+        return;
+
+    uint8_t *heat = m_heat.data();
+    uint32_t cooling = ((uint32_t)m_param.size * 10) / n + 2;
+    uint8_t sparking = m_param.speed;
+
+    for (size_t i = 0; i < n; i++) {
+        uint8_t cool = (uint8_t)(random8() % cooling);
+        heat[i] = heat[i] > cool ? heat[i] - cool : 0;
+    }
+
+    for (size_t i = n - 1; i >= 2; i--) {
+        heat[i] = (uint8_t)(((uint16_t)heat[i - 1] + heat[i - 2] + heat[i - 2]) / 3);
+    }
+
+    if (random8() < sparking) {
+        size_t y = random8() % (n < 7 ? n : 7);
+        uint16_t v = heat[y] + 160 + (random8() % 96);
+        heat[y] = v > 255 ? 255 : (uint8_t)v;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *rgb = heat_lut.v[heat[i]];
+        pixels[i] = RGB(rgb[0], rgb[1], rgb[2]);
+    }
+}
+
+CWS2812Effect* ws2812_create_effect(uint8_t type)
+{
+    switch (type) {
+    case WS2812_EFFECT_RAINBOW:
+        return new CRainbowEffect();
+    case WS2812_EFFECT_CHASE:
+        return new CChaseEffect();
+    case WS2812_EFFECT_TWINKLE:
+        return new CTwinkleEffect();
+    case WS2812_EFFECT_FIRE:
+        return new CFireEffect();
+    default:
+        return nullptr;
+    }
+}
+
+const char* ws2812_effect_name(uint8_t type)
+{
+    if (type >= WS2812_EFFECT_COUNT)
+        return "unknown";
+    return effect_names[type];
+}
+
+int ws2812_effect_from_name(const char *name)
+{
+    for (int i = 0; i < WS2812_EFFECT_COUNT; i++) {
+        if (strcmp(name, effect_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+WS2812EffectParam ws2812_effect_default_param()
+{
+    WS2812EffectParam param;
+    param.speed = 128;
+    param.size = 64;
+    param.color = RGB(255, 255, 255);
+    return param;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file ws2812_encoder.cpp
+ * @author yogyui
+ * @brief WS2812 waveform encoder (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_encoder.h"
+#include "esp_attr.h"
+
+// byte -> 24 spi bits lookup table (generated at compile time, in ram for the spi interrupt)
+struct SpiLut {
+    uint32_t v[256];
+};
+
+static constexpr uint32_t spi_expand_byte(uint8_t value)
+{
+    uint32_t out = 0;
+    for (int b = 7; b >= 0; b--) {
+        out = (out << 3) | ((value & (1U << b)) ? 0x6 : 0x4);
+    }
+    return out;
+}
+
+static constexpr SpiLut make_spi_lut()
+{
+    SpiLut lut{};
+    for (int i = 0; i < 256; i++) {
+        lut.v[i] = spi_expand_byte((uint8_t)i);
+    }
+    return lut;
+}
+
+DRAM_ATTR static constexpr SpiLut spi_lut = make_spi_lut();
+static_assert(spi_lut.v[0x00] == 0x924924, "invalid spi lut");
+static_assert(spi_lut.v[0xFF] == 0xDB6DB6, "invalid spi lut");
+
+static uint32_t ns_to_ticks(uint32_t ns, uint32_t counter_clk_hz)
+{
+    // round to nearest tick, 15-bit duration field
+    uint64_t ticks = ((uint64_t)ns * counter_clk_hz + 500000000ULL) / 1000000000ULL;
+    if (ticks > 0x7FFF)
+        ticks = 0x7FFF;
+    return (uint32_t)ticks;
+}
+
+static uint32_t make_item(uint32_t high_ticks, uint32_t low_ticks)
+{
+    // level0 = 1 (high), level1 = 0 (low)
+    return (high_ticks & 0x7FFF) | (1UL << 15) | ((low_ticks & 0x7FFF) << 16);
+}
+
+WS2812RmtTiming ws2812_rmt_timing(uint32_t counter_clk_hz)
+{
+    WS2812RmtTiming timing;
+    timing.bit0 = make_item(ns_to_ticks(WS2812_T0H_NS, counter_clk_hz), ns_to_ticks(WS2812_T0L_NS, counter_clk_hz));
+    timing.bit1 = make_item(ns_to_ticks(WS2812_T1H_NS, counter_clk_hz), ns_to_ticks(WS2812_T1L_NS, counter_clk_hz));
+    return timing;
+}
+
+size_t ws2812_encode_rmt_items(const uint32_t *grb, size_t pixel_cnt, uint32_t *items, WS2812RmtTiming timing)
+{
+    uint32_t *out = items;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        uint32_t value = grb[i];
+        for (int b = WS2812_BITS_PER_PIXEL - 1; b >= 0; b--) {
+            *out++ = (value & (1UL << b)) ? timing.bit1 : timing.bit0;
+        }
+    }
+
+    return (size_t)(out - items);
+}
+
+size_t IRAM_ATTR ws2812_encode_spi(const uint32_t *grb, size_t pixel_cnt, uint8_t *out)
+{
+    uint8_t *p = out;
+    for (size_t i = 0; i < pixel_cnt; i++) {
+        uint32_t value = grb[i];
+        for (int shift = 16; shift >= 0; shift -= 8) {
+            uint32_t e = spi_lut.v[(value >> shift) & 0xFF];
+            p[0] = (uint8_t)(e >> 16);
+            p[1] = (uint8_t)(e >> 8);
+            p[2] = (uint8_t)e;
+            p += 3;
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+uint32_t ws2812_frame_time_us(size_t pixel_cnt)
+{
+    // slower of the two bit periods (rmt timing, spi bits are 1.2us)
+    const uint32_t bit_ns = (WS2812_T0H_NS + WS2812_T0L_NS) > (WS2812_T1H_NS + WS2812_T1L_NS) ? 
+        (WS2812_T0H_NS + WS2812_T0L_NS) : (WS2812_T1H_NS + WS2812_T1L_NS);
+    return (uint32_t)(((uint64_t)pixel_cnt * WS2812_BITS_PER_PIXEL * bit_ns + 999) / 1000) + WS2812_RESET_US;
+}
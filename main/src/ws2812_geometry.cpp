@@ -0,0 +1,86 @@
+/**
+ * @file ws2812_geometry.cpp
+ * @author yogyui
+ * @brief strip geometry: defaults, backend per strip and validation against the backend limits
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_geometry.h"
+#include "driver/gpio.h"
+#include "logger.h"
+#include <string.h>
+
+WS2812Geometry ws2812_default_geometry()
+{
+    static const WS2812StripConfig strip_config[] = WS2812_STRIP_CONFIG;
+    WS2812Geometry geometry;
+    memset(&geometry, 0, sizeof(geometry));
+    geometry.pwm_pin_no = PIN_WS2812_PWM;
+    geometry.strip_cnt = sizeof(strip_config) / sizeof(strip_config[0]);
+    for (uint8_t i = 0; i < geometry.strip_cnt; i++) {
+        geometry.strips[i] = strip_config[i];
+    }
+    return geometry;
+}
+
+uint8_t ws2812_strip_output(uint8_t strip, uint8_t output_mode/*=WS2812_OUTPUT_MODE*/)
+{
+    return (output_mode == WS2812_OUTPUT_SPI && strip == 0) ? WS2812_OUTPUT_SPI : WS2812_OUTPUT_RMT;
+}
+
+size_t ws2812_geometry_pixel_count(const WS2812Geometry *geometry)
+{
+    size_t total_cnt = 0;
+    for (uint8_t i = 0; i < geometry->strip_cnt && i < WS2812_MAX_STRIPS; i++) {
+        total_cnt += geometry->strips[i].pixel_cnt;
+    }
+    return total_cnt;
+}
+
+bool ws2812_validate_geometry(const WS2812Geometry *geometry, uint8_t output_mode/*=WS2812_OUTPUT_MODE*/)
+{
+    if (geometry->strip_cnt == 0 || geometry->strip_cnt > WS2812_MAX_STRIPS) {
+        GetLogger(eLogType::Error)->Log("invalid strip count (%d)", geometry->strip_cnt);
+        return false;
+    }
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(geometry->pwm_pin_no)) {
+        GetLogger(eLogType::Error)->Log("invalid pwm pin (%d)", geometry->pwm_pin_no);
+        return false;
+    }
+
+    // rmt items (96 bytes/pixel) are allocated per rmt strip, the spi strip is streamed
+    size_t rmt_cnt = 0;
+    for (uint8_t i = 0; i < geometry->strip_cnt; i++) {
+        const WS2812StripConfig *config = &geometry->strips[i];
+        if (!GPIO_IS_VALID_OUTPUT_GPIO(config->gpio_pin_no) || config->gpio_pin_no == geometry->pwm_pin_no) {
+            GetLogger(eLogType::Error)->Log("invalid data pin (strip %d, gpio %d)", i, config->gpio_pin_no);
+            return false;
+        }
+        for (uint8_t j = 0; j < i; j++) {
+            if (geometry->strips[j].gpio_pin_no == config->gpio_pin_no) {
+                GetLogger(eLogType::Error)->Log("data pin %d is used twice", config->gpio_pin_no);
+                return false;
+            }
+        }
+        if (config->pixel_cnt == 0 || config->color_order >= WS2812_ORDER_COUNT) {
+            GetLogger(eLogType::Error)->Log("invalid strip %d (%d pixels, order %d)", i, config->pixel_cnt, config->color_order);
+            return false;
+        }
+        if (ws2812_strip_output(i, output_mode) == WS2812_OUTPUT_SPI) {
+            if (config->pixel_cnt > WS2812_MAX_SPI_PIXEL_COUNT) {
+                GetLogger(eLogType::Error)->Log("too many pixels on spi strip %d (%d > %d)", i, config->pixel_cnt, WS2812_MAX_SPI_PIXEL_COUNT);
+                return false;
+            }
+        } else {
+            rmt_cnt += config->pixel_cnt;
+        }
+    }
+    if (rmt_cnt > WS2812_MAX_RMT_PIXEL_COUNT) {
+        GetLogger(eLogType::Error)->Log("too many pixels on rmt strips (%d > %d)", rmt_cnt, WS2812_MAX_RMT_PIXEL_COUNT);
+        return false;
+    }
+
+    return true;
+}
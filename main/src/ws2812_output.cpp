@@ -0,0 +1,323 @@
+/**
+ * @file ws2812_output.cpp
+ * @author yogyui
+ * @brief WS2812 data line transmit backends (RMT peripheral, SPI DMA streaming)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_output.h"
+#include "definition.h"
+#include "logger.h"
+#include "esp_heap_caps.h"
+#include "esp_intr_alloc.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <algorithm>
+
+CWS2812RmtOutput::CWS2812RmtOutput()
+{
+    m_channel = RMT_CHANNEL_0;
+    m_installed = false;
+    m_timing.bit0 = 0;
+    m_timing.bit1 = 0;
+}
+
+CWS2812RmtOutput::~CWS2812RmtOutput()
+{
+    release();
+}
+
+bool CWS2812RmtOutput::initialize(uint8_t gpio_pin_no, uint8_t channel, uint16_t pixel_cnt)
+{
+    esp_err_t ret;
+
+    release();
+    m_channel = (rmt_channel_t)channel;
+
+    rmt_config_t rmt_cfg = RMT_DEFAULT_CONFIG_TX((gpio_num_t)gpio_pin_no, m_channel);
+    rmt_cfg.clk_div = WS2812_RMT_CLK_DIV;
+    rmt_cfg.mem_block_num = 1;
+    ret = rmt_config(&rmt_cfg);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to configure rmt channel %d (ret %d)", channel, ret);
+        return false;
+    }
+
+    ret = rmt_driver_install(m_channel, 0, 0);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to install rmt driver (ret %d)", ret);
+        return false;
+    }
+    m_installed = true;
+
+    uint32_t counter_clk_hz = 0;
+    ret = rmt_get_counter_clock(m_channel, &counter_clk_hz);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to get rmt counter clock (ret %d)", ret);
+        release();
+        return false;
+    }
+    m_timing = ws2812_rmt_timing(counter_clk_hz);
+    m_items.resize((size_t)pixel_cnt * WS2812_BITS_PER_PIXEL);
+
+    GetLogger(eLogType::Info)->Log("rmt output initialized (gpio %d, channel %d, clock %u Hz)", gpio_pin_no, channel, counter_clk_hz);
+    return true;
+}
+
+bool CWS2812RmtOutput::release()
+{
+    if (m_installed) {
+        rmt_wait_tx_done(m_channel, pdMS_TO_TICKS(WS2812_TX_TIMEOUT_MS));
+        esp_err_t ret = rmt_driver_uninstall(m_channel);
+        m_installed = false;
+        if (ret != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to uninstall rmt driver (ret %d)", ret);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CWS2812RmtOutput::transmit(const uint32_t *grb, size_t pixel_cnt)
+{
+    if (!m_installed) {
+        return false;
+    }
+
+    // previous frame is still streamed out of m_items by the rmt isr
+    if (!wait_done(WS2812_TX_TIMEOUT_MS)) {
+        return false;
+    }
+
+    if (pixel_cnt * WS2812_BITS_PER_PIXEL > m_items.size()) {
+        pixel_cnt = m_items.size() / WS2812_BITS_PER_PIXEL;
+    }
+    size_t item_cnt = ws2812_encode_rmt_items(grb, pixel_cnt, m_items.data(), m_timing);
+
+    esp_err_t ret = rmt_write_items(m_channel, reinterpret_cast<const rmt_item32_t *>(m_items.data()), item_cnt, false);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to write rmt items (ret %d)", ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool CWS2812RmtOutput::wait_done(uint32_t timeout_ms)
+{
+    if (!m_installed) {
+        return true;
+    }
+
+    esp_err_t ret = rmt_wait_tx_done(m_channel, pdMS_TO_TICKS(timeout_ms));
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("rmt transmit timeout (ret %d)", ret);
+        return false;
+    }
+
+    return true;
+}
+
+CWS2812SpiOutput::CWS2812SpiOutput()
+{
+    m_host = WS2812_SPI_HOST;
+    m_handle = nullptr;
+    m_buffer[0] = nullptr;
+    m_buffer[1] = nullptr;
+    m_reset_buffer = nullptr;
+    m_frame = nullptr;
+    m_frame_capacity = 0;
+    m_frame_cnt = 0;
+    m_encoded_cnt = 0;
+    m_pending = 0;
+}
+
+CWS2812SpiOutput::~CWS2812SpiOutput()
+{
+    release();
+}
+
+bool CWS2812SpiOutput::initialize(uint8_t gpio_pin_no, uint8_t channel, uint16_t pixel_cnt)
+{
+    esp_err_t ret;
+    const size_t chunk_size = WS2812_SPI_CHUNK_PIXELS * WS2812_SPI_BYTES_PER_PIXEL;
+    const size_t chunk_cnt = (pixel_cnt + WS2812_SPI_CHUNK_PIXELS - 1) / WS2812_SPI_CHUNK_PIXELS;
+
+    release();
+    m_host = (spi_host_device_t)channel;
+
+    for (int i = 0; i < 2; i++) {
+        m_buffer[i] = (uint8_t *)heap_caps_malloc(chunk_size, MALLOC_CAP_DMA);
+    }
+    m_reset_buffer = (uint8_t *)heap_caps_calloc(1, WS2812_SPI_RESET_BYTES, MALLOC_CAP_DMA);
+    // internal ram: the interrupt reads it while flash writes disable the cache
+    m_frame = (uint32_t *)heap_caps_malloc(pixel_cnt * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!m_buffer[0] || !m_buffer[1] || !m_reset_buffer || !m_frame) {
+        GetLogger(eLogType::Error)->Log("Failed to allocate dma buffer");
+        release();
+        return false;
+    }
+    m_frame_capacity = pixel_cnt;
+    m_transaction.resize(chunk_cnt + 1);
+
+    spi_bus_config_t cfg_bus;
+    memset(&cfg_bus, 0, sizeof(cfg_bus));
+    cfg_bus.mosi_io_num = gpio_pin_no;
+    cfg_bus.miso_io_num = -1;
+    cfg_bus.sclk_io_num = -1;
+    cfg_bus.quadwp_io_num = -1;
+    cfg_bus.quadhd_io_num = -1;
+    cfg_bus.data4_io_num = -1;
+    cfg_bus.data5_io_num = -1;
+    cfg_bus.data6_io_num = -1;
+    cfg_bus.data7_io_num = -1;
+    cfg_bus.max_transfer_sz = chunk_size;
+    cfg_bus.intr_flags = ESP_INTR_FLAG_IRAM;    // chunks are refilled during nvs flash writes as well
+    ret = spi_bus_initialize(m_host, &cfg_bus, SPI_DMA_CH_AUTO);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("failed to initialize spi bus (ret: %d)", ret);
+        release();
+        return false;
+    }
+
+    spi_device_interface_config_t cfg_dev_if;
+    memset(&cfg_dev_if, 0, sizeof(cfg_dev_if));
+    cfg_dev_if.clock_speed_hz = WS2812_SPI_CLOCK_HZ;
+    cfg_dev_if.mode = 0;
+    cfg_dev_if.spics_io_num = -1;
+    cfg_dev_if.queue_size = (int)m_transaction.size();     // whole frame is queued at once
+    cfg_dev_if.post_cb = post_transaction;
+    ret = spi_bus_add_device(m_host, &cfg_dev_if, &m_handle);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("failed to add device to spi bus (ret: %d)", ret);
+        spi_bus_free(m_host);
+        m_handle = nullptr;
+        release();
+        return false;
+    }
+
+    GetLogger(eLogType::Info)->Log("spi output initialized (gpio %d, host %d, %d pixels, %d chunks of %d bytes)", 
+        gpio_pin_no, channel, pixel_cnt, chunk_cnt, chunk_size);
+    return true;
+}
+
+bool CWS2812SpiOutput::release()
+{
+    if (m_handle) {
+        wait_done(WS2812_TX_TIMEOUT_MS);
+        spi_bus_remove_device(m_handle);
+        spi_bus_free(m_host);
+        m_handle = nullptr;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (m_buffer[i]) {
+            heap_caps_free(m_buffer[i]);
+            m_buffer[i] = nullptr;
+        }
+    }
+    if (m_reset_buffer) {
+        heap_caps_free(m_reset_buffer);
+        m_reset_buffer = nullptr;
+    }
+    if (m_frame) {
+        heap_caps_free(m_frame);
+        m_frame = nullptr;
+    }
+    m_frame_capacity = 0;
+    std::vector<spi_transaction_t>().swap(m_transaction);
+
+    return true;
+}
+
+esp_err_t CWS2812SpiOutput::queue(spi_transaction_t *trans, const uint8_t *data, size_t len, void *user)
+{
+    memset(trans, 0, sizeof(spi_transaction_t));
+    trans->length = len * 8;
+    trans->tx_buffer = data;
+    trans->user = user;
+
+    // never blocks, the queue holds a whole frame
+    esp_err_t ret = spi_device_queue_trans(m_handle, trans, 0);
+    if (ret == ESP_OK) {
+        m_pending++;
+    }
+
+    return ret;
+}
+
+void IRAM_ATTR CWS2812SpiOutput::encode_chunk(uint8_t *buffer)
+{
+    size_t count = std::min<size_t>(m_frame_cnt - m_encoded_cnt, WS2812_SPI_CHUNK_PIXELS);
+    ws2812_encode_spi(m_frame + m_encoded_cnt, count, buffer);
+    m_encoded_cnt += count;
+}
+
+void IRAM_ATTR CWS2812SpiOutput::post_transaction(spi_transaction_t *trans)
+{
+    // chunk n is sent: its buffer takes chunk n + 2, chunk n + 1 (other buffer) is sent meanwhile
+    CWS2812SpiOutput *output = (CWS2812SpiOutput *)trans->user;
+    if (output && output->m_encoded_cnt < output->m_frame_cnt) {
+        output->encode_chunk((uint8_t *)trans->tx_buffer);
+    }
+}
+
+bool CWS2812SpiOutput::transmit(const uint32_t *grb, size_t pixel_cnt)
+{
+    if (!m_handle || pixel_cnt > m_frame_capacity) {
+        return false;
+    }
+
+    if (!wait_done(WS2812_TX_TIMEOUT_MS)) {
+        return false;
+    }
+
+    // the caller renders the next frame while this one is sent from the copy
+    memcpy(m_frame, grb, pixel_cnt * sizeof(uint32_t));
+    m_frame_cnt = pixel_cnt;
+    m_encoded_cnt = 0;
+    for (int i = 0; i < 2 && m_encoded_cnt < m_frame_cnt; i++) {
+        encode_chunk(m_buffer[i]);
+    }
+
+    // chunks are queued back to back without a context switch: once the first chunk runs, each
+    // following one must be queued before its predecessor ends (~2ms), a preempted led task
+    // would leave the line low long enough to latch a partial frame
+    esp_err_t ret = ESP_OK;
+    size_t chunk_cnt = (pixel_cnt + WS2812_SPI_CHUNK_PIXELS - 1) / WS2812_SPI_CHUNK_PIXELS;
+    vTaskSuspendAll();
+    for (size_t i = 0; i < chunk_cnt && ret == ESP_OK; i++) {
+        size_t count = std::min<size_t>(pixel_cnt - i * WS2812_SPI_CHUNK_PIXELS, WS2812_SPI_CHUNK_PIXELS);
+        ret = queue(&m_transaction[i], m_buffer[i & 1], count * WS2812_SPI_BYTES_PER_PIXEL, this);
+    }
+    // trailing low period latches the frame, completion is collected by next transmit
+    if (ret == ESP_OK) {
+        ret = queue(&m_transaction[chunk_cnt], m_reset_buffer, WS2812_SPI_RESET_BYTES, nullptr);
+    }
+    xTaskResumeAll();
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to queue spi transaction (ret %d)", ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool CWS2812SpiOutput::wait_done(uint32_t timeout_ms)
+{
+    spi_transaction_t *done;
+    while (m_pending > 0) {
+        if (spi_device_get_trans_result(m_handle, &done, pdMS_TO_TICKS(timeout_ms)) != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("spi transmit timeout");
+            return false;
+        }
+        m_pending--;
+    }
+
+    return true;
+}
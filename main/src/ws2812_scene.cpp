@@ -0,0 +1,168 @@
+/**
+ * @file ws2812_scene.cpp
+ * @author yogyui
+ * @brief scene binary encoding, run length encoded frames (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_scene.h"
+#include <string.h>
+
+#define RLE_MAX_PACKET  128
+#define RLE_LITERAL     0x80
+
+static_assert(sizeof(RGB) == 3, "raw frames are packed rgb");
+
+static inline bool same_pixel(const RGB &a, const RGB &b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+size_t ws2812_scene_rle_encode(const RGB *pixels, size_t pixel_cnt, uint8_t *out, size_t out_size)
+{
+    size_t len = 0;
+    size_t i = 0;
+    while (i < pixel_cnt) {
+        size_t run = 1;
+        while (i + run < pixel_cnt && run < RLE_MAX_PACKET && same_pixel(pixels[i + run], pixels[i])) {
+            run++;
+        }
+        if (run >= 2) {
+            if (len + 4 > out_size) {
+                return 0;
+            }
+            out[len++] = (uint8_t)(run - 1);
+            out[len++] = pixels[i].r;
+            out[len++] = pixels[i].g;
+            out[len++] = pixels[i].b;
+            i += run;
+            continue;
+        }
+
+        // literal packet until the next run of two starts
+        size_t literal = 1;
+        while (i + literal < pixel_cnt && literal < RLE_MAX_PACKET &&
+               !(i + literal + 1 < pixel_cnt && same_pixel(pixels[i + literal], pixels[i + literal + 1]))) {
+            literal++;
+        }
+        if (len + 1 + literal * 3 > out_size) {
+            return 0;
+        }
+        out[len++] = (uint8_t)(RLE_LITERAL | (literal - 1));
+        for (size_t k = 0; k < literal; k++) {
+            out[len++] = pixels[i + k].r;
+            out[len++] = pixels[i + k].g;
+            out[len++] = pixels[i + k].b;
+        }
+        i += literal;
+    }
+
+    return len;
+}
+
+bool ws2812_scene_rle_decode(const uint8_t *data, size_t len, RGB *pixels, size_t pixel_cnt)
+{
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos < len) {
+        uint8_t ctrl = data[pos++];
+        size_t n = (ctrl & ~RLE_LITERAL) + 1;
+        if (count + n > pixel_cnt) {
+            return false;
+        }
+        if (ctrl & RLE_LITERAL) {
+            if (pos + n * 3 > len) {
+                return false;
+            }
+            for (size_t k = 0; k < n; k++, pos += 3) {
+                pixels[count++] = RGB(data[pos], data[pos + 1], data[pos + 2]);
+            }
+        } else {
+            if (pos + 3 > len) {
+                return false;
+            }
+            RGB rgb(data[pos], data[pos + 1], data[pos + 2]);
+            pos += 3;
+            for (size_t k = 0; k < n; k++) {
+                pixels[count++] = rgb;
+            }
+        }
+    }
+
+    return count == pixel_cnt;
+}
+
+size_t ws2812_scene_encode(const WS2812SceneHeader *header, const RGB *pixels, uint8_t *out, size_t out_size)
+{
+    if (out_size < sizeof(WS2812SceneHeader)) {
+        return 0;
+    }
+
+    WS2812SceneHeader hdr = *header;
+    hdr.magic = WS2812_SCENE_MAGIC;
+    hdr.version = WS2812_SCENE_VERSION;
+    hdr.flags &= WS2812_SCENE_FLAG_FRAME;
+    hdr.name[WS2812_SCENE_NAME_LEN - 1] = '\0';
+    if (!(hdr.flags & WS2812_SCENE_FLAG_FRAME) || !pixels) {
+        hdr.flags = 0;
+        hdr.pixel_cnt = 0;
+    }
+
+    uint8_t *payload = out + sizeof(WS2812SceneHeader);
+    size_t payload_size = out_size - sizeof(WS2812SceneHeader);
+    size_t raw_len = (size_t)hdr.pixel_cnt * 3;
+    size_t len = 0;
+    if (hdr.pixel_cnt) {
+        // rle only if it saves space (noisy frames grow by one byte per 128 pixels)
+        len = ws2812_scene_rle_encode(pixels, hdr.pixel_cnt, payload, raw_len < payload_size ? raw_len : payload_size);
+        if (len > 0 && len < raw_len) {
+            hdr.flags |= WS2812_SCENE_FLAG_RLE;
+        } else if (raw_len <= payload_size) {
+            memcpy(payload, pixels, raw_len);
+            len = raw_len;
+        } else {
+            return 0;
+        }
+    }
+    hdr.payload_len = (uint32_t)len;
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return sizeof(hdr) + len;
+}
+
+bool ws2812_scene_decode(const uint8_t *data, size_t len, WS2812SceneHeader *header, RGB *pixels, size_t pixel_capacity)
+{
+    if (len < sizeof(WS2812SceneHeader)) {
+        return false;
+    }
+
+    WS2812SceneHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    // newer versions must be migrated here when the layout changes
+    if (hdr.magic != WS2812_SCENE_MAGIC || hdr.version == 0 || hdr.version > WS2812_SCENE_VERSION) {
+        return false;
+    }
+    if (hdr.payload_len > len - sizeof(hdr) || hdr.pixel_cnt > pixel_capacity) {
+        return false;
+    }
+    hdr.name[WS2812_SCENE_NAME_LEN - 1] = '\0';
+
+    if ((hdr.flags & WS2812_SCENE_FLAG_FRAME) && pixels) {
+        const uint8_t *payload = data + sizeof(hdr);
+        if (hdr.flags & WS2812_SCENE_FLAG_RLE) {
+            if (!ws2812_scene_rle_decode(payload, hdr.payload_len, pixels, hdr.pixel_cnt)) {
+                return false;
+            }
+        } else {
+            if (hdr.payload_len != (uint32_t)hdr.pixel_cnt * 3) {
+                return false;
+            }
+            memcpy(pixels, payload, hdr.payload_len);
+        }
+    }
+    *header = hdr;
+
+    return true;
+}
@@ -0,0 +1,324 @@
+/**
+ * @file ws2812_stream.cpp
+ * @author yogyui
+ * @brief DDP / E1.31(sACN) / Art-Net pixel stream decoder (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_stream.h"
+#include <string.h>
+
+static_assert(sizeof(RGB) == 3, "frame is written as packed rgb bytes");
+
+// DDP (http://www.3waylabs.com/ddp/)
+#define DDP_HEADER_LEN              10
+#define DDP_HEADER_LEN_TIMECODE     14
+#define DDP_FLAGS_VER_MASK          0xC0
+#define DDP_FLAGS_VER1              0x40
+#define DDP_FLAGS_TIMECODE          0x10
+#define DDP_FLAGS_STORAGE           0x08
+#define DDP_FLAGS_REPLY             0x04
+#define DDP_FLAGS_QUERY             0x02
+#define DDP_FLAGS_PUSH              0x01
+#define DDP_TYPE_MASK               0x38
+#define DDP_TYPE_UNDEFINED          0x00
+#define DDP_TYPE_RGB                0x08
+#define DDP_ID_DISPLAY              1
+
+// E1.31 (ANSI E1.31-2016)
+#define E131_DATA_HEADER_LEN        126
+#define E131_SYNC_PACKET_LEN        49
+#define E131_VECTOR_ROOT_DATA       0x00000004
+#define E131_VECTOR_ROOT_EXTENDED   0x00000008
+#define E131_VECTOR_DATA_PACKET     0x00000002
+#define E131_VECTOR_EXTENDED_SYNC   0x00000001
+#define E131_VECTOR_DMP_SET_PROPERTY 0x02
+#define E131_DMP_ADDRESS_TYPE       0xA1
+#define E131_OPTION_PREVIEW         0x80
+#define E131_OPTION_TERMINATED      0x40
+
+// Art-Net 4
+#define ARTNET_HEADER_LEN           12
+#define ARTNET_DMX_HEADER_LEN       18
+#define ARTNET_OP_DMX               0x5000
+#define ARTNET_OP_SYNC              0x5200
+
+#define DMX_MAX_SLOTS               512
+#define DMX_START_CODE              0x00
+
+static const uint8_t e131_acn_id[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+static const uint8_t artnet_id[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool ws2812_stream_seq_stale(uint8_t last, uint8_t seq)
+{
+    int8_t diff = (int8_t)(seq - last);
+    return diff <= 0 && diff > -20;
+}
+
+bool ws2812_stream_ddp_seq_stale(uint8_t last, uint8_t seq)
+{
+    // 1 ~ 15 wraps to 1, distance modulo 15
+    uint8_t diff = (uint8_t)((seq + 15 - last) % 15);
+    return diff > 10;
+}
+
+CWS2812StreamDecoder::CWS2812StreamDecoder(uint16_t e131_first_universe, uint16_t artnet_first_universe)
+{
+    m_first_universe[WS2812_STREAM_DDP] = 0;
+    m_first_universe[WS2812_STREAM_E131] = e131_first_universe;
+    m_first_universe[WS2812_STREAM_ARTNET] = artnet_first_universe;
+    m_universe_cnt = 0;
+    memset(m_universe_seq, 0, sizeof(m_universe_seq));
+    reset();
+    reset_stats();
+}
+
+bool CWS2812StreamDecoder::resize(size_t pixel_cnt)
+{
+    size_t universe_cnt = (pixel_cnt + WS2812_STREAM_DMX_PIXELS - 1) / WS2812_STREAM_DMX_PIXELS;
+    if (universe_cnt > WS2812_STREAM_MAX_UNIVERSES) {
+        return false;
+    }
+
+    m_frame.assign(pixel_cnt, RGB());
+    m_universe_cnt = (uint8_t)universe_cnt;
+    reset();
+
+    return true;
+}
+
+void CWS2812StreamDecoder::reset()
+{
+    m_universe_pending = 0;
+    m_universe_active = m_universe_cnt >= 32 ? 0xFFFFFFFFUL : (1UL << m_universe_cnt) - 1;
+    m_universe_seq_valid = 0;
+    m_sync_address = 0;
+    m_artnet_sync = false;
+    m_ddp_seq = 0;
+}
+
+void CWS2812StreamDecoder::reset_stats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool CWS2812StreamDecoder::feed(uint8_t protocol, const uint8_t *data, size_t len)
+{
+    m_stats.packets++;
+    switch (protocol) {
+    case WS2812_STREAM_DDP:
+        return feed_ddp(data, len);
+    case WS2812_STREAM_E131:
+        return feed_e131(data, len);
+    case WS2812_STREAM_ARTNET:
+        return feed_artnet(data, len);
+    default:
+        m_stats.dropped_ignored++;
+        return false;
+    }
+}
+
+bool CWS2812StreamDecoder::complete_frame()
+{
+    m_universe_pending = 0;
+    m_stats.frames++;
+    return true;
+}
+
+bool CWS2812StreamDecoder::feed_ddp(const uint8_t *data, size_t len)
+{
+    if (len < DDP_HEADER_LEN || (data[0] & DDP_FLAGS_VER_MASK) != DDP_FLAGS_VER1) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    uint8_t flags = data[0];
+    size_t header_len = (flags & DDP_FLAGS_TIMECODE) ? DDP_HEADER_LEN_TIMECODE : DDP_HEADER_LEN;
+    uint32_t offset = read_be32(&data[4]);
+    uint16_t length = read_be16(&data[8]);
+    if (len < header_len || len - header_len < length) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    uint8_t type = data[2] & DDP_TYPE_MASK;
+    uint8_t id = data[3];
+    if ((flags & (DDP_FLAGS_QUERY | DDP_FLAGS_REPLY | DDP_FLAGS_STORAGE)) ||
+        (type != DDP_TYPE_UNDEFINED && type != DDP_TYPE_RGB) ||
+        (id != 0 && id != DDP_ID_DISPLAY)) {
+        m_stats.dropped_ignored++;
+        return false;
+    }
+
+    uint8_t seq = data[1] & 0x0F;
+    if (seq != 0) {
+        if (m_ddp_seq != 0 && ws2812_stream_ddp_seq_stale(m_ddp_seq, seq)) {
+            m_stats.dropped_stale++;
+            return false;
+        }
+        m_ddp_seq = seq;
+    }
+
+    // byte addressed, a packet may start or end in the middle of a pixel
+    size_t frame_len = m_frame.size() * sizeof(RGB);
+    if (offset < frame_len && length > 0) {
+        size_t copy_len = length;
+        if (copy_len > frame_len - offset)
+            copy_len = frame_len - offset;
+        memcpy(reinterpret_cast<uint8_t *>(m_frame.data()) + offset, &data[header_len], copy_len);
+        m_stats.bytes += copy_len;
+    }
+
+    if (flags & DDP_FLAGS_PUSH) {
+        return complete_frame();
+    }
+    return false;
+}
+
+bool CWS2812StreamDecoder::feed_e131(const uint8_t *data, size_t len)
+{
+    if (len < E131_SYNC_PACKET_LEN || read_be16(&data[0]) != 0x0010 || memcmp(&data[4], e131_acn_id, sizeof(e131_acn_id)) != 0) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    uint32_t root_vector = read_be32(&data[18]);
+    uint32_t framing_vector = read_be32(&data[40]);
+    if (root_vector == E131_VECTOR_ROOT_EXTENDED) {
+        if (framing_vector != E131_VECTOR_EXTENDED_SYNC) {
+            // universe discovery
+            m_stats.dropped_ignored++;
+            return false;
+        }
+        m_stats.sync_packets++;
+        uint16_t sync_address = read_be16(&data[45]);
+        if (sync_address == 0 || sync_address != m_sync_address || m_universe_pending == 0) {
+            return false;
+        }
+        return complete_frame();
+    }
+
+    if (root_vector != E131_VECTOR_ROOT_DATA || framing_vector != E131_VECTOR_DATA_PACKET || len < E131_DATA_HEADER_LEN ||
+        data[117] != E131_VECTOR_DMP_SET_PROPERTY || data[118] != E131_DMP_ADDRESS_TYPE) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    // property value count includes the start code
+    uint16_t value_cnt = read_be16(&data[123]);
+    if (value_cnt == 0 || value_cnt > DMX_MAX_SLOTS + 1 || len < E131_DATA_HEADER_LEN - 1 + (size_t)value_cnt) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    uint16_t universe = read_be16(&data[113]);
+    uint8_t options = data[112];
+    if (options & E131_OPTION_TERMINATED) {
+        // sender stopped, next packets start a new sequence
+        if (universe >= m_first_universe[WS2812_STREAM_E131] && universe - m_first_universe[WS2812_STREAM_E131] < m_universe_cnt) {
+            m_universe_seq_valid &= ~(1UL << (universe - m_first_universe[WS2812_STREAM_E131]));
+        }
+        m_stats.dropped_ignored++;
+        return false;
+    }
+    if ((options & E131_OPTION_PREVIEW) || data[125] != DMX_START_CODE) {
+        m_stats.dropped_ignored++;
+        return false;
+    }
+
+    m_sync_address = read_be16(&data[109]);
+    return write_universe(WS2812_STREAM_E131, universe, true, data[111], &data[126], value_cnt - 1, m_sync_address != 0);
+}
+
+bool CWS2812StreamDecoder::feed_artnet(const uint8_t *data, size_t len)
+{
+    if (len < ARTNET_HEADER_LEN || memcmp(data, artnet_id, sizeof(artnet_id)) != 0) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    uint16_t opcode = (uint16_t)(data[8] | (data[9] << 8));
+    if (opcode == ARTNET_OP_SYNC) {
+        // once a sender uses ArtSync, frames are only shown on sync (until reset)
+        m_stats.sync_packets++;
+        m_artnet_sync = true;
+        if (m_universe_pending == 0) {
+            return false;
+        }
+        return complete_frame();
+    }
+    if (opcode != ARTNET_OP_DMX) {
+        // ArtPoll etc. (no reply is sent)
+        m_stats.dropped_ignored++;
+        return false;
+    }
+
+    uint16_t length = read_be16(&data[16]);
+    if (len < ARTNET_DMX_HEADER_LEN || length > DMX_MAX_SLOTS || len - ARTNET_DMX_HEADER_LEN < length) {
+        m_stats.dropped_malformed++;
+        return false;
+    }
+
+    // 15 bit port address (net, sub-net + universe), sequence 0 disables reordering checks
+    uint16_t universe = (uint16_t)(((data[15] & 0x7F) << 8) | data[14]);
+    uint8_t seq = data[12];
+    return write_universe(WS2812_STREAM_ARTNET, universe, seq != 0, seq, &data[ARTNET_DMX_HEADER_LEN], length, m_artnet_sync);
+}
+
+bool CWS2812StreamDecoder::write_universe(uint8_t protocol, uint16_t universe, bool has_seq, uint8_t seq, const uint8_t *slots, size_t slot_cnt, bool synced)
+{
+    uint16_t first = m_first_universe[protocol];
+    if (universe < first || universe - first >= m_universe_cnt) {
+        m_stats.dropped_ignored++;
+        return false;
+    }
+
+    uint8_t index = (uint8_t)(universe - first);
+    uint32_t bit = 1UL << index;
+    if (has_seq) {
+        if ((m_universe_seq_valid & bit) && ws2812_stream_seq_stale(m_universe_seq[index], seq)) {
+            m_stats.dropped_stale++;
+            return false;
+        }
+        m_universe_seq[index] = seq;
+        m_universe_seq_valid |= bit;
+    }
+
+    if (!synced && (m_universe_pending & bit)) {
+        // the sender started the next frame before all expected universes arrived,
+        // it covers fewer universes than the strip: learn the set, the partial frame is discarded
+        m_universe_active = m_universe_pending;
+        m_universe_pending = 0;
+    }
+
+    size_t pixel_offset = (size_t)index * WS2812_STREAM_DMX_PIXELS;
+    size_t copy_len = slot_cnt;
+    if (copy_len > WS2812_STREAM_DMX_PIXELS * sizeof(RGB))
+        copy_len = WS2812_STREAM_DMX_PIXELS * sizeof(RGB);
+    if (copy_len > (m_frame.size() - pixel_offset) * sizeof(RGB))
+        copy_len = (m_frame.size() - pixel_offset) * sizeof(RGB);
+    memcpy(reinterpret_cast<uint8_t *>(m_frame.data() + pixel_offset), slots, copy_len);
+    m_stats.bytes += copy_len;
+
+    m_universe_pending |= bit;
+    m_universe_active |= bit;
+    if (synced) {
+        return false;
+    }
+    if ((m_universe_pending & m_universe_active) == m_universe_active) {
+        return complete_frame();
+    }
+    return false;
+}
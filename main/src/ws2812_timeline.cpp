@@ -0,0 +1,186 @@
+/**
+ * @file ws2812_timeline.cpp
+ * @author yogyui
+ * @brief keyframe/transition engine with fixed point easing (hardware independent)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "ws2812_timeline.h"
+#include <string.h>
+
+uint32_t ws2812_ease(uint8_t easing, uint32_t t)
+{
+    if (t >= WS2812_Q16_ONE)
+        return WS2812_Q16_ONE;
+
+    uint64_t t2, t3, inv;
+    switch (easing) {
+    case WS2812_EASE_IN:
+        return (uint32_t)(((uint64_t)t * t) >> 16);
+    case WS2812_EASE_OUT:
+        inv = WS2812_Q16_ONE - t;
+        return (uint32_t)(WS2812_Q16_ONE - ((inv * inv) >> 16));
+    case WS2812_EASE_IN_OUT:
+        // 3t^2 - 2t^3
+        t2 = ((uint64_t)t * t) >> 16;
+        t3 = (t2 * t) >> 16;
+        return (uint32_t)(3 * t2 - 2 * t3);
+    case WS2812_EASE_STEP:
+        return WS2812_Q16_ONE;
+    case WS2812_EASE_LINEAR:
+    default:
+        return t;
+    }
+}
+
+uint8_t ws2812_lerp_u8(uint8_t a, uint8_t b, uint32_t w)
+{
+    if (w >= WS2812_Q16_ONE)
+        return b;
+
+    if (b >= a) {
+        return (uint8_t)(a + ((((uint32_t)(b - a)) * w + 0x8000) >> 16));
+    } else {
+        return (uint8_t)(a - ((((uint32_t)(a - b)) * w + 0x8000) >> 16));
+    }
+}
+
+void ws2812_sequence_init(WS2812Sequence *seq, uint16_t repeat)
+{
+    memset(seq, 0, sizeof(WS2812Sequence));
+    seq->repeat = repeat;
+}
+
+bool ws2812_sequence_add(WS2812Sequence *seq, uint32_t duration_ms, uint8_t easing, const uint8_t *value, uint8_t channels)
+{
+    if (seq->key_count >= WS2812_TIMELINE_MAX_KEYFRAMES || channels > WS2812_TIMELINE_MAX_CHANNELS)
+        return false;
+
+    WS2812Keyframe *key = &seq->keys[seq->key_count++];
+    key->duration_ms = duration_ms;
+    key->easing = easing;
+    memset(key->value, 0, sizeof(key->value));
+    memcpy(key->value, value, channels);
+    return true;
+}
+
+CWS2812Track::CWS2812Track()
+{
+    m_head = 0;
+    m_count = 0;
+    m_key = 0;
+    m_loop = 0;
+    m_key_start_ms = 0;
+    m_channels = 1;
+    memset(m_from, 0, sizeof(m_from));
+    memset(m_value, 0, sizeof(m_value));
+}
+
+CWS2812Track::~CWS2812Track()
+{
+}
+
+void CWS2812Track::reset(const uint8_t *value, uint8_t channels)
+{
+    stop();
+    m_channels = channels > WS2812_TIMELINE_MAX_CHANNELS ? WS2812_TIMELINE_MAX_CHANNELS : channels;
+    memcpy(m_value, value, m_channels);
+    memcpy(m_from, value, m_channels);
+}
+
+bool CWS2812Track::play(const WS2812Sequence *seq, uint32_t now_ms, bool enqueue)
+{
+    if (seq->key_count == 0)
+        return false;
+
+    if (!enqueue) {
+        // preempt: new sequence starts from the value currently shown
+        stop();
+    } else if (m_count >= WS2812_TIMELINE_MAX_SEQUENCES) {
+        return false;
+    }
+
+    uint8_t slot = (m_head + m_count) % WS2812_TIMELINE_MAX_SEQUENCES;
+    m_queue[slot] = *seq;
+
+    // endless loop of zero length keyframes would never yield
+    uint32_t total_ms = 0;
+    for (uint8_t i = 0; i < seq->key_count; i++) {
+        total_ms += seq->keys[i].duration_ms;
+    }
+    if (total_ms == 0) {
+        m_queue[slot].repeat = 1;
+    }
+
+    m_count++;
+    if (m_count == 1) {
+        begin(now_ms);
+    }
+
+    return true;
+}
+
+void CWS2812Track::stop()
+{
+    m_head = 0;
+    m_count = 0;
+    m_key = 0;
+    m_loop = 0;
+    memcpy(m_from, m_value, sizeof(m_from));
+}
+
+void CWS2812Track::begin(uint32_t now_ms)
+{
+    m_key = 0;
+    m_loop = 0;
+    m_key_start_ms = now_ms;
+    memcpy(m_from, m_value, sizeof(m_from));
+}
+
+bool CWS2812Track::set_value(const uint8_t *value)
+{
+    bool changed = memcmp(m_value, value, m_channels) != 0;
+    memcpy(m_value, value, m_channels);
+    return changed;
+}
+
+bool CWS2812Track::advance(uint32_t now_ms)
+{
+    bool changed = false;
+
+    while (m_count > 0) {
+        const WS2812Sequence *seq = &m_queue[m_head];
+        const WS2812Keyframe *key = &seq->keys[m_key];
+        uint32_t elapsed = now_ms - m_key_start_ms;
+
+        if (elapsed < key->duration_ms) {
+            uint32_t t = (uint32_t)(((uint64_t)elapsed << 16) / key->duration_ms);
+            uint32_t w = ws2812_ease(key->easing, t);
+            uint8_t value[WS2812_TIMELINE_MAX_CHANNELS];
+            for (uint8_t c = 0; c < m_channels; c++) {
+                value[c] = ws2812_lerp_u8(m_from[c], key->value[c], w);
+            }
+            changed |= set_value(value);
+            break;
+        }
+
+        // keyframe finished, carry remaining time over to the next one
+        changed |= set_value(key->value);
+        memcpy(m_from, m_value, sizeof(m_from));
+        m_key_start_ms += key->duration_ms;
+        m_key++;
+        if (m_key >= seq->key_count) {
+            m_key = 0;
+            m_loop++;
+            if (seq->repeat != 0 && m_loop >= seq->repeat) {
+                m_loop = 0;
+                m_head = (m_head + 1) % WS2812_TIMELINE_MAX_SEQUENCES;
+                m_count--;
+            }
+        }
+    }
+
+    return changed;
+}
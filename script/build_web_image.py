@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# build_web_image.py
+# purpose: pack web resources into a read-only image for the 'web' partition
+#          (served from memory mapped flash, see main/include/web_image.h)
+# usage: python build_web_image.py <resource dir> <output bin> [--size <partition size>]
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import struct
+import sys
+
+WEB_IMAGE_MAGIC = 0x49424557    # "WEBI"
+WEB_IMAGE_VERSION = 1
+WEB_IMAGE_FLAG_IMMUTABLE = 0x01
+HEADER_FORMAT = '<IHHII'        # WebImageHeader
+ENTRY_FORMAT = '<IIIIII8sB3x'   # WebImageEntry
+ALIGN = 4
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.js': 'application/javascript',
+    '.css': 'text/css',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+    '.svg': 'image/svg+xml',
+    '.json': 'application/json',
+    '.map': 'application/json',
+    '.txt': 'text/plain',
+    '.woff': 'font/woff',
+    '.woff2': 'font/woff2',
+}
+COMPRESSIBLE = ('.html', '.js', '.css', '.svg', '.json', '.map', '.ico', '.txt')
+HASHED_NAME = re.compile(r'\.[0-9a-f]{8,}\.[A-Za-z0-9]+$')   # vue-cli: app.3f2a9c1e.js
+SKIPPED_NAMES = ('asset-manifest.txt',)
+
+
+def collect_files(resource_dir):
+    files = []
+    for root, _, names in os.walk(resource_dir):
+        for name in names:
+            if name.endswith('.gz') or name in SKIPPED_NAMES:
+                continue
+            full_path = os.path.join(root, name)
+            uri = '/' + os.path.relpath(full_path, resource_dir).replace(os.sep, '/')
+            with open(full_path, 'rb') as f:
+                files.append((uri, f.read()))
+    # lookup on the device uses strcmp (byte order)
+    files.sort(key=lambda x: x[0].encode('utf-8'))
+    return files
+
+
+def align(offset):
+    return (offset + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def build_image(files):
+    header_size = struct.calcsize(HEADER_FORMAT)
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+
+    # string table (paths, mime types)
+    strings = bytearray()
+    string_offsets = {}
+    table_start = header_size + entry_size * len(files)
+
+    def add_string(text):
+        if text not in string_offsets:
+            string_offsets[text] = table_start + len(strings)
+            strings.extend(text.encode('utf-8') + b'\0')
+        return string_offsets[text]
+
+    records = []
+    for uri, content in files:
+        ext = os.path.splitext(uri)[1].lower()
+        mime = MIME_TYPES.get(ext, 'text/plain')
+        compressed = b''
+        if ext in COMPRESSIBLE:
+            compressed = gzip.compress(content, compresslevel=9, mtime=0)
+            if len(compressed) >= len(content):
+                compressed = b''
+        flags = WEB_IMAGE_FLAG_IMMUTABLE if HASHED_NAME.search(uri) else 0
+        etag = hashlib.sha256(content).digest()[:8]
+        records.append([add_string(uri), add_string(mime), content, compressed, etag, flags])
+
+    # file blobs
+    blobs = bytearray()
+    blob_start = align(table_start + len(strings))
+    entries = bytearray()
+    for path_offset, mime_offset, content, compressed, etag, flags in records:
+        data_offset = blob_start + len(blobs)
+        blobs.extend(content)
+        blobs.extend(b'\0' * (align(len(blobs)) - len(blobs)))
+        gzip_offset = 0
+        if compressed:
+            gzip_offset = blob_start + len(blobs)
+            blobs.extend(compressed)
+            blobs.extend(b'\0' * (align(len(blobs)) - len(blobs)))
+        entries.extend(struct.pack(ENTRY_FORMAT, path_offset, mime_offset, data_offset, len(content),
+                                   gzip_offset, len(compressed), etag, flags))
+
+    image_size = blob_start + len(blobs)
+    image = bytearray(struct.pack(HEADER_FORMAT, WEB_IMAGE_MAGIC, WEB_IMAGE_VERSION, len(files), image_size, 0))
+    image.extend(entries)
+    image.extend(strings)
+    image.extend(b'\0' * (blob_start - len(image)))
+    image.extend(blobs)
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='pack web resources into a web image partition binary')
+    parser.add_argument('resource_dir')
+    parser.add_argument('output')
+    parser.add_argument('--size', type=lambda x: int(x, 0), default=0, help='partition size (fail if the image does not fit)')
+    args = parser.parse_args()
+
+    files = collect_files(args.resource_dir)
+    if len(files) > 0xFFFF:
+        sys.exit('too many files (%d)' % len(files))
+    image = build_image(files)
+    if args.size and len(image) > args.size:
+        sys.exit('image (%d bytes) does not fit into partition (%d bytes)' % (len(image), args.size))
+
+    out_dir = os.path.dirname(args.output)
+    if out_dir and not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print('web image generated >> %s (%d files, %d bytes)' % (args.output, len(files), len(image)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,39 @@
+#! /usr/sh
+# build_web_image_partition.sh
+# purpose: build web resource as packed read-only image (.bin), served from memory mapped flash
+#          (alternative to build_spiffs_web_partition.sh, upload with flash_web_resource.sh)
+# reference: script/build_web_image.py, main/include/web_image.h
+
+cur_path=${PWD}
+if [[ "$OSTYPE" == "darwin"* ]]; then
+    project_path=$(dirname $(dirname $(realpath $0)))
+else 
+    project_path=$(dirname $(dirname $(realpath $BASH_SOURCE)))
+fi
+esp_idf_path=${project_path}/sdk/esp-idf
+
+# prepare environment (python)
+if [ -z "$IDF_PATH" ]; then
+  source ${esp_idf_path}/export.sh
+fi
+python=${python:-python}
+
+# set variables
+PARTITION_LABEL=web
+PARTITION_CSV_PATH=${project_path}/partitions.csv
+RESOURCE_DIR=${project_path}/main/web/dist
+BIN_OUT_PATH=${project_path}/main/web/out/${PARTITION_LABEL}.bin
+
+PARTITION_TABLE_OFFSET=0xC000   # defined in sdkconfig (CONFIG_PARTITION_TABLE_OFFSET)
+
+# 1) get partition size from partition csv file (parttool.py)
+PARTITION_SIZE=$(${python} ${esp_idf_path}/components/partition_table/parttool.py \
+                    --partition-table-offset ${PARTITION_TABLE_OFFSET} \
+                    --partition-table-file ${PARTITION_CSV_PATH} \
+                    get_partition_info --partition-name ${PARTITION_LABEL} --info size)
+echo "partition (${PARTITION_LABEL}): size=${PARTITION_SIZE}"
+
+# 2) create web image binary file
+${python} ${project_path}/script/build_web_image.py ${RESOURCE_DIR} ${BIN_OUT_PATH} --size ${PARTITION_SIZE}
+
+cd ${cur_path}
@@ -6,6 +6,44 @@ else
 fi
 
 cd ${project_path}/main/web
-npm run build
+npm run build || exit 1
+
+# precompress text assets and write manifest for the web server (ETag / Cache-Control)
+# line format: <uri path> <content hash> <gzip variant 0/1> <hashed file name 0/1>
+RESOURCE_DIR=${project_path}/main/web/dist
+MANIFEST_NAME=asset-manifest.txt
+if command -v sha256sum > /dev/null; then
+    sha256_cmd="sha256sum"
+else
+    sha256_cmd="shasum -a 256"
+fi
+
+cd ${RESOURCE_DIR}
+rm -f ${MANIFEST_NAME}
+find . -type f ! -name "*.gz" | sort | while read -r file; do
+    path=${file#.}
+    hash=$(${sha256_cmd} "$file" | cut -c1-16)
+
+    gzip_variant=0
+    case "$file" in
+        *.html|*.js|*.css|*.svg|*.json|*.map|*.ico|*.txt)
+            gzip -9 -n -c "$file" > "$file.gz"
+            if [ $(wc -c < "$file.gz") -lt $(wc -c < "$file") ]; then
+                gzip_variant=1
+            else
+                rm -f "$file.gz"
+            fi
+            ;;
+    esac
+
+    # vue-cli file names carry a content hash (app.3f2a9c1e.js), those never change
+    immutable=0
+    if echo "$path" | grep -Eq '\.[0-9a-f]{8,}\.[A-Za-z0-9]+$'; then
+        immutable=1
+    fi
+
+    echo "${path} ${hash} ${gzip_variant} ${immutable}" >> ${MANIFEST_NAME}
+done
+echo "asset manifest generated >> ${RESOURCE_DIR}/${MANIFEST_NAME}"
 
 cd ${cur_path}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# http_load_test.py
+# purpose: api latency (p50/p99) while static assets are downloaded by slow clients
+# usage: python http_load_test.py [--host 10.11.12.1] [--port 80] [--asset /js/app.js]
+#        [--downloaders 3] [--rate 32] [--api /api/v1/ws2812/state] [--duration 10] [--timeout 5]
+import argparse
+import socket
+import threading
+import time
+
+
+def http_get(host, port, path, rate_kbps=0, timeout=30., counter=None):
+    # one request per connection, rate_kbps > 0 reads the body like a slow client
+    # counter[0] is advanced while reading so partial downloads are accounted
+    sock = socket.create_connection((host, port), timeout=timeout)
+    try:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        request = 'GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n' % (path, host)
+        sock.sendall(request.encode())
+        total = 0
+        while True:
+            data = sock.recv(1024 if rate_kbps else 65536)
+            if not data:
+                break
+            total += len(data)
+            if counter is not None:
+                counter[0] += len(data)
+            if rate_kbps:
+                time.sleep(len(data) / (rate_kbps * 1024.))
+        return total
+    finally:
+        sock.close()
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(p / 100. * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def measure(args, downloaders):
+    stop = threading.Event()
+    downloaded = [0]
+
+    def download():
+        while not stop.is_set():
+            try:
+                http_get(args.host, args.port, args.asset, args.rate, counter=downloaded)
+            except OSError:
+                time.sleep(0.1)
+
+    threads = [threading.Thread(target=download, daemon=True) for _ in range(downloaders)]
+    for t in threads:
+        t.start()
+    time.sleep(0.5 if downloaders else 0)
+
+    latencies = []
+    errors = 0
+    end = time.monotonic() + args.duration
+    while time.monotonic() < end:
+        t0 = time.monotonic()
+        try:
+            http_get(args.host, args.port, args.api, timeout=args.timeout)
+            latencies.append((time.monotonic() - t0) * 1000.)
+        except OSError:
+            errors += 1
+        time.sleep(args.interval / 1000.)
+    stop.set()
+    return latencies, errors, downloaded[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='api latency under concurrent asset downloads')
+    parser.add_argument('--host', default='10.11.12.1')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('--asset', default='/js/app.js', help='large static file')
+    parser.add_argument('--api', default='/api/v1/ws2812/state')
+    parser.add_argument('--downloaders', type=int, default=3, help='concurrent asset downloads')
+    parser.add_argument('--rate', type=float, default=32, help='download speed per client (KB/s, 0: unlimited)')
+    parser.add_argument('--duration', type=float, default=10, help='seconds per phase')
+    parser.add_argument('--timeout', type=float, default=5, help='api call timeout (s), counted as error')
+    parser.add_argument('--interval', type=float, default=50, help='pause between api calls (ms)')
+    args = parser.parse_args()
+
+    for label, downloaders in (('idle', 0), ('downloads x%d' % args.downloaders, args.downloaders)):
+        latencies, errors, downloaded = measure(args, downloaders)
+        if not latencies:
+            print('%-16s no successful api call (%d errors)' % (label, errors))
+            continue
+        print('%-16s api calls %4d, p50 %7.1f ms, p99 %7.1f ms, max %7.1f ms, errors %d, downloaded %d KB' % (
+            label, len(latencies), percentile(latencies, 50), percentile(latencies, 99), max(latencies),
+            errors, downloaded // 1024))
+
+
+if __name__ == '__main__':
+    main()
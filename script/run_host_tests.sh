@@ -0,0 +1,57 @@
+#!/bin/bash
+# host build of the hardware independent modules (tests and benchmarks, no esp-idf needed)
+# usage: script/run_host_tests.sh [name ...]     (default: all)
+if [[ "$OSTYPE" == "darwin"* ]]; then
+    project_path=$(dirname $(dirname $(realpath $0)))
+else 
+    project_path=$(dirname $(dirname $(realpath $BASH_SOURCE)))
+fi
+
+CXX=${CXX:-g++}
+# warnings as in the esp-idf build
+CXXFLAGS="-std=gnu++17 -O2 -Wall -Wextra -Wno-unused-parameter -Wno-sign-compare -I${project_path}/main/include -I${project_path}/test/host/stubs"
+BUILD_DIR=${BUILD_DIR:-${TMPDIR:-/tmp}/ws2812_host_tests}
+TEST_DIR=${project_path}/test/host
+SRC_DIR=${project_path}/main/src
+# cJSON (esp-idf component) for the json_reader comparison, skipped if not found
+CJSON_DIR=${CJSON_DIR:-${IDF_PATH}/components/json/cJSON}
+mkdir -p ${BUILD_DIR}
+if [ -f "${CJSON_DIR}/cJSON.c" ] && ${CC:-gcc} -O2 -c -o ${BUILD_DIR}/cJSON.o ${CJSON_DIR}/cJSON.c; then
+    CJSON_FLAGS="-DHOST_CJSON -I${CJSON_DIR} ${BUILD_DIR}/cJSON.o"
+fi
+
+failed=0
+# run <test name> <main/src sources...> (EXTRA_FLAGS: additional compiler arguments)
+run() {
+    local name=$1
+    shift
+    if [ -n "${SELECTED}" ] && [[ " ${SELECTED} " != *" ${name} "* ]]; then
+        return
+    fi
+    local sources=""
+    for src in "$@"; do
+        sources="${sources} ${SRC_DIR}/${src}"
+    done
+    echo "== ${name}"
+    if ! ${CXX} ${CXXFLAGS} -o ${BUILD_DIR}/${name} ${TEST_DIR}/${name}.cpp ${sources} ${EXTRA_FLAGS} -lpthread; then
+        failed=1
+        return
+    fi
+    (cd ${TEST_DIR} && ${BUILD_DIR}/${name}) || failed=1
+}
+
+SELECTED="$*"
+run ws2812_encoder_bench    ws2812_encoder.cpp
+run ws2812_timeline_test    ws2812_timeline.cpp
+run ws2812_effect_bench     ws2812_effect.cpp ws2812_color.cpp
+run ws2812_color_test       ws2812_color.cpp ws2812_encoder.cpp
+run ws2812_frame_bench      ws2812_color.cpp ws2812_encoder.cpp
+run ws2812_stream_test      ws2812_stream.cpp
+run ws2812_geometry_test    ws2812_geometry.cpp logger.cpp
+run web_image_test          web_image.cpp
+EXTRA_FLAGS="${CJSON_FLAGS}" run json_reader_test json_reader.cpp ws2812_effect.cpp ws2812_color.cpp
+run memory_blob_test        memory_blob.cpp
+run logger_test             logger.cpp
+run logger_site_bench       logger.cpp
+
+exit ${failed}
@@ -0,0 +1,72 @@
+/**
+ * @file host_test.h
+ * @author yogyui
+ * @brief minimal check/bench helpers for host builds of the hardware independent modules
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        host_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+        printf("FAIL %s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        host_test_failures++; \
+    } \
+} while (0)
+
+// exit code of a test program
+inline int host_test_result(const char *name)
+{
+    printf("%s: %s\n", name, host_test_failures ? "FAILED" : "OK");
+    return host_test_failures ? 1 : 0;
+}
+
+inline double host_now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// best of `rounds` runs of fn() (ns per run), the minimum filters scheduler noise
+template<typename F>
+inline double host_bench_ns(int rounds, F fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < rounds; i++) {
+        double t0 = host_now_ns();
+        fn();
+        double t = host_now_ns() - t0;
+        if (t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// keeps the compiler from dropping benchmarked work
+template<typename T>
+inline void host_keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * @file json_reader_test.cpp
+ * @author yogyui
+ * @brief json_reader correctness, bounds and malformed input tests,
+ *        parse time and heap allocations against cJSON (when built with HOST_CJSON)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "json_reader.h"
+#include "ws2812_effect.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HOST_CJSON
+#include "cJSON.h"
+#endif
+
+/**
+ * heap allocation counter (glibc), covers malloc from cJSON and operator new
+ */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+static size_t s_alloc_cnt = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    s_alloc_cnt++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    s_alloc_cnt++;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    s_alloc_cnt++;
+    return __libc_realloc(ptr, size);
+}
+
+/**
+ * request struct and schema as in webserver.cpp (/api/v1/ws2812/config)
+ */
+typedef struct st_test_range
+{
+    uint16_t offset;
+    uint16_t length;
+    uint8_t rgb[3];
+} TestRange;
+
+static const JsonField range_fields[] = {
+    JSON_FIELD("offset", JSON_UINT16, TestRange, offset),
+    JSON_FIELD("length", JSON_UINT16, TestRange, length),
+    JSON_FIELD_ARRAY("rgb", TestRange, rgb, 3),
+};
+static const JsonSchema range_schema = JSON_SCHEMA(range_fields, 0x07);
+
+typedef struct st_test_config
+{
+    uint8_t brightness;
+    uint8_t rgb[3];
+    uint32_t fade;
+    bool enqueue;
+    uint8_t effect;
+    uint16_t gamma_x100;
+    char name[8];
+    uint8_t range_cnt;
+    TestRange ranges[2];
+} TestConfig;
+
+static const JsonField config_fields[] = {
+    JSON_FIELD("brightness", JSON_UINT8, TestConfig, brightness),
+    JSON_FIELD_ARRAY("rgb", TestConfig, rgb, 3),
+    JSON_FIELD("fade", JSON_UINT32, TestConfig, fade),
+    JSON_FIELD("queue", JSON_BOOL, TestConfig, enqueue),
+    JSON_FIELD_ENUM("effect", TestConfig, effect, ws2812_effect_from_name),
+    JSON_FIELD("gamma", JSON_FIXED100, TestConfig, gamma_x100),
+    JSON_FIELD_STRING("name", TestConfig, name),
+    JSON_FIELD_OBJECTS("ranges", TestConfig, ranges, 2, range_cnt, range_schema),
+};
+static const JsonSchema config_schema = JSON_SCHEMA(config_fields, 0);
+static const JsonSchema config_required_schema = JSON_SCHEMA(config_fields, 0x01);   // brightness
+
+static bool parse(const char *json, TestConfig *cfg, uint32_t *present = nullptr, const JsonSchema *schema = &config_schema)
+{
+    memset(cfg, 0, sizeof(TestConfig));
+    return json_read_object(json, strlen(json), schema, cfg, present);
+}
+
+static void test_fields()
+{
+    TestConfig cfg;
+    uint32_t present = 0;
+    CHECK(parse("{\"brightness\": 80, \"rgb\": [255, 0, 16], \"fade\": 4000000000, \"queue\": true,"
+                " \"effect\": \"rainbow\", \"gamma\": 2.25, \"name\": \"a\\\"b\","
+                " \"ranges\": [{\"offset\": 1, \"length\": 2, \"rgb\": [1, 2, 3]}, {\"rgb\": [4, 5, 6], \"length\": 7, \"offset\": 8}]}",
+                &cfg, &present));
+    CHECK_EQ(present, 0xFF);
+    CHECK_EQ(cfg.brightness, 80);
+    CHECK_EQ(cfg.rgb[0], 255);
+    CHECK_EQ(cfg.rgb[2], 16);
+    CHECK_EQ(cfg.fade, 4000000000UL);
+    CHECK(cfg.enqueue);
+    CHECK_EQ(cfg.effect, ws2812_effect_from_name("rainbow"));
+    CHECK_EQ(cfg.gamma_x100, 225);
+    CHECK(strcmp(cfg.name, "a\"b") == 0);
+    CHECK_EQ(cfg.range_cnt, 2);
+    CHECK_EQ(cfg.ranges[1].offset, 8);
+    CHECK_EQ(cfg.ranges[1].length, 7);
+    CHECK_EQ(cfg.ranges[1].rgb[2], 6);
+
+    // presence mask, unknown keys (nested) are skipped
+    CHECK(parse("{\"x\": {\"y\": [1, {\"z\": null}, \"s\", 1e5]}, \"fade\": 0, \"a_key_longer_than_any_field_name\": false}", &cfg, &present));
+    CHECK_EQ(present, 0x04);
+
+    // enum by number, bool from number, fixed point rounding
+    CHECK(parse("{\"effect\": 2, \"queue\": 0, \"gamma\": 1.005}", &cfg));
+    CHECK_EQ(cfg.effect, 2);
+    CHECK(!cfg.enqueue);
+    CHECK_EQ(cfg.gamma_x100, 101);
+
+    // extra array elements are ignored, missing ones untouched
+    CHECK(parse("{\"rgb\": [1, 2, 3, 4, 5]}", &cfg));
+    CHECK_EQ(cfg.rgb[2], 3);
+    CHECK(parse("{\"rgb\": [9]}", &cfg));
+    CHECK_EQ(cfg.rgb[0], 9);
+    CHECK_EQ(cfg.rgb[1], 0);
+
+    CHECK(parse(" { } ", &cfg, &present));
+    CHECK_EQ(present, 0);
+    CHECK(parse("{\"brightness\": 1}", &cfg, nullptr, &config_required_schema));
+}
+
+static void test_bounds()
+{
+    TestConfig cfg;
+    CHECK(parse("{\"brightness\": 255}", &cfg));
+    CHECK(!parse("{\"brightness\": 256}", &cfg));
+    CHECK(!parse("{\"brightness\": -1}", &cfg));
+    CHECK(!parse("{\"rgb\": [0, 300, 0]}", &cfg));
+    CHECK(parse("{\"fade\": 4294967295}", &cfg));
+    CHECK(!parse("{\"fade\": 4294967296}", &cfg));
+    CHECK(!parse("{\"fade\": 99999999999999999999}", &cfg));
+    CHECK(!parse("{\"gamma\": 655.36}", &cfg));
+    CHECK(!parse("{\"fade\": 1e3}", &cfg));
+    CHECK(parse("{\"name\": \"1234567\"}", &cfg));
+    CHECK(!parse("{\"name\": \"12345678\"}", &cfg));
+    CHECK(!parse("{\"effect\": \"no_such_effect\"}", &cfg));
+    CHECK(!parse("{\"effect\": \"a_name_longer_than_the_name_buffer\"}", &cfg));
+    // object array capacity and required fields of the nested schema
+    CHECK(!parse("{\"ranges\": [{\"offset\": 0, \"length\": 1, \"rgb\": []}, {\"offset\": 0, \"length\": 1, \"rgb\": []},"
+                 " {\"offset\": 0, \"length\": 1, \"rgb\": []}]}", &cfg));
+    CHECK(!parse("{\"ranges\": [{\"offset\": 0, \"length\": 1}]}", &cfg));
+    CHECK(!parse("{}", &cfg, nullptr, &config_required_schema));
+
+    // skip depth
+    char deep[64] = "{\"x\": ";
+    for (int depth = 1; depth <= JSON_READER_MAX_DEPTH + 1; depth++) {
+        strcat(deep, "[");
+    }
+    for (int depth = 1; depth <= JSON_READER_MAX_DEPTH + 1; depth++) {
+        strcat(deep, "]");
+    }
+    strcat(deep, "}");
+    CHECK(!parse(deep, &cfg));
+    deep[6] = ' ';
+    deep[6 + JSON_READER_MAX_DEPTH * 2 + 1] = ' ';
+    CHECK(parse(deep, &cfg));
+}
+
+static void test_malformed()
+{
+    static const char *inputs[] = {
+        "", "{", "}", "[]", "null", "{\"brightness\"}", "{\"brightness\": }", "{\"brightness\": 1,}",
+        "{\"brightness\": 1 \"fade\": 2}", "{\"brightness\": 1}}", "{\"brightness\": 1} x", "{brightness: 1}",
+        "{\"brightness\": 1.}", "{\"brightness\": .5}", "{\"brightness\": \"1\"}", "{\"queue\": tru}",
+        "{\"name\": \"abc}", "{\"name\": \"a\nb\"}", "{\"name\": \"\\u12\"}", "{\"rgb\": [1, 2}", "{\"rgb\": 1}",
+        "{\"x\": [1, 2}", "{\"x\": {\"y\" 1}}", "{\"x\": nul}",
+    };
+    TestConfig cfg;
+    for (const char *input : inputs) {
+        if (parse(input, &cfg)) {
+            printf("FAIL accepted: %s\n", input);
+            host_test_failures++;
+        }
+    }
+
+    // every truncation of a valid body is rejected, without reading past len
+    const char *body = "{\"brightness\": 80, \"rgb\": [1, 2, 3], \"name\": \"ab\", \"ranges\": [{\"offset\": 1, \"length\": 2, \"rgb\": [1]}]}";
+    size_t len = strlen(body);
+    for (size_t n = 0; n < len; n++) {
+        char *copy = (char *)malloc(n);     // exact size so that an overread is caught by sanitizers
+        memcpy(copy, body, n);
+        memset(&cfg, 0, sizeof(cfg));
+        CHECK(!json_read_object(copy, n, &config_schema, &cfg, nullptr));
+        free(copy);
+    }
+    CHECK(json_read_object(body, len, &config_schema, &cfg, nullptr));
+    CHECK(!json_read_object(nullptr, 0, &config_schema, &cfg, nullptr));
+}
+
+#ifdef HOST_CJSON
+// the handler code before json_reader: tree, lookups, conversion
+static bool parse_cjson(const char *json, size_t len, TestConfig *cfg)
+{
+    cJSON *item = cJSON_ParseWithLength(json, len);
+    if (!item) {
+        return false;
+    }
+    const cJSON *item_brightness = cJSON_GetObjectItemCaseSensitive(item, "brightness");
+    if (item_brightness) {
+        cfg->brightness = (uint8_t)item_brightness->valuedouble;
+    }
+    const cJSON *item_rgb = cJSON_GetObjectItemCaseSensitive(item, "rgb");
+    if (item_rgb && cJSON_GetArraySize(item_rgb) >= 3) {
+        for (int i = 0; i < 3; i++) {
+            cfg->rgb[i] = (uint8_t)cJSON_GetArrayItem(item_rgb, i)->valuedouble;
+        }
+    }
+    const cJSON *item_fade = cJSON_GetObjectItemCaseSensitive(item, "fade");
+    if (item_fade) {
+        cfg->fade = (uint32_t)item_fade->valuedouble;
+    }
+    const cJSON *item_queue = cJSON_GetObjectItemCaseSensitive(item, "queue");
+    if (item_queue) {
+        cfg->enqueue = cJSON_IsTrue(item_queue) || item_queue->valuedouble != 0;
+    }
+    const cJSON *item_effect = cJSON_GetObjectItemCaseSensitive(item, "effect");
+    if (cJSON_IsString(item_effect)) {
+        cfg->effect = (uint8_t)ws2812_effect_from_name(item_effect->valuestring);
+    }
+    cJSON_Delete(item);
+    return true;
+}
+#endif
+
+static void bench()
+{
+    static const char body[] = "{\"brightness\": 80, \"rgb\": [255, 128, 0], \"fade\": 500, \"queue\": false, \"effect\": \"rainbow\"}";
+    const size_t len = sizeof(body) - 1;
+    const int iterations = 10000;
+    TestConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+
+    size_t allocs = s_alloc_cnt;
+    CHECK(json_read_object(body, len, &config_schema, &cfg, nullptr));
+    allocs = s_alloc_cnt - allocs;
+    printf("json_reader: %zu allocations per parse\n", allocs);
+    CHECK_EQ(allocs, 0);
+    double ns = host_bench_ns(5, [&]() {
+        for (int i = 0; i < iterations; i++) {
+            host_keep(json_read_object(body, len, &config_schema, &cfg, nullptr));
+        }
+    });
+    printf("json_reader: %.0f ns per parse (%zu byte config body)\n", ns / iterations, len);
+
+#ifdef HOST_CJSON
+    TestConfig ref;
+    memset(&ref, 0, sizeof(ref));
+    // the handlers copied the body into a malloc'd buffer before parsing
+    allocs = s_alloc_cnt;
+    char *copy = (char *)malloc(len + 1);
+    memcpy(copy, body, len + 1);
+    CHECK(parse_cjson(copy, len, &ref));
+    free(copy);
+    allocs = s_alloc_cnt - allocs;
+    printf("cJSON:       %zu allocations per parse (body copy + tree)\n", allocs);
+    CHECK_EQ(ref.brightness, cfg.brightness);
+    CHECK_EQ(ref.effect, cfg.effect);
+    ns = host_bench_ns(5, [&]() {
+        for (int i = 0; i < iterations; i++) {
+            char *copy = (char *)malloc(len + 1);
+            memcpy(copy, body, len + 1);
+            host_keep(parse_cjson(copy, len, &ref));
+            free(copy);
+        }
+    });
+    printf("cJSON:       %.0f ns per parse\n", ns / iterations);
+#else
+    printf("cJSON:       not built (set CJSON_DIR or IDF_PATH to compare)\n");
+#endif
+}
+
+int main()
+{
+    test_fields();
+    test_bounds();
+    test_malformed();
+    bench();
+    return host_test_result("json_reader_test");
+}
@@ -0,0 +1,125 @@
+/**
+ * @file logger_site_bench.cpp
+ * @author yogyui
+ * @brief cost of log sites: code size (symbol sizes of this binary) and time per call
+ *        of a function with compiled out (LOGGER_MIN_LEVEL) sites against the same function without
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "logger.h"
+#include "esp_log.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+// GetLogger must not leave an open if behind (unbraced if/else around log sites below)
+#pragma GCC diagnostic error "-Wdangling-else"
+#pragma GCC diagnostic error "-Wparentheses"
+
+static_assert(!log_level_enabled(eLogType::Debug), "the disabled sites below are Debug (LOGGER_MIN_LEVEL Info)");
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+}
+
+static volatile uint32_t s_duty;
+static int s_evaluated = 0;
+
+static uint32_t evaluated(uint32_t value)
+{
+    s_evaluated++;
+    return value;
+}
+
+// hot path shapes: set_pwm_duty with a per call trace, without and with the trace compiled in
+extern "C" __attribute__((noinline)) uint32_t site_plain(uint32_t duty, bool verbose)
+{
+    s_duty = duty;
+    return duty * 3 + verbose;
+}
+
+extern "C" __attribute__((noinline)) uint32_t site_disabled(uint32_t duty, bool verbose)
+{
+    s_duty = duty;
+    if (verbose)
+        GetLogger(eLogType::Debug)->Log("set pwm duty: %u (%u)", duty, evaluated(duty));
+    else
+        GetLogger(eLogType::Debug)->Log("pwm duty: %u", evaluated(duty));
+    return duty * 3 + verbose;
+}
+
+extern "C" __attribute__((noinline)) uint32_t site_enabled(uint32_t duty, bool verbose)
+{
+    s_duty = duty;
+    if (verbose)
+        GetLogger(eLogType::Info)->Log("set pwm duty: %u", duty);
+    return duty * 3 + verbose;
+}
+
+// symbol size in this binary (nm), 0 if not found
+static long symbol_size(const char *name)
+{
+    char exe[256];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) {
+        return 0;
+    }
+    exe[len] = '\0';
+    std::string cmd = std::string("nm --print-size '") + exe + "' 2>/dev/null";
+    long size = 0;
+    FILE *fp = popen(cmd.c_str(), "r");
+    char line[512];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        char addr[32], type[4], sym[256];
+        unsigned long sz;
+        if (sscanf(line, "%31s %lx %3s %255s", addr, &sz, type, sym) == 4 && strcmp(sym, name) == 0) {
+            size = (long)sz;
+        }
+    }
+    if (fp) {
+        pclose(fp);
+    }
+    return size;
+}
+
+int main()
+{
+    long plain = symbol_size("site_plain");
+    long disabled = symbol_size("site_disabled");
+    long enabled = symbol_size("site_enabled");
+    if (plain && disabled) {
+        printf("code size: %ld bytes without log sites, %ld bytes with 2 compiled out sites, %ld bytes with 1 enabled site\n",
+               plain, disabled, enabled);
+        CHECK_EQ(disabled, plain);
+    } else {
+        printf("code size: nm not available\n");
+    }
+
+    const int iterations = 1000000;
+    uint32_t sum = 0;
+    double ns_plain = host_bench_ns(5, [&]() {
+        for (int i = 0; i < iterations; i++) {
+            sum += site_plain(i, i & 1);
+        }
+    });
+    double ns_disabled = host_bench_ns(5, [&]() {
+        for (int i = 0; i < iterations; i++) {
+            sum += site_disabled(i, i & 1);
+        }
+    });
+    host_keep(sum);
+    printf("time: %.2f ns per call without log sites, %.2f ns with compiled out sites\n",
+           ns_plain / iterations, ns_disabled / iterations);
+    CHECK_EQ(s_evaluated, 0);
+
+    return host_test_result("logger_site_bench");
+}
@@ -0,0 +1,294 @@
+/**
+ * @file logger_test.cpp
+ * @author yogyui
+ * @brief asynchronous logger tests (formatting, compile-time filter, ring stress with drop accounting,
+ *        no error record lost under load)
+ *        and cost of a log call against formatting in the caller
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "logger.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * output of the drain task (esp_log_write), one entry per record
+ * never destroyed: the drain task keeps running while the process exits
+ */
+static std::mutex s_out_lock;
+static std::vector<std::string> &s_out = *new std::vector<std::string>();
+static std::atomic<size_t> s_out_cnt{0};
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    char line[MAXLEN_LOG_MSG + 64];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(line, sizeof(line), format, ap);
+    va_end(ap);
+    std::lock_guard<std::mutex> lock(s_out_lock);
+    s_out.emplace_back(line);
+    s_out_cnt.fetch_add(1, std::memory_order_release);
+}
+
+static std::vector<std::string> take_output()
+{
+    std::lock_guard<std::mutex> lock(s_out_lock);
+    std::vector<std::string> out;
+    out.swap(s_out);
+    return out;
+}
+
+// waits until the drain task has written `count` lines in total (false on timeout)
+static bool wait_output(size_t count, int timeout_ms = 2000)
+{
+    for (int i = 0; i < timeout_ms && s_out_cnt.load(std::memory_order_acquire) < count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return s_out_cnt.load(std::memory_order_acquire) >= count;
+}
+
+// "I (123) logger: [func] message [file:line]\n" -> "[func] message [file:line]"
+static std::string record_text(const std::string &line)
+{
+    size_t begin = line.find(": [");
+    std::string text = begin == std::string::npos ? line : line.substr(begin + 2);
+    if (!text.empty() && text.back() == '\n') {
+        text.pop_back();
+    }
+    return text;
+}
+
+static int s_evaluated = 0;
+
+static int evaluated()
+{
+    return ++s_evaluated;
+}
+
+static void test_format()
+{
+    size_t base = s_out_cnt;
+    char volatile_buffer[16] = "copied";
+    int line = __LINE__ + 1;
+    GetLogger(eLogType::Warning)->Log("i %d u %u x %x neg %x s %s f %.2f c %c %% p %s", -5, 7u, 255, -1, volatile_buffer, 1.5, 'y', (const char *)nullptr);
+    strcpy(volatile_buffer, "overwritten");     // the record holds a copy
+    GetLogger(eLogType::Info)->Log("%s", "0123456789012345678901234567890123456789012345678901234567890123456789");
+    GetLogger(eLogType::Error)->Log("missing %d %d", 1);
+    GetLogger(eLogType::Debug)->Log("compiled out %d", evaluated());     // LOGGER_MIN_LEVEL is Info
+    CHECK(wait_output(base + 3));
+    std::vector<std::string> out = take_output();
+    CHECK_EQ(out.size(), 3);
+    if (out.size() == 3) {
+        char expected[160];
+        snprintf(expected, sizeof(expected), "[test_format] i -5 u 7 x ff neg ffffffff s copied f 1.50 c y %% p (null) [logger_test.cpp:%d]", line);
+        CHECK(record_text(out[0]) == expected);
+        CHECK(out[0][0] == 'W');
+        // strings are truncated to LOGGER_MAX_STRING
+        CHECK(out[1].find(std::string("] ") + std::string("0123456789012345678901234567890123456789012345678901234567890123456789").substr(0, LOGGER_MAX_STRING) + " [") != std::string::npos);
+        CHECK(record_text(out[2]).find("missing 1 <?>") != std::string::npos);
+        CHECK(out[2][0] == 'E');
+    }
+    CHECK_EQ(s_evaluated, 0);
+}
+
+struct CLoggerTestScope {
+    void member() {
+        GetLogger(eLogType::Info)->Log("member");
+    }
+    // log site as built by gcc 8: full __PRETTY_FUNCTION__, the drain task extracts the name
+    const char* unresolved(int repeat) {
+        for (int i = 0; i < repeat; i++) {
+            CLogger::Write(eLogType::Info, __PRETTY_FUNCTION__, 0, "logger_test.cpp", 1, "unresolved", nullptr, 0);
+        }
+        return __PRETTY_FUNCTION__;
+    }
+};
+
+static void test_funcname()
+{
+    size_t base = s_out_cnt;
+    CLoggerTestScope scope;
+    scope.member();
+    const char *pretty = scope.unresolved(3);   // first record fills the cache, the others hit it
+    CHECK(wait_output(base + 4));
+    std::vector<std::string> out = take_output();
+    CHECK_EQ(out.size(), 4);
+    if (out.size() == 4) {
+        CHECK(record_text(out[0]).find("[CLoggerTestScope::member] member [logger_test.cpp:") == 0);
+        for (size_t i = 1; i < out.size(); i++) {
+            CHECK(record_text(out[i]) == "[CLoggerTestScope::unresolved] unresolved [logger_test.cpp:1]");
+        }
+    }
+    CHECK(strstr(pretty, "const char* CLoggerTestScope::unresolved(int)") == pretty);
+}
+
+/**
+ * producers on both cores (several per core, concurrent compare-and-swap reservation) against the drain task:
+ * per producer sequence numbers must increase, strings must be intact and every call is either
+ * written or counted as dropped
+ */
+static void test_stress()
+{
+    const int producers = 6;
+    const int messages = 20000;
+    static const char text[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    take_output();
+    size_t base = s_out_cnt;
+    uint32_t dropped_base = CLogger::GetDropped();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++) {
+        threads.emplace_back([t]() {
+            host_core_id = t % portNUM_PROCESSORS;
+            for (int i = 0; i < messages; i++) {
+                GetLogger(eLogType::Info)->Log("t%d %d %s", t, i, (i % 3) ? text : "");
+                if (i % 16 == 0) {
+                    // bursts of 16, the drain task runs in between (some bursts still overflow the ring)
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    uint32_t dropped = CLogger::GetDropped() - dropped_base;
+    size_t written = producers * messages - dropped;
+    CHECK(wait_output(base + written, 5000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOGGER_DRAIN_MS * 3));   // drop report
+
+    int last[producers];
+    for (int &seq : last) {
+        seq = -1;
+    }
+    size_t records = 0;
+    int bad = 0;
+    bool drop_reported = dropped == 0;
+    for (const std::string &line : take_output()) {
+        int t, i;
+        char s[64] = "";
+        size_t pos = line.find("] t");
+        if (pos == std::string::npos) {
+            drop_reported |= line.find("log records dropped") != std::string::npos;
+            continue;
+        }
+        if (sscanf(line.c_str() + pos + 3, "%d %d %63s", &t, &i, s) < 2 || t < 0 || t >= producers || i <= last[t] ||
+            ((i % 3) && strcmp(s, text) != 0)) {
+            bad++;
+            continue;
+        }
+        last[t] = i;
+        records++;
+    }
+    printf("stress: %d producers x %d calls, %zu written, %u dropped, %d bad\n", producers, messages, records, dropped, bad);
+    CHECK_EQ(bad, 0);
+    CHECK_EQ(records, written);
+    CHECK(drop_reported);
+}
+
+/**
+ * the same load with an error every 64 calls: the ring overflows (info records are dropped),
+ * errors fall back to a synchronous write and none is lost
+ */
+static void test_error_under_load()
+{
+    const int producers = 6;
+    const int messages = 20000;
+    const int error_every = 64;
+    take_output();
+    uint32_t dropped_base = CLogger::GetDropped();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++) {
+        threads.emplace_back([t]() {
+            host_core_id = t % portNUM_PROCESSORS;
+            for (int i = 0; i < messages; i++) {
+                if (i % error_every == 0) {
+                    GetLogger(eLogType::Error)->Log("error t%d %d", t, i);
+                } else {
+                    GetLogger(eLogType::Info)->Log("info t%d %d", t, i);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    uint32_t dropped = CLogger::GetDropped() - dropped_base;
+    const int errors = producers * ((messages + error_every - 1) / error_every);
+    std::vector<bool> seen(producers * messages, false);
+    int received = 0;
+    for (int wait = 0; wait < 5000 && received < errors; wait += LOGGER_DRAIN_MS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOGGER_DRAIN_MS));
+        for (const std::string &line : take_output()) {
+            int t, i;
+            size_t pos = line.find("] error t");
+            if (pos != std::string::npos && sscanf(line.c_str() + pos + 9, "%d %d", &t, &i) == 2 &&
+                t >= 0 && t < producers && i >= 0 && i < messages && !seen[t * messages + i]) {
+                CHECK(line[0] == 'E');
+                seen[t * messages + i] = true;
+                received++;
+            }
+        }
+    }
+    printf("errors under load: %d of %d written, %u info records dropped\n", received, errors, dropped);
+    CHECK(dropped > 0);     // the fallback was exercised
+    CHECK_EQ(received, errors);
+}
+
+static void bench()
+{
+    // batches fit into the ring, each batch starts with a drained ring (no drops)
+    const int batch = 32;
+    const int rounds = 50;     // each round waits for a drain poll (LOGGER_DRAIN_MS)
+    int value = 0;
+    take_output();
+    uint32_t dropped = CLogger::GetDropped();
+    size_t expected = s_out_cnt;
+    double best = 1e30;
+    for (int round = 0; round < rounds; round++) {
+        CHECK(wait_output(expected));
+        take_output();
+        double t0 = host_now_ns();
+        for (int i = 0; i < batch; i++) {
+            GetLogger(eLogType::Info)->Log("brightness %d, duty %u", value++, 512u);
+        }
+        best = std::min(best, host_now_ns() - t0);
+        expected += batch;
+    }
+    CHECK_EQ(CLogger::GetDropped(), dropped);
+    printf("logger: %.0f ns per call (record into the ring)\n", best / batch);
+
+    // the same line formatted in the caller (snprintf), as before the asynchronous logger
+    char line[MAXLEN_LOG_MSG];
+    double ns = host_bench_ns(rounds, [&]() {
+        for (int i = 0; i < batch; i++) {
+            snprintf(line, sizeof(line), "[%s] brightness %d, duty %u [%s:%d]", "CWS2812Ctrl::set_brightness", value++, 512u, "ws2812.cpp", 123);
+            host_keep(line);
+        }
+    });
+    printf("snprintf: %.0f ns per call (formatting in the caller)\n", ns / batch);
+}
+
+int main()
+{
+    CHECK(StartLogger());
+    test_format();
+    test_funcname();
+    test_stress();
+    test_error_under_load();
+    bench();
+    return host_test_result("logger_test");
+}
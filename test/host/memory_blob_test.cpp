@@ -0,0 +1,215 @@
+/**
+ * @file memory_blob_test.cpp
+ * @author yogyui
+ * @brief versioned settings blob encode/decode tests (corruption, version and migration paths)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "memory_blob.h"
+#include <string.h>
+
+// v1 layout and its append only successor
+typedef struct st_test_state_v1
+{
+    uint8_t brightness;
+    uint8_t rgb[3];
+    uint16_t fade_ms;
+} TestStateV1;
+
+typedef struct st_test_state_v2
+{
+    uint8_t brightness;
+    uint8_t rgb[3];
+    uint16_t fade_ms;
+    uint16_t gamma_x100;    // new in v2
+    uint8_t strip_cnt;      // new in v2
+} TestStateV2;
+
+static TestStateV2 defaults_v2()
+{
+    TestStateV2 state;
+    memset(&state, 0, sizeof(state));
+    state.brightness = 100;
+    state.fade_ms = 1000;
+    state.gamma_x100 = 220;
+    state.strip_cnt = 1;
+    return state;
+}
+
+static TestStateV1 sample_v1()
+{
+    TestStateV1 state;
+    memset(&state, 0, sizeof(state));
+    state.brightness = 42;
+    state.rgb[0] = 255;
+    state.rgb[1] = 128;
+    state.rgb[2] = 1;
+    state.fade_ms = 250;
+    return state;
+}
+
+static int s_migrations = 0;
+
+static void migrate(uint16_t from, void *state)
+{
+    TestStateV2 *s = static_cast<TestStateV2 *>(state);
+    if (from == 1) {
+        s->fade_ms *= 2;    // v2 changed the unit of the shared field
+    }
+    s_migrations++;
+}
+
+static void test_crc()
+{
+    // ieee crc32 check value
+    CHECK_EQ(memory_blob_crc32(0, "123456789", 9), 0xCBF43926);
+    // incremental == one shot
+    uint32_t crc = memory_blob_crc32(0, "1234", 4);
+    CHECK_EQ(memory_blob_crc32(crc, "56789", 5), 0xCBF43926);
+}
+
+static void test_round_trip()
+{
+    TestStateV2 state = defaults_v2();
+    state.rgb[1] = 77;
+    uint8_t blob[sizeof(MemoryBlobHeader) + sizeof(TestStateV2)];
+    CHECK_EQ(memory_blob_encode(2, &state, sizeof(state), blob, sizeof(blob)), sizeof(blob));
+    CHECK_EQ(memory_blob_encode(2, &state, sizeof(state), blob, sizeof(blob) - 1), 0);
+
+    TestStateV2 out = defaults_v2();
+    CHECK_EQ(memory_blob_decode(blob, sizeof(blob), 2, &out, sizeof(out), migrate), MEMORY_BLOB_OK);
+    CHECK(memcmp(&out, &state, sizeof(state)) == 0);
+}
+
+static void test_corrupt()
+{
+    const TestStateV2 defaults = defaults_v2();
+    TestStateV2 state = defaults;
+    state.brightness = 7;
+    uint8_t blob[sizeof(MemoryBlobHeader) + sizeof(TestStateV2)];
+    size_t len = memory_blob_encode(2, &state, sizeof(state), blob, sizeof(blob));
+    TestStateV2 out;
+
+    // crc mismatch: every single bit flip in header or payload is caught, state is not written
+    int flips_missed = 0;
+    for (size_t bit = 0; bit < len * 8; bit++) {
+        uint8_t copy[sizeof(blob)];
+        memcpy(copy, blob, len);
+        copy[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        out = defaults;
+        if (memory_blob_decode(copy, len, 2, &out, sizeof(out), migrate) != MEMORY_BLOB_CORRUPT ||
+            memcmp(&out, &defaults, sizeof(out)) != 0) {
+            flips_missed++;
+        }
+    }
+    CHECK_EQ(flips_missed, 0);
+
+    // truncated blob (nvs returned fewer bytes), down to a partial header
+    for (size_t n = 0; n < len; n++) {
+        out = defaults;
+        CHECK_EQ(memory_blob_decode(blob, n, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+        CHECK(memcmp(&out, &defaults, sizeof(out)) == 0);
+    }
+
+    // hdr.length does not match the stored bytes: trailing bytes, and a shorter length with a valid crc
+    uint8_t longer[sizeof(blob) + 4];
+    memcpy(longer, blob, len);
+    memset(longer + len, 0, 4);
+    out = defaults;
+    CHECK_EQ(memory_blob_decode(longer, sizeof(longer), 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+    MemoryBlobHeader hdr;
+    memcpy(&hdr, longer, sizeof(hdr));
+    hdr.length -= 2;
+    hdr.crc = 0;
+    hdr.crc = memory_blob_crc32(memory_blob_crc32(0, &hdr, sizeof(hdr)), longer + sizeof(hdr), hdr.length);
+    memcpy(longer, &hdr, sizeof(hdr));
+    CHECK_EQ(memory_blob_decode(longer, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+    CHECK(memcmp(&out, &defaults, sizeof(out)) == 0);
+
+    // current version, but payload size differs from the struct (layout changed without a version bump)
+    TestStateV1 v1 = sample_v1();
+    uint8_t short_blob[sizeof(MemoryBlobHeader) + sizeof(TestStateV1)];
+    len = memory_blob_encode(2, &v1, sizeof(v1), short_blob, sizeof(short_blob));
+    out = defaults;
+    CHECK_EQ(memory_blob_decode(short_blob, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+    CHECK(memcmp(&out, &defaults, sizeof(out)) == 0);
+
+    // bad magic, version 0
+    uint8_t bad[sizeof(blob)];
+    len = memory_blob_encode(2, &state, sizeof(state), bad, sizeof(bad));
+    memcpy(&hdr, bad, sizeof(hdr));
+    hdr.magic = 0x12345678;
+    hdr.crc = 0;
+    hdr.crc = memory_blob_crc32(memory_blob_crc32(0, &hdr, sizeof(hdr)), bad + sizeof(hdr), hdr.length);
+    memcpy(bad, &hdr, sizeof(hdr));
+    CHECK_EQ(memory_blob_decode(bad, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+    len = memory_blob_encode(0, &state, sizeof(state), bad, sizeof(bad));
+    CHECK_EQ(memory_blob_decode(bad, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+}
+
+static void test_too_new()
+{
+    // a v3 blob (larger than v2) read by v2 firmware: valid, but not decoded
+    const TestStateV2 defaults = defaults_v2();
+    uint8_t payload[sizeof(TestStateV2) + 4];
+    memset(payload, 0xAA, sizeof(payload));
+    uint8_t blob[sizeof(MemoryBlobHeader) + sizeof(payload)];
+    size_t len = memory_blob_encode(3, payload, sizeof(payload), blob, sizeof(blob));
+    TestStateV2 out = defaults;
+    s_migrations = 0;
+    CHECK_EQ(memory_blob_decode(blob, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_TOO_NEW);
+    CHECK(memcmp(&out, &defaults, sizeof(out)) == 0);
+    CHECK_EQ(s_migrations, 0);
+    CHECK(strcmp(memory_blob_result_name(MEMORY_BLOB_TOO_NEW), "too new") == 0);
+}
+
+static void test_migrated()
+{
+    // v1 blob is a prefix of v2: shared fields are read, appended fields keep their defaults
+    TestStateV1 v1 = sample_v1();
+    uint8_t blob[sizeof(MemoryBlobHeader) + sizeof(TestStateV1)];
+    size_t len = memory_blob_encode(1, &v1, sizeof(v1), blob, sizeof(blob));
+
+    const TestStateV2 defaults = defaults_v2();
+    TestStateV2 out = defaults;
+    s_migrations = 0;
+    CHECK_EQ(memory_blob_decode(blob, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_MIGRATED);
+    CHECK_EQ(s_migrations, 1);
+    CHECK_EQ(out.brightness, v1.brightness);
+    CHECK_EQ(out.rgb[0], 255);
+    CHECK_EQ(out.rgb[2], 1);
+    CHECK_EQ(out.fade_ms, 500);
+    CHECK_EQ(out.gamma_x100, defaults.gamma_x100);
+    CHECK_EQ(out.strip_cnt, defaults.strip_cnt);
+
+    // one migration step per version, no hook: prefix copy only
+    out = defaults;
+    s_migrations = 0;
+    CHECK_EQ(memory_blob_decode(blob, len, 4, &out, sizeof(out), migrate), MEMORY_BLOB_MIGRATED);
+    CHECK_EQ(s_migrations, 3);
+    out = defaults;
+    CHECK_EQ(memory_blob_decode(blob, len, 2, &out, sizeof(out), nullptr), MEMORY_BLOB_MIGRATED);
+    CHECK_EQ(out.fade_ms, 250);
+    CHECK_EQ(out.gamma_x100, defaults.gamma_x100);
+
+    // an older version can not be larger than the current struct
+    uint8_t big[sizeof(MemoryBlobHeader) + sizeof(TestStateV2) + 2];
+    uint8_t payload[sizeof(TestStateV2) + 2] = {0};
+    len = memory_blob_encode(1, payload, sizeof(payload), big, sizeof(big));
+    out = defaults;
+    CHECK_EQ(memory_blob_decode(big, len, 2, &out, sizeof(out), migrate), MEMORY_BLOB_CORRUPT);
+    CHECK(memcmp(&out, &defaults, sizeof(out)) == 0);
+}
+
+int main()
+{
+    test_crc();
+    test_round_trip();
+    test_corrupt();
+    test_too_new();
+    test_migrated();
+    return host_test_result("memory_blob_test");
+}
@@ -0,0 +1,13 @@
+/**
+ * host stub of driver/gpio.h (esp32 output capable pins: 0-33 without 24, 28-31)
+ */
+#pragma once
+#ifndef _HOST_STUB_DRIVER_GPIO_H_
+#define _HOST_STUB_DRIVER_GPIO_H_
+
+#include <stdint.h>
+
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) \
+    ((gpio_num) >= 0 && (gpio_num) < 34 && ((1ULL << (gpio_num)) & 0xF1000000ULL) == 0)
+
+#endif
@@ -0,0 +1,11 @@
+/**
+ * host stub of esp_attr.h (code and data placement has no meaning on the host)
+ */
+#pragma once
+#ifndef _HOST_STUB_ESP_ATTR_H_
+#define _HOST_STUB_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * host stub of esp_log.h (logger.cpp output), esp_log_write is defined by the test
+ */
+#pragma once
+#ifndef _HOST_STUB_ESP_LOG_H_
+#define _HOST_STUB_ESP_LOG_H_
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+// no colors
+#define LOG_FORMAT(letter, format)  #letter " (%u) %s: " format "\n"
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * host stub of esp_timer.h (monotonic clock, us)
+ */
+#pragma once
+#ifndef _HOST_STUB_ESP_TIMER_H_
+#define _HOST_STUB_ESP_TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+inline int64_t esp_timer_get_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+#endif
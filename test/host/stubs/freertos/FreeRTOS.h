@@ -0,0 +1,36 @@
+/**
+ * host stub of FreeRTOS.h, tasks are threads and the "core" of a thread is host_core_id
+ */
+#pragma once
+#ifndef _HOST_STUB_FREERTOS_H_
+#define _HOST_STUB_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define portMAX_DELAY       0xFFFFFFFFU
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(x)    ((TickType_t)(x))
+#define portNUM_PROCESSORS  2
+
+// set by a test thread to pick the per core state it runs on (0 .. portNUM_PROCESSORS - 1)
+inline thread_local int host_core_id = 0;
+
+inline BaseType_t xPortGetCoreID()
+{
+    return host_core_id;
+}
+
+// test threads are never interrupt handlers
+inline BaseType_t xPortInIsrContext()
+{
+    return pdFALSE;
+}
+
+#endif
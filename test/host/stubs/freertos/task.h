@@ -0,0 +1,77 @@
+/**
+ * host stub of task.h, a task is a detached thread on core 0 with a notification counter
+ */
+#pragma once
+#ifndef _HOST_STUB_TASK_H_
+#define _HOST_STUB_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void *);
+
+struct HostTask {
+    std::mutex lock;
+    std::condition_variable cond;
+    uint32_t notified = 0;
+};
+typedef HostTask* TaskHandle_t;
+
+// task of the calling thread (nullptr for threads not created with xTaskCreate)
+inline thread_local HostTask *host_current_task = nullptr;
+
+inline BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_depth, void *param,
+                              UBaseType_t priority, TaskHandle_t *handle)
+{
+    HostTask *task = new HostTask();     // never freed, tasks run until the process exits
+    std::thread([task, func, param]() {
+        host_current_task = task;
+        func(param);
+    }).detach();
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->lock);
+        task->notified++;
+    }
+    task->cond.notify_one();
+    return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_woken)
+{
+    xTaskNotifyGive(task);
+    if (higher_priority_woken) {
+        *higher_priority_woken = pdFALSE;
+    }
+}
+
+#define portYIELD_FROM_ISR(x)   ((void)(x))
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    HostTask *task = host_current_task;
+    std::unique_lock<std::mutex> lock(task->lock);
+    task->cond.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), [task]() { return task->notified != 0; });
+    uint32_t value = task->notified;
+    if (value) {
+        task->notified = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+#endif
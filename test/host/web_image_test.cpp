@@ -0,0 +1,240 @@
+/**
+ * @file web_image_test.cpp
+ * @author yogyui
+ * @brief web image builder (script/build_web_image.py) and CWebImage parser tests
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "web_image.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#define BUILDER "../../script/build_web_image.py"
+
+typedef struct st_test_asset {
+    const char *path;
+    const char *mime;
+    std::string content;
+    bool gzip;
+    bool immutable;
+} TestAsset;
+
+static std::string s_dir;
+
+static std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::vector<uint8_t> data;
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp) {
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(fp);
+    }
+    return data;
+}
+
+static void write_file(const std::string &path, const void *data, size_t len)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    fwrite(data, 1, len, fp);
+    fclose(fp);
+}
+
+static std::string shell_output(const std::string &cmd)
+{
+    std::string out;
+    FILE *fp = popen(cmd.c_str(), "r");
+    char buf[256];
+    while (fp && fgets(buf, sizeof(buf), fp)) {
+        out += buf;
+    }
+    if (fp) {
+        pclose(fp);
+    }
+    return out;
+}
+
+static std::vector<TestAsset> make_assets()
+{
+    std::string js;
+    for (int i = 0; i < 400; i++) {
+        js += "export function f" + std::to_string(i) + "() { return " + std::to_string(i * 7) + "; }\n";
+    }
+    std::string png("\x89PNG\r\n\x1a\n", 8);
+    for (int i = 0; i < 300; i++) {
+        png += (char)(i * 131);
+    }
+    return {
+        {"/index.html", "text/html", "<!doctype html><html><body><div id=app></div></body></html>\n", false, false},
+        {"/js/app.3f2a9c1e.js", "application/javascript", js, true, true},
+        {"/css/app.css", "text/css", std::string(2000, 'a'), true, false},
+        {"/img/logo.png", "image/png", png, false, false},
+        {"/favicon.ico", "image/x-icon", "", false, false},
+        {"/a", "text/plain", "short\n", false, false},
+    };
+}
+
+// builder output read back through the parser: lookup, mime, etag, gzip variant, flags
+static void test_builder_round_trip(const std::vector<TestAsset> &assets, std::vector<uint8_t> *image)
+{
+    std::string res = s_dir + "/dist";
+    for (const char *sub : { "", "/js", "/css", "/img" }) {
+        mkdir((res + sub).c_str(), 0755);
+    }
+    for (const TestAsset &asset : assets) {
+        write_file(res + asset.path, asset.content.data(), asset.content.size());
+    }
+    // skipped by the builder
+    write_file(res + "/asset-manifest.txt", "x", 1);
+    write_file(res + "/index.html.gz", "x", 1);
+
+    std::string out = s_dir + "/web.bin";
+    CHECK_EQ(system(("python3 " BUILDER " " + res + " " + out + " > /dev/null").c_str()), 0);
+    // does not fit into a tiny partition
+    CHECK(system(("python3 " BUILDER " " + res + " " + s_dir + "/small.bin --size 0x100 2> /dev/null").c_str()) != 0);
+
+    *image = read_file(out);
+    CWebImage web;
+    CHECK(web.attach(image->data(), image->size()));
+    CHECK_EQ(web.get_entry_count(), assets.size());
+
+    for (const TestAsset &asset : assets) {
+        const WebImageEntry *entry = web.find(asset.path, strlen(asset.path));
+        CHECK(entry != nullptr);
+        if (!entry) {
+            continue;
+        }
+        CHECK_EQ(strcmp(web.get_string(entry->mime_offset), asset.mime), 0);
+        CHECK_EQ(entry->data_length, asset.content.size());
+        CHECK(memcmp(web.get_data(entry->data_offset), asset.content.data(), asset.content.size()) == 0);
+        CHECK_EQ(entry->data_offset % 4, 0);
+        CHECK_EQ(!!(entry->flags & WEB_IMAGE_FLAG_IMMUTABLE), asset.immutable);
+        CHECK_EQ(entry->gzip_length != 0, asset.gzip);
+
+        // etag: first 8 bytes of the sha256 of the identity content
+        std::string sha = shell_output("sha256sum " + s_dir + "/dist" + asset.path);
+        char etag[24], expected[24];
+        web_image_format_etag(entry, false, etag, sizeof(etag));
+        snprintf(expected, sizeof(expected), "\"%.16s\"", sha.c_str());
+        CHECK_EQ(strcmp(etag, expected), 0);
+        web_image_format_etag(entry, true, etag, sizeof(etag));
+        snprintf(expected, sizeof(expected), "\"%.16s-gz\"", sha.c_str());
+        CHECK_EQ(strcmp(etag, expected), 0);
+
+        if (entry->gzip_length) {
+            std::string gz = s_dir + "/variant.gz";
+            write_file(gz, web.get_data(entry->gzip_offset), entry->gzip_length);
+            CHECK_EQ(system(("gzip -dc " + gz + " | cmp -s - " + res + asset.path).c_str()), 0);
+        }
+    }
+
+    // query strings are cut by the caller passing the path length
+    const char *query = "/index.html?v=3";
+    CHECK(web.find(query, 11) != nullptr);
+    CHECK(web.find("/index", 6) == nullptr);
+    CHECK(web.find("/index.html.gz", 14) == nullptr);
+    CHECK(web.find("/asset-manifest.txt", 19) == nullptr);
+    CHECK(web.find("/", 1) == nullptr);
+    CHECK(web.find("/zzz", 4) == nullptr);
+}
+
+// images that must not attach: the index is trusted after attach()
+static void test_parser_rejects(const std::vector<uint8_t> &image)
+{
+    CWebImage web;
+    CHECK(!web.attach(nullptr, 0));
+    CHECK(!web.attach(image.data(), sizeof(WebImageHeader) - 1));
+
+    // truncated at every length
+    for (size_t len = 0; len < image.size(); len++) {
+        CHECK(!web.attach(image.data(), len));
+        CHECK(!web.is_attached());
+    }
+
+    WebImageHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    std::vector<uint8_t> bad;
+    auto patch_header = [&](const WebImageHeader &h) {
+        bad = image;
+        memcpy(bad.data(), &h, sizeof(h));
+        return web.attach(bad.data(), bad.size());
+    };
+    WebImageHeader h = header;
+    h.magic ^= 1;
+    CHECK(!patch_header(h));
+    h = header;
+    h.version = WEB_IMAGE_VERSION + 1;
+    CHECK(!patch_header(h));
+    h = header;
+    h.entry_cnt = 0xFFFF;
+    CHECK(!patch_header(h));
+
+    // entry fields pointing out of the image
+    const size_t field_offsets[] = {
+        offsetof(WebImageEntry, path_offset), offsetof(WebImageEntry, mime_offset),
+        offsetof(WebImageEntry, data_offset), offsetof(WebImageEntry, data_length),
+        offsetof(WebImageEntry, gzip_offset),
+    };
+    for (uint16_t i = 0; i < header.entry_cnt; i++) {
+        for (size_t field : field_offsets) {
+            bad = image;
+            uint32_t value = header.image_size + 1;
+            memcpy(bad.data() + sizeof(WebImageHeader) + i * sizeof(WebImageEntry) + field, &value, sizeof(value));
+            WebImageEntry entry;
+            memcpy(&entry, bad.data() + sizeof(WebImageHeader) + i * sizeof(WebImageEntry), sizeof(entry));
+            bool expect_reject = !(field == offsetof(WebImageEntry, gzip_offset) && entry.gzip_length == 0);
+            CHECK_EQ(web.attach(bad.data(), bad.size()), !expect_reject);
+        }
+    }
+
+    // unsorted index breaks the binary search
+    bad = image;
+    WebImageEntry first, second;
+    uint8_t *entries = bad.data() + sizeof(WebImageHeader);
+    memcpy(&first, entries, sizeof(first));
+    memcpy(&second, entries + sizeof(WebImageEntry), sizeof(second));
+    memcpy(entries, &second, sizeof(second));
+    memcpy(entries + sizeof(WebImageEntry), &first, sizeof(first));
+    CHECK(!web.attach(bad.data(), bad.size()));
+
+    // random corruption: attach may pass, but lookups stay inside the image
+    srand(1);
+    for (int round = 0; round < 2000; round++) {
+        bad = image;
+        for (int n = 0; n < 4; n++) {
+            bad[rand() % bad.size()] ^= (uint8_t)(1 << (rand() % 8));
+        }
+        if (web.attach(bad.data(), bad.size())) {
+            const WebImageEntry *entry = web.find("/index.html", 11);
+            if (entry) {
+                CHECK(entry->data_offset + entry->data_length <= bad.size());
+            }
+        }
+    }
+}
+
+int main()
+{
+    char dir[] = "/tmp/web_image_test.XXXXXX";
+    CHECK(mkdtemp(dir) != nullptr);
+    s_dir = dir;
+
+    std::vector<TestAsset> assets = make_assets();
+    std::vector<uint8_t> image;
+    test_builder_round_trip(assets, &image);
+    if (!image.empty()) {
+        test_parser_rejects(image);
+    }
+
+    system(("rm -rf " + s_dir).c_str());
+    return host_test_result("web_image_test");
+}
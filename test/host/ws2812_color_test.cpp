@@ -0,0 +1,132 @@
+/**
+ * @file ws2812_color_test.cpp
+ * @author yogyui
+ * @brief correction table, quantization and temporal dithering tests
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_color.h"
+#include "ws2812_encoder.h"
+#include "definition.h"
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+static void test_correction_tables()
+{
+    const WS2812Correction *corr = ws2812_default_correction();
+    for (int c = 0; c < 3; c++) {
+        CHECK_EQ(corr->lut[c][0], 0);
+        CHECK_EQ(corr->lut[c][255], 255 * 256);
+    }
+    // compile-time table matches powf within one 8.8 step, monotonic
+    for (int i = 1; i < 256; i++) {
+        double expected = pow(i / 255., WS2812_DEFAULT_GAMMA_X100 / 100.) * 255. * 256.;
+        CHECK(fabs(corr->lut[0][i] - expected) <= 1.);
+        CHECK(corr->lut[0][i] >= corr->lut[0][i - 1]);
+    }
+
+    // default calibration takes the compile-time table
+    WS2812Calibration cal = ws2812_default_calibration();
+    CHECK(!cal.dither);
+    WS2812Correction built;
+    ws2812_build_correction(&built, &cal);
+    for (int i = 0; i < 256; i++) {
+        CHECK_EQ(built.lut[1][i], corr->lut[1][i]);
+    }
+
+    // linear with white balance trim: value * balance / 255 in 8.8
+    cal.gamma_x100 = 100;
+    cal.white_balance[0] = 255;
+    cal.white_balance[1] = 200;
+    cal.white_balance[2] = 128;
+    ws2812_build_correction(&built, &cal);
+    for (int i = 0; i < 256; i++) {
+        for (int c = 0; c < 3; c++) {
+            long expected = lround(i / 255. * cal.white_balance[c] * 256.);
+            CHECK(labs((long)built.lut[c][i] - expected) <= 1);
+        }
+    }
+}
+
+static void test_quantize()
+{
+    // r = 1.5 (rounds up), g = 2.49 (rounds down), b = 255.0
+    const uint16_t linear[3] = { 0x0180, 0x027D, 0xFF00 };
+    uint32_t word = 0;
+    ws2812_quantize_pixels(linear, 1, WS2812_ORDER_GRB, &word);
+    CHECK_EQ(word, 0x0202FF);
+    ws2812_quantize_pixels(linear, 1, WS2812_ORDER_RGB, &word);
+    CHECK_EQ(word, 0x0202FF);
+    ws2812_quantize_pixels(linear, 1, WS2812_ORDER_BGR, &word);
+    CHECK_EQ(word, 0xFF0202);
+    // out of range order falls back to GRB
+    ws2812_quantize_pixels(linear, 1, WS2812_ORDER_COUNT, &word);
+    CHECK_EQ(word, 0x0202FF);
+
+    const uint16_t red[3] = { 0x1000, 0, 0 };
+    ws2812_quantize_pixels(red, 1, WS2812_ORDER_GRB, &word);
+    CHECK_EQ(word, 0x001000);
+    ws2812_quantize_pixels(red, 1, WS2812_ORDER_RGB, &word);
+    CHECK_EQ(word, 0x100000);
+}
+
+// accumulators: over 256 frames every 8.8 value is shown exactly on average,
+// and the running output never drifts more than one step from the ideal
+static void test_dither_accumulator()
+{
+    const size_t pixel_cnt = 4;
+    std::vector<uint8_t> error(pixel_cnt * 3);
+    std::vector<uint16_t> linear(pixel_cnt * 3);
+    std::vector<uint32_t> words(pixel_cnt);
+
+    for (uint32_t v = 0; v <= 255 * 256; v += 37) {
+        for (auto & l : linear) {
+            l = (uint16_t)v;
+        }
+        ws2812_dither_seed(error.data(), pixel_cnt);
+        uint64_t sum[pixel_cnt * 3] = {};
+        bool residual = false;
+        for (uint32_t frame = 1; frame <= 256; frame++) {
+            residual = ws2812_dither_pixels(linear.data(), pixel_cnt, WS2812_ORDER_RGB, error.data(), words.data());
+            for (size_t i = 0; i < pixel_cnt; i++) {
+                uint32_t out[3] = { (words[i] >> 16) & 0xFF, (words[i] >> 8) & 0xFF, words[i] & 0xFF };
+                for (int c = 0; c < 3; c++) {
+                    CHECK(out[c] == (v >> 8) || out[c] == (v >> 8) + 1);
+                    sum[i * 3 + c] += out[c];
+                    int64_t drift = (int64_t)sum[i * 3 + c] * 256 - (int64_t)frame * v;
+                    CHECK(drift > -256 && drift < 256);
+                }
+            }
+        }
+        for (size_t k = 0; k < pixel_cnt * 3; k++) {
+            CHECK_EQ(sum[k], v);
+        }
+        CHECK_EQ(residual, (v & 0xFF) != 0);
+    }
+
+    // neighbours do not toggle in phase
+    ws2812_dither_seed(error.data(), pixel_cnt);
+    CHECK(error[0] != error[3] && error[3] != error[6]);
+}
+
+// dither refresh can not be faster than one frame of the longest strip
+static void test_frame_time()
+{
+    CHECK(ws2812_frame_time_us(16) < WS2812_DITHER_FRAME_TIME_MS * 1000);
+    uint32_t us = ws2812_frame_time_us(1024);
+    CHECK(us > 30000 && us < 33000);
+    CHECK_EQ(ws2812_frame_time_us(0), WS2812_RESET_US);
+}
+
+int main()
+{
+    test_correction_tables();
+    test_quantize();
+    test_dither_accumulator();
+    test_frame_time();
+    return host_test_result("ws2812_color_test");
+}
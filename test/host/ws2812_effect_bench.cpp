@@ -0,0 +1,53 @@
+/**
+ * @file ws2812_effect_bench.cpp
+ * @author yogyui
+ * @brief render time per effect per pixel (1000 pixel frame)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_effect.h"
+#include "definition.h"
+#include <vector>
+
+int main()
+{
+    const size_t pixel_cnt = 1000;
+    const int frames = 100;
+    std::vector<RGB> pixels(pixel_cnt);
+
+    for (uint8_t type = WS2812_EFFECT_NONE + 1; type < WS2812_EFFECT_COUNT; type++) {
+        CWS2812Effect *effect = ws2812_create_effect(type);
+        CHECK(effect != nullptr);
+        if (!effect) {
+            continue;
+        }
+        CHECK(effect->resize(pixel_cnt));
+        effect->set_param(ws2812_effect_default_param());
+
+        // frames advance like the led task (WS2812_FRAME_TIME_MS ticks)
+        uint32_t now_ms = 0;
+        double ns = host_bench_ns(20, [&] {
+            for (int i = 0; i < frames; i++) {
+                effect->render(pixels.data(), pixel_cnt, now_ms);
+                now_ms += WS2812_FRAME_TIME_MS;
+                host_keep(pixels[0]);
+            }
+        });
+
+        bool lit = false;
+        for (const RGB &pixel : pixels) {
+            lit = lit || pixel.r || pixel.g || pixel.b;
+        }
+        CHECK(lit);
+
+        double frame_ns = ns / frames;
+        printf("%-8s %6.2f ns/pixel, %7.1f us/frame (%zu pixels)\n",
+               ws2812_effect_name(type), frame_ns / pixel_cnt, frame_ns / 1000, pixel_cnt);
+        delete effect;
+    }
+
+    return host_test_result("ws2812_effect_bench");
+}
@@ -0,0 +1,90 @@
+/**
+ * @file ws2812_encoder_bench.cpp
+ * @author yogyui
+ * @brief encode cost (ns/pixel) of the rmt and spi waveform encoders for long strips
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_encoder.h"
+#include "definition.h"
+#include <vector>
+
+// reference: one ws2812 bit at a time ('0' -> 100, '1' -> 110)
+static void encode_spi_reference(uint32_t grb, uint8_t *out)
+{
+    uint32_t bits[3] = {};
+    for (int b = WS2812_BITS_PER_PIXEL - 1, n = 0; b >= 0; b--, n++) {
+        uint32_t code = (grb & (1UL << b)) ? 0x6 : 0x4;
+        bits[n / 8] = (bits[n / 8] << 3) | code;
+    }
+    for (int i = 0; i < 3; i++) {
+        out[i * 3 + 0] = (uint8_t)(bits[i] >> 16);
+        out[i * 3 + 1] = (uint8_t)(bits[i] >> 8);
+        out[i * 3 + 2] = (uint8_t)bits[i];
+    }
+}
+
+static void check_encoders()
+{
+    const uint32_t values[] = { 0x000000, 0xFFFFFF, 0x123456, 0x80FF01, 0xA5A5A5 };
+    for (uint32_t grb : values) {
+        uint8_t expected[WS2812_SPI_BYTES_PER_PIXEL];
+        uint8_t encoded[WS2812_SPI_BYTES_PER_PIXEL];
+        encode_spi_reference(grb, expected);
+        CHECK_EQ(ws2812_encode_spi(&grb, 1, encoded), WS2812_SPI_BYTES_PER_PIXEL);
+        for (int i = 0; i < WS2812_SPI_BYTES_PER_PIXEL; i++) {
+            CHECK_EQ(encoded[i], expected[i]);
+        }
+    }
+
+    // 40MHz counter: 25ns ticks
+    WS2812RmtTiming timing = ws2812_rmt_timing(40000000);
+    CHECK_EQ(timing.bit0 & 0x7FFF, WS2812_T0H_NS / 25);
+    CHECK_EQ((timing.bit0 >> 16) & 0x7FFF, WS2812_T0L_NS / 25);
+    CHECK_EQ(timing.bit1 & 0x7FFF, WS2812_T1H_NS / 25);
+    uint32_t grb = 0x800001;
+    uint32_t items[WS2812_BITS_PER_PIXEL];
+    CHECK_EQ(ws2812_encode_rmt_items(&grb, 1, items, timing), WS2812_BITS_PER_PIXEL);
+    CHECK_EQ(items[0], timing.bit1);
+    CHECK_EQ(items[1], timing.bit0);
+    CHECK_EQ(items[WS2812_BITS_PER_PIXEL - 1], timing.bit1);
+}
+
+int main()
+{
+    check_encoders();
+
+    WS2812RmtTiming timing = ws2812_rmt_timing(80000000 / WS2812_RMT_CLK_DIV);
+    const size_t counts[] = { 1000, 4000 };
+    for (size_t pixel_cnt : counts) {
+        std::vector<uint32_t> grb(pixel_cnt);
+        for (size_t i = 0; i < pixel_cnt; i++) {
+            grb[i] = (uint32_t)(i * 2654435761u) & 0xFFFFFF;
+        }
+
+        // spi streaming encodes one ping-pong chunk at a time
+        std::vector<uint8_t> chunk(WS2812_SPI_CHUNK_PIXELS * WS2812_SPI_BYTES_PER_PIXEL);
+        double spi_ns = host_bench_ns(200, [&] {
+            for (size_t offset = 0; offset < pixel_cnt; offset += WS2812_SPI_CHUNK_PIXELS) {
+                size_t n = pixel_cnt - offset < WS2812_SPI_CHUNK_PIXELS ? pixel_cnt - offset : WS2812_SPI_CHUNK_PIXELS;
+                ws2812_encode_spi(&grb[offset], n, chunk.data());
+                host_keep(chunk[0]);
+            }
+        });
+
+        std::vector<uint32_t> items(pixel_cnt * WS2812_BITS_PER_PIXEL);
+        double rmt_ns = host_bench_ns(200, [&] {
+            ws2812_encode_rmt_items(grb.data(), pixel_cnt, items.data(), timing);
+            host_keep(items[0]);
+        });
+
+        // spi output memory: frame copy read by the interrupt + two chunk buffers
+        printf("%5zu pixels: spi %.2f ns/pixel (%zu bytes), rmt %.2f ns/pixel (%zu bytes)\n",
+               pixel_cnt, spi_ns / pixel_cnt, pixel_cnt * sizeof(uint32_t) + chunk.size() * 2, rmt_ns / pixel_cnt, items.size() * sizeof(uint32_t));
+    }
+
+    return host_test_result("ws2812_encoder_bench");
+}
@@ -0,0 +1,62 @@
+/**
+ * @file ws2812_frame_bench.cpp
+ * @author yogyui
+ * @brief frames per second of the raw frame path (copy, correction, quantize/dither, encode)
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_color.h"
+#include "ws2812_encoder.h"
+#include "definition.h"
+#include <string.h>
+#include <vector>
+
+// same steps as POST /api/v1/ws2812/frame -> write_frame -> convert_frame -> refresh_frame (rmt)
+int main()
+{
+    const size_t counts[] = { 16, 256, WS2812_MAX_RMT_PIXEL_COUNT };
+    const WS2812Correction *corr = ws2812_default_correction();
+    WS2812RmtTiming timing = ws2812_rmt_timing(80000000 / WS2812_RMT_CLK_DIV);
+
+    for (size_t pixel_cnt : counts) {
+        std::vector<RGB> request(pixel_cnt), back(pixel_cnt);
+        std::vector<uint16_t> linear(pixel_cnt * 3);
+        std::vector<uint8_t> error(pixel_cnt * 3);
+        std::vector<uint32_t> words(pixel_cnt);
+        std::vector<uint32_t> items(pixel_cnt * WS2812_BITS_PER_PIXEL);
+        for (size_t i = 0; i < pixel_cnt; i++) {
+            request[i] = RGB((uint8_t)i, (uint8_t)(i * 3), (uint8_t)(i * 7));
+        }
+        ws2812_dither_seed(error.data(), pixel_cnt);
+
+        const int frames = 50;
+        double plain_ns = host_bench_ns(20, [&] {
+            for (int f = 0; f < frames; f++) {
+                memcpy(back.data(), request.data(), pixel_cnt * sizeof(RGB));
+                ws2812_correct_pixels(back.data(), pixel_cnt, corr, linear.data());
+                ws2812_quantize_pixels(linear.data(), pixel_cnt, WS2812_ORDER_GRB, words.data());
+                ws2812_encode_rmt_items(words.data(), pixel_cnt, items.data(), timing);
+                host_keep(items[0]);
+            }
+        }) / frames;
+        double dither_ns = host_bench_ns(20, [&] {
+            for (int f = 0; f < frames; f++) {
+                memcpy(back.data(), request.data(), pixel_cnt * sizeof(RGB));
+                ws2812_correct_pixels(back.data(), pixel_cnt, corr, linear.data());
+                ws2812_dither_pixels(linear.data(), pixel_cnt, WS2812_ORDER_GRB, error.data(), words.data());
+                ws2812_encode_rmt_items(words.data(), pixel_cnt, items.data(), timing);
+                host_keep(items[0]);
+            }
+        }) / frames;
+
+        // the wire is the limit on target: one frame takes ws2812_frame_time_us
+        printf("%5zu pixels: %8.0f fps (%.1f us/frame), dithered %8.0f fps, wire limit %5.0f fps\n",
+               pixel_cnt, 1e9 / plain_ns, plain_ns / 1000, 1e9 / dither_ns, 1e6 / ws2812_frame_time_us(pixel_cnt));
+        CHECK(plain_ns > 0);
+    }
+
+    return host_test_result("ws2812_frame_bench");
+}
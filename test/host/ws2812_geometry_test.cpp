@@ -0,0 +1,121 @@
+/**
+ * @file ws2812_geometry_test.cpp
+ * @author yogyui
+ * @brief geometry validation tests (pins, backend per strip, rmt and spi pixel limits)
+ * @version 0.1
+ * @date 2023-03-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_geometry.h"
+#include "esp_log.h"
+
+// validation errors are logged, the logger task is not started (records stay in the ring)
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+}
+
+static WS2812Geometry make_geometry(const uint16_t *pixel_cnt, uint8_t strip_cnt)
+{
+    static const uint8_t pins[WS2812_MAX_STRIPS] = {18, 5, 4, 16, 17, 21, 22, 23};
+    WS2812Geometry geometry = ws2812_default_geometry();
+    geometry.strip_cnt = strip_cnt;
+    for (uint8_t i = 0; i < strip_cnt; i++) {
+        geometry.strips[i].gpio_pin_no = pins[i];
+        geometry.strips[i].pixel_cnt = pixel_cnt[i];
+        geometry.strips[i].color_order = WS2812_ORDER_GRB;
+    }
+    return geometry;
+}
+
+static void test_default()
+{
+    WS2812Geometry geometry = ws2812_default_geometry();
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_RMT));
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+    CHECK(ws2812_validate_geometry(&geometry));
+    CHECK_EQ(ws2812_geometry_pixel_count(&geometry), WS2812_PIXEL_COUNT);
+}
+
+static void test_strip_output()
+{
+    CHECK_EQ(ws2812_strip_output(0, WS2812_OUTPUT_SPI), WS2812_OUTPUT_SPI);
+    CHECK_EQ(ws2812_strip_output(1, WS2812_OUTPUT_SPI), WS2812_OUTPUT_RMT);
+    CHECK_EQ(ws2812_strip_output(0, WS2812_OUTPUT_RMT), WS2812_OUTPUT_RMT);
+}
+
+static void test_spi_limit()
+{
+    // a long strip on the spi host (streamed), too long for rmt items
+    const uint16_t long_strip[] = {4000};
+    WS2812Geometry geometry = make_geometry(long_strip, 1);
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+    CHECK(!ws2812_validate_geometry(&geometry, WS2812_OUTPUT_RMT));
+
+    const uint16_t max_strip[] = {WS2812_MAX_SPI_PIXEL_COUNT};
+    geometry = make_geometry(max_strip, 1);
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+    geometry.strips[0].pixel_cnt++;
+    CHECK(!ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+}
+
+static void test_rmt_limit()
+{
+    // the rmt limit counts rmt strips only: spi strip + rmt strips up to WS2812_MAX_RMT_PIXEL_COUNT
+    const uint16_t mixed[] = {4000, 512, 512};
+    WS2812Geometry geometry = make_geometry(mixed, 3);
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+    CHECK_EQ(ws2812_geometry_pixel_count(&geometry), 5024);
+    geometry.strips[2].pixel_cnt++;
+    CHECK(!ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+
+    const uint16_t rmt_only[] = {256, 256, 256, 256};
+    geometry = make_geometry(rmt_only, 4);
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_RMT));
+    geometry.strips[0].pixel_cnt++;
+    CHECK(!ws2812_validate_geometry(&geometry, WS2812_OUTPUT_RMT));
+    // in spi mode the first strip leaves the rmt budget
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_SPI));
+}
+
+static void test_invalid()
+{
+    const uint16_t strips[] = {16, 16};
+    WS2812Geometry geometry = make_geometry(strips, 2);
+    CHECK(ws2812_validate_geometry(&geometry, WS2812_OUTPUT_RMT));
+
+    WS2812Geometry bad = geometry;
+    bad.strips[1].gpio_pin_no = bad.strips[0].gpio_pin_no;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad = geometry;
+    bad.strips[1].gpio_pin_no = bad.pwm_pin_no;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad = geometry;
+    bad.strips[1].gpio_pin_no = 34;     // input only
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad = geometry;
+    bad.pwm_pin_no = 24;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad = geometry;
+    bad.strips[0].pixel_cnt = 0;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_SPI));
+    bad = geometry;
+    bad.strips[0].color_order = WS2812_ORDER_COUNT;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad = geometry;
+    bad.strip_cnt = 0;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+    bad.strip_cnt = WS2812_MAX_STRIPS + 1;
+    CHECK(!ws2812_validate_geometry(&bad, WS2812_OUTPUT_RMT));
+}
+
+int main()
+{
+    test_default();
+    test_strip_output();
+    test_spi_limit();
+    test_rmt_limit();
+    test_invalid();
+    return host_test_result("ws2812_geometry_test");
+}
@@ -0,0 +1,218 @@
+/**
+ * @file ws2812_stream_test.cpp
+ * @author yogyui
+ * @brief DDP / E1.31 / Art-Net decoder: packet captures and a udp loopback sender
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_stream.h"
+#include "definition.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// captures hold udp payloads as hex streams (wireshark "copy as hex stream"), one per line:
+//   <ddp|e131|artnet> <hex>
+// "# expect: frames n, stale n, ..." gives the decoder statistics after replay,
+// the last completed frame is 400 pixels of (i, 2i, 3i)
+#define CAPTURE_PIXELS  400
+
+static int protocol_from_name(const std::string &name)
+{
+    if (name == "ddp") return WS2812_STREAM_DDP;
+    if (name == "e131") return WS2812_STREAM_E131;
+    if (name == "artnet") return WS2812_STREAM_ARTNET;
+    return -1;
+}
+
+static bool expect_value(const std::string &expect, const char *key, uint32_t *value)
+{
+    size_t pos = expect.find(key);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    *value = (uint32_t)strtoul(expect.c_str() + pos + strlen(key), nullptr, 10);
+    return true;
+}
+
+static void replay_capture(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    CHECK(fp != nullptr);
+    if (!fp) {
+        return;
+    }
+
+    CWS2812StreamDecoder decoder(STREAM_E131_FIRST_UNIVERSE, STREAM_ARTNET_FIRST_UNIVERSE);
+    decoder.resize(CAPTURE_PIXELS);
+    std::vector<RGB> last(CAPTURE_PIXELS);
+    std::string expect;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        std::string text(line);
+        if (text.rfind("# expect:", 0) == 0) {
+            expect = text;
+        }
+        char name[16], hex[sizeof(line)];
+        if (text[0] == '#' || sscanf(line, "%15s %4095s", name, hex) != 2) {
+            continue;
+        }
+        std::vector<uint8_t> packet(strlen(hex) / 2);
+        for (size_t i = 0; i < packet.size(); i++) {
+            unsigned int byte;
+            sscanf(&hex[i * 2], "%2x", &byte);
+            packet[i] = (uint8_t)byte;
+        }
+        int protocol = protocol_from_name(name);
+        CHECK(protocol >= 0);
+        if (decoder.feed((uint8_t)protocol, packet.data(), packet.size())) {
+            memcpy(last.data(), decoder.get_frame(), CAPTURE_PIXELS * sizeof(RGB));
+        }
+    }
+    fclose(fp);
+
+    WS2812StreamStats stats;
+    decoder.get_stats(&stats);
+    printf("%-22s packets %u, frames %u, sync %u, stale %u, malformed %u, ignored %u\n", path, stats.packets,
+           stats.frames, stats.sync_packets, stats.dropped_stale, stats.dropped_malformed, stats.dropped_ignored);
+    uint32_t value;
+    CHECK(!expect.empty());
+    if (expect_value(expect, "frames ", &value)) CHECK_EQ(stats.frames, value);
+    if (expect_value(expect, "stale ", &value)) CHECK_EQ(stats.dropped_stale, value);
+    if (expect_value(expect, "malformed ", &value)) CHECK_EQ(stats.dropped_malformed, value);
+    if (expect_value(expect, "ignored ", &value)) CHECK_EQ(stats.dropped_ignored, value);
+    if (expect_value(expect, "sync ", &value)) CHECK_EQ(stats.sync_packets, value);
+    for (int i = 0; i < CAPTURE_PIXELS; i++) {
+        CHECK_EQ(last[i].r, i & 0xFF);
+        CHECK_EQ(last[i].g, (2 * i) & 0xFF);
+        CHECK_EQ(last[i].b, (3 * i) & 0xFF);
+    }
+}
+
+static void test_sequence_numbers()
+{
+    CHECK(!ws2812_stream_seq_stale(10, 11));
+    CHECK(ws2812_stream_seq_stale(10, 10));
+    CHECK(ws2812_stream_seq_stale(10, 250));     // 16 behind across the wrap
+    CHECK(!ws2812_stream_seq_stale(10, 246));    // 20 behind: sender restarted
+    CHECK(!ws2812_stream_seq_stale(255, 0));
+    CHECK(!ws2812_stream_ddp_seq_stale(15, 1));
+    CHECK(!ws2812_stream_ddp_seq_stale(3, 3));
+    CHECK(ws2812_stream_ddp_seq_stale(3, 1));
+}
+
+// e1.31 data packet as a sender builds it (ANSI E1.31-2016, 126 byte header)
+static size_t build_e131(uint8_t *p, uint16_t universe, uint8_t seq, const uint8_t *slots, uint16_t slot_cnt)
+{
+    size_t len = 126 + slot_cnt;
+    memset(p, 0, 126);
+    p[1] = 0x10;
+    memcpy(&p[4], "ASC-E1.17", 9);
+    p[16] = (uint8_t)(0x70 | ((len - 16) >> 8)); p[17] = (uint8_t)(len - 16);
+    p[21] = 0x04;
+    p[38] = (uint8_t)(0x70 | ((len - 38) >> 8)); p[39] = (uint8_t)(len - 38);
+    p[43] = 0x02;
+    p[108] = 100;
+    p[111] = seq;
+    p[113] = (uint8_t)(universe >> 8); p[114] = (uint8_t)universe;
+    p[115] = (uint8_t)(0x70 | ((len - 115) >> 8)); p[116] = (uint8_t)(len - 115);
+    p[117] = 0x02; p[118] = 0xA1; p[122] = 1;
+    p[123] = (uint8_t)((slot_cnt + 1) >> 8); p[124] = (uint8_t)(slot_cnt + 1);
+    memcpy(&p[126], slots, slot_cnt);
+    return len;
+}
+
+// sender thread -> 127.0.0.1 -> decoder, as the receiver task does with recvfrom
+static void test_loopback()
+{
+    const size_t pixel_cnt = WS2812_MAX_RMT_PIXEL_COUNT;
+    const int universe_cnt = (pixel_cnt + WS2812_STREAM_DMX_PIXELS - 1) / WS2812_STREAM_DMX_PIXELS;
+    const int frame_cnt = 2000;
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 1 << 20;
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    timeval timeout = {0, 200000};
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    CHECK(bind(rx, (sockaddr *)&addr, sizeof(addr)) == 0);
+    getsockname(rx, (sockaddr *)&addr, &addr_len);
+
+    std::atomic<uint32_t> sent{0};
+    std::thread sender([&] {
+        int tx = socket(AF_INET, SOCK_DGRAM, 0);
+        uint8_t packet[STREAM_MAX_PACKET];
+        uint8_t slots[510];
+        for (int f = 0; f < frame_cnt; f++) {
+            memset(slots, f & 0xFF, sizeof(slots));
+            for (int u = 0; u < universe_cnt; u++) {
+                uint16_t slot_cnt = (uint16_t)(std::min<size_t>(pixel_cnt - u * WS2812_STREAM_DMX_PIXELS, WS2812_STREAM_DMX_PIXELS) * 3);
+                size_t len = build_e131(packet, (uint16_t)(STREAM_E131_FIRST_UNIVERSE + u), (uint8_t)f, slots, slot_cnt);
+                sendto(tx, packet, len, 0, (sockaddr *)&addr, sizeof(addr));
+                sent++;
+                // every 100th frame repeats a universe: the receiver must drop it as stale
+                if (f % 100 == 0 && u == 0) {
+                    sendto(tx, packet, len, 0, (sockaddr *)&addr, sizeof(addr));
+                    sent++;
+                }
+            }
+            if (f % 8 == 0) {
+                usleep(100);    // let the receiver keep up (the loopback queue is finite)
+            }
+        }
+        close(tx);
+    });
+
+    CWS2812StreamDecoder decoder(STREAM_E131_FIRST_UNIVERSE, STREAM_ARTNET_FIRST_UNIVERSE);
+    decoder.resize(pixel_cnt);
+    uint8_t packet[STREAM_MAX_PACKET];
+    uint32_t received = 0;
+    double t0 = host_now_ns(), decode_ns = 0;
+    while (true) {
+        ssize_t len = recv(rx, packet, sizeof(packet), 0);
+        if (len <= 0) {
+            break;
+        }
+        received++;
+        double d0 = host_now_ns();
+        decoder.feed(WS2812_STREAM_E131, packet, (size_t)len);
+        decode_ns += host_now_ns() - d0;
+    }
+    double elapsed_s = (host_now_ns() - t0) / 1e9 - 0.2;
+    sender.join();
+    close(rx);
+
+    WS2812StreamStats stats;
+    decoder.get_stats(&stats);
+    printf("loopback e1.31 %zu pixels (%d universes): sent %u, received %u (lost %u), frames %u/%d, "
+           "stale %u, malformed %u\n", pixel_cnt, universe_cnt, sent.load(), received, sent.load() - received,
+           stats.frames, frame_cnt, stats.dropped_stale, stats.dropped_malformed);
+    printf("loopback throughput %.0f packets/s, %.0f frames/s, decode %.0f ns/packet\n",
+           received / elapsed_s, stats.frames / elapsed_s, received ? decode_ns / received : 0.);
+    CHECK_EQ(stats.dropped_malformed, 0);
+    CHECK(stats.frames > 0);
+    // repeated universes are dropped unless the packet itself was lost
+    CHECK(stats.dropped_stale <= frame_cnt / 100);
+    CHECK(stats.dropped_stale > 0 || received < sent.load());
+}
+
+int main()
+{
+    test_sequence_numbers();
+    replay_capture("captures/ddp.txt");
+    replay_capture("captures/e131.txt");
+    replay_capture("captures/artnet.txt");
+    test_loopback();
+    return host_test_result("ws2812_stream_test");
+}
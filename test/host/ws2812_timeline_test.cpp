@@ -0,0 +1,101 @@
+/**
+ * @file ws2812_timeline_test.cpp
+ * @author yogyui
+ * @brief keyframe track and easing tests
+ * @version 0.1
+ * @date 2023-03-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+#include "host_test.h"
+#include "ws2812_timeline.h"
+
+static void test_easing()
+{
+    const uint8_t easings[] = { WS2812_EASE_LINEAR, WS2812_EASE_IN, WS2812_EASE_OUT, WS2812_EASE_IN_OUT };
+    for (uint8_t easing : easings) {
+        CHECK_EQ(ws2812_ease(easing, 0), 0);
+        CHECK_EQ(ws2812_ease(easing, WS2812_Q16_ONE), WS2812_Q16_ONE);
+        uint32_t prev = 0;
+        for (uint32_t t = 0; t <= WS2812_Q16_ONE; t += 1024) {
+            uint32_t w = ws2812_ease(easing, t);
+            CHECK(w >= prev);
+            prev = w;
+        }
+    }
+    CHECK_EQ(ws2812_ease(WS2812_EASE_STEP, 1), WS2812_Q16_ONE);
+    CHECK_EQ(ws2812_lerp_u8(10, 200, WS2812_Q16_ONE / 2), 105);
+    CHECK_EQ(ws2812_lerp_u8(200, 10, WS2812_Q16_ONE / 2), 105);
+}
+
+// color tracks must be reset with 3 channels (CWS2812Ctrl constructor), a fade reaches all of them
+static void test_color_fade()
+{
+    CWS2812Track track;
+    const uint8_t black[3] = {0, 0, 0};
+    track.reset(black, 3);
+
+    WS2812Sequence seq;
+    const uint8_t target[3] = {10, 200, 50};
+    ws2812_sequence_init(&seq, 1);
+    ws2812_sequence_add(&seq, 300, WS2812_EASE_IN_OUT, target, 3);
+    CHECK(track.play(&seq, 1000, false));
+
+    track.advance(1150);
+    const uint8_t *value = track.get_value();
+    CHECK(value[1] > 0 && value[1] < 200);
+    CHECK(value[2] > 0 && value[2] < 50);
+
+    for (uint32_t now = 1150; now <= 1400; now += 20) {
+        track.advance(now);
+    }
+    CHECK(!track.is_active());
+    CHECK_EQ(value[0], 10);
+    CHECK_EQ(value[1], 200);
+    CHECK_EQ(value[2], 50);
+}
+
+static void test_sequence_queue()
+{
+    CWS2812Track track;
+    const uint8_t zero = 0;
+    track.reset(&zero, 1);
+
+    // blink twice: 100 -> 0, then hold 30
+    WS2812Sequence blink;
+    ws2812_sequence_init(&blink, 2);
+    const uint8_t on = 100, off = 0, hold = 30;
+    ws2812_sequence_add(&blink, 50, WS2812_EASE_STEP, &on, 1);
+    ws2812_sequence_add(&blink, 50, WS2812_EASE_STEP, &off, 1);
+    WS2812Sequence rest;
+    ws2812_sequence_init(&rest, 1);
+    ws2812_sequence_add(&rest, 0, WS2812_EASE_STEP, &hold, 1);
+
+    CHECK(track.play(&blink, 0, false));
+    CHECK(track.play(&rest, 0, true));
+    track.advance(10);
+    CHECK_EQ(track.get_value()[0], 100);
+    track.advance(60);
+    CHECK_EQ(track.get_value()[0], 0);
+    track.advance(110);
+    CHECK_EQ(track.get_value()[0], 100);
+    track.advance(200);
+    CHECK_EQ(track.get_value()[0], 30);
+    CHECK(!track.is_active());
+
+    // zero length keyframes can not loop forever
+    WS2812Sequence endless;
+    ws2812_sequence_init(&endless, 0);
+    ws2812_sequence_add(&endless, 0, WS2812_EASE_STEP, &on, 1);
+    CHECK(track.play(&endless, 300, false));
+    track.advance(300);
+    CHECK(!track.is_active());
+}
+
+int main()
+{
+    test_easing();
+    test_color_fade();
+    test_sequence_queue();
+    return host_test_result("ws2812_timeline_test");
+}